@@ -16,6 +16,8 @@
 #include "bbl_interactive.h"
 #include "bbl_ctrl.h"
 #include "bbl_stream.h"
+#include "bbl_session_traffic.h"
+#include "bbl_throughput.h"
 #include "bbl_dhcp.h"
 #include "bbl_dhcpv6.h"
 
@@ -70,6 +72,8 @@ enable_disable_traffic(bbl_ctx_s *ctx, bool status)
             session->stream_traffic = status;
         }
     }
+    /* Pass new state to stream threads */
+    bbl_stream_sync_threads(ctx);
 }
 
 static bool
@@ -97,6 +101,7 @@ bbl_add_multicast_packets(bbl_ctx_s *ctx)
         }
 
         interface->mc_packets = malloc(ctx->config.igmp_group_count * 2000);
+        interface->mc_templates = calloc(ctx->config.igmp_group_count, sizeof(bbl_template_t));
         buf = interface->mc_packets;
 
         for(i = 0; i < ctx->config.igmp_group_count; i++) {
@@ -138,9 +143,9 @@ bbl_add_multicast_packets(bbl_ctx_s *ctx)
             if(encode_ethernet(buf, &len, &eth) != PROTOCOL_SUCCESS) {
                 return false;
             }
+            bbl_template_init(&interface->mc_templates[i], buf, len, &bbl);
             buf = buf + len;
         }
-        interface->mc_packet_len = len;
     }
     return true;
 }
@@ -243,12 +248,8 @@ bbl_ctrl_job (timer_s *timer)
     bbl_ctx_s *ctx = timer->data;
     bbl_session_s *session;
     bbl_interface_s *interface;
-    int rate = 0;
     uint32_t i;
 
-    struct timespec timestamp;
-    struct timespec time_diff;
-
     /* Setup phase ...
      * Wait for all network interfaces to be resolved. */
     if(g_init_phase && !g_teardown) {
@@ -282,34 +283,157 @@ bbl_ctrl_job (timer_s *timer)
         }
         /* Teardown phase ... */
         if(g_teardown_request) {
-            /* Put all sessions on the teardown list. */
+            /* Put all sessions on the teardown list of their slice. */
             for(i = 0; i < ctx->sessions; i++) {
                 session = ctx->session_list[i];
                 if(session) {
                     if(!CIRCLEQ_NEXT(session, session_teardown_qnode)) {
                         /* Add only if not already on teardown list. */
-                        CIRCLEQ_INSERT_TAIL(&ctx->sessions_teardown_qhead, session, session_teardown_qnode);
+                        CIRCLEQ_INSERT_TAIL(&BBL_SESSION_SLICE(ctx, session)->teardown_qhead, session, session_teardown_qnode);
                     }
                 }
             }
             g_teardown_request = false;
+        }
+    } else {
+        bbl_stats_update_cps(ctx);
+    }
+}
+
+/**
+ * bbl_session_slice_teardown
+ *
+ * Process teardown list of slice.
+ *
+ * @param ctx global context
+ * @param slice session slice
+ * @param rate remaining teardown budget
+ * @return remaining teardown budget
+ */
+static uint32_t
+bbl_session_slice_teardown(bbl_ctx_s *ctx, bbl_session_slice_s *slice, uint32_t rate)
+{
+    bbl_session_s *session;
+
+    while (!CIRCLEQ_EMPTY(&slice->teardown_qhead)) {
+        session = CIRCLEQ_FIRST(&slice->teardown_qhead);
+        if(rate > 0) {
+            if(session->session_state != BBL_IDLE) rate--;
+            bbl_session_clear(ctx, session);
+            /* Remove from teardown queue. */
+            CIRCLEQ_REMOVE(&slice->teardown_qhead, session, session_teardown_qnode);
+            CIRCLEQ_NEXT(session, session_teardown_qnode) = NULL;
+            CIRCLEQ_PREV(session, session_teardown_qnode) = NULL;
         } else {
-            /* Process teardown list in chunks. */
-            rate = ctx->config.sessions_stop_rate;
-            while (!CIRCLEQ_EMPTY(&ctx->sessions_teardown_qhead)) {
-                session = CIRCLEQ_FIRST(&ctx->sessions_teardown_qhead);
-                if(rate > 0) {
-                    if(session->session_state != BBL_IDLE) rate--;
-                    bbl_session_clear(ctx, session);
-                    /* Remove from teardown queue. */
-                    CIRCLEQ_REMOVE(&ctx->sessions_teardown_qhead, session, session_teardown_qnode);
-                    CIRCLEQ_NEXT(session, session_teardown_qnode) = NULL;
-                    CIRCLEQ_PREV(session, session_teardown_qnode) = NULL;
-                } else {
-                    break;
+            break;
+        }
+    }
+    return rate;
+}
+
+/**
+ * bbl_session_slice_start
+ *
+ * Iterate over all idle session of slice (list of pending sessions)
+ * and start as much as permitted based on max outstanding and
+ * remaining setup budget. Sessions started will be removed from
+ * idle list.
+ *
+ * @param ctx global context
+ * @param slice session slice
+ * @param rate remaining setup budget
+ * @return remaining setup budget
+ */
+static uint32_t
+bbl_session_slice_start(bbl_ctx_s *ctx, bbl_session_slice_s *slice, uint32_t rate)
+{
+    bbl_session_s *session;
+
+    while (!CIRCLEQ_EMPTY(&slice->idle_qhead)) {
+        session = CIRCLEQ_FIRST(&slice->idle_qhead);
+        if(rate > 0) {
+            if(ctx->sessions_outstanding < ctx->config.sessions_max_outstanding) {
+                ctx->sessions_outstanding++;
+                rate--;
+                /* Start session */
+                switch (session->access_type) {
+                    case ACCESS_TYPE_PPPOE:
+                        /* PPP over Ethernet (PPPoE) */
+                        session->session_state = BBL_PPPOE_INIT;
+                        session->send_requests = BBL_SEND_DISCOVERY;
+                        break;
+                    case ACCESS_TYPE_IPOE:
+                        /* IP over Ethernet (IPoE) */
+                        session->session_state = BBL_IPOE_SETUP;
+                        session->send_requests = 0;
+                        if(session->access_config->ipv4_enable) {
+                            if(session->access_config->dhcp_enable) {
+                                /* Start IPoE session by sending DHCP discovery if enabled. */
+                                bbl_dhcp_start(session);
+                            } else if (session->ip_address && session->peer_ip_address) {
+                                /* Start IPoE session by sending ARP request if local and
+                                 * remote IP addresses are already provided. */
+                                session->send_requests |= BBL_SEND_ARP_REQUEST;
+                            }
+                        }
+                        if(session->access_config->ipv6_enable) {
+                            if(session->access_config->dhcpv6_enable) {
+                                /* Start IPoE session by sending DHCPv6 request if enabled. */
+                                bbl_dhcpv6_start(session);
+                            } else {
+                                /* Start IPoE session by sending RS. */
+                                session->send_requests |= BBL_SEND_ICMPV6_RS;
+                            }
+                        }
+                        break;
                 }
+                bbl_session_tx_qnode_insert(session);
+                /* Remove from idle queue */
+                CIRCLEQ_REMOVE(&slice->idle_qhead, session, session_idle_qnode);
+                CIRCLEQ_NEXT(session, session_idle_qnode) = NULL;
+                CIRCLEQ_PREV(session, session_idle_qnode) = NULL;
+            } else {
+                /* Max outstanding sessions reached. */
+                return 0;
             }
+        } else {
+            break;
         }
+    }
+    return rate;
+}
+
+/**
+ * bbl_session_slice_job
+ *
+ * This job is executed once per slice and second, serving
+ * the slices round robin. The configured setup and teardown
+ * rates are distributed over all time slices of a second.
+ * If the current slice has nothing to do, the remaining budget
+ * of this time slice is passed to the following slices.
+ */
+void
+bbl_session_slice_job (timer_s *timer)
+{
+    bbl_ctx_s *ctx = timer->data;
+    bbl_session_slice_s *slice;
+
+    uint32_t slices = ctx->config.session_slices;
+    uint32_t slot = ctx->session_slice_cursor;
+    uint32_t rate;
+    uint32_t i;
+
+    struct timespec timestamp;
+    struct timespec time_diff;
+
+    if((g_init_phase && !g_teardown) || g_teardown_request) {
+        return;
+    }
+
+    ctx->session_slice_cursor = (slot + 1) % slices;
+
+    if(g_teardown) {
+        rate = ctx->config.sessions_stop_rate;
     } else {
         /* Wait N seconds (default 0) before we start to setup sessions. */
         if(ctx->config.sessions_start_delay) {
@@ -319,60 +443,17 @@ bbl_ctrl_job (timer_s *timer)
                 return;
             }
         }
-        /* Iterate over all idle session (list of pending sessions)
-         * and start as much as permitted per interval based on max
-         * outstanding and setup rate. Sessions started will be removed
-         * from idle list. */
-        bbl_stats_update_cps(ctx);
         rate = ctx->config.sessions_start_rate;
-        while (!CIRCLEQ_EMPTY(&ctx->sessions_idle_qhead)) {
-            session = CIRCLEQ_FIRST(&ctx->sessions_idle_qhead);
-            if(rate > 0) {
-                if(ctx->sessions_outstanding < ctx->config.sessions_max_outstanding) {
-                    ctx->sessions_outstanding++;
-                    /* Start session */
-                    switch (session->access_type) {
-                        case ACCESS_TYPE_PPPOE:
-                            /* PPP over Ethernet (PPPoE) */
-                            session->session_state = BBL_PPPOE_INIT;
-                            session->send_requests = BBL_SEND_DISCOVERY;
-                            break;
-                        case ACCESS_TYPE_IPOE:
-                            /* IP over Ethernet (IPoE) */
-                            session->session_state = BBL_IPOE_SETUP;
-                            session->send_requests = 0;
-                            if(session->access_config->ipv4_enable) {
-                                if(session->access_config->dhcp_enable) {
-                                    /* Start IPoE session by sending DHCP discovery if enabled. */
-                                    bbl_dhcp_start(session);
-                                } else if (session->ip_address && session->peer_ip_address) {
-                                    /* Start IPoE session by sending ARP request if local and
-                                     * remote IP addresses are already provided. */
-                                    session->send_requests |= BBL_SEND_ARP_REQUEST;
-                                }
-                            }
-                            if(session->access_config->ipv6_enable) {
-                                if(session->access_config->dhcpv6_enable) {
-                                    /* Start IPoE session by sending DHCPv6 request if enabled. */
-                                    bbl_dhcpv6_start(session);
-                                } else {
-                                    /* Start IPoE session by sending RS. */
-                                    session->send_requests |= BBL_SEND_ICMPV6_RS;
-                                }
-                            }
-                            break;
-                    }
-                    bbl_session_tx_qnode_insert(session);
-                    /* Remove from idle queue */
-                    CIRCLEQ_REMOVE(&ctx->sessions_idle_qhead, session, session_idle_qnode);
-                    CIRCLEQ_NEXT(session, session_idle_qnode) = NULL;
-                    CIRCLEQ_PREV(session, session_idle_qnode) = NULL;
-                } else {
-                    break;
-                }
-            } else {
-                break;
-            }
+    }
+    /* Budget of this time slice. */
+    rate = ((rate * (slot + 1)) / slices) - ((rate * slot) / slices);
+
+    for(i = 0; i < slices && rate > 0; i++) {
+        slice = &ctx->session_slices[(slot + i) % slices];
+        if(g_teardown) {
+            rate = bbl_session_slice_teardown(ctx, slice, rate);
+        } else {
+            rate = bbl_session_slice_start(ctx, slice, rate);
         }
     }
 }
@@ -569,6 +650,26 @@ main (int argc, char *argv[])
     /* Setup control job. */
     timer_add_periodic(&ctx->timer_root, &ctx->control_timer, "Control Timer", 1, 0, ctx, &bbl_ctrl_job);
 
+    /* Setup session slice job. */
+    if(ctx->session_slices) {
+        if(ctx->config.session_slices > 1) {
+            timer_add_periodic(&ctx->timer_root, &ctx->session_slice_timer, "Session Slices", 0,
+                               SEC / ctx->config.session_slices, ctx, &bbl_session_slice_job);
+        } else {
+            timer_add_periodic(&ctx->timer_root, &ctx->session_slice_timer, "Session Slices", 1, 0,
+                               ctx, &bbl_session_slice_job);
+        }
+    }
+
+    /* Setup rate computation job. */
+    bbl_rate_sweep_start(&ctx->timer_root, &ctx->rate_sweep, ctx->config.rate_slices);
+
+    /* Setup session traffic jobs. */
+    bbl_session_traffic_init(ctx);
+
+    /* Setup throughput search job. */
+    bbl_throughput_start(ctx);
+
     /* Setup control socket and job */
     if(ctx->ctrl_socket_path) {
         if(!bbl_ctrl_socket_open(ctx)) {
@@ -24,6 +24,7 @@
 #include <getopt.h>
 #include <poll.h>
 #include <sys/epoll.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
@@ -9,6 +9,7 @@
 
 #include "bbl.h"
 #include "bbl_stream.h"
+#include "bbl_rx.h"
 
 void
 bbl_a10nsp_session_free(bbl_session_s *session)
@@ -243,10 +244,6 @@ bbl_a10nsp_pppoes_handler(bbl_interface_s *interface,
     bbl_bbl_t   *bbl;
 
     bbl_stream *stream;
-    void **search = NULL;
-
-    struct timespec delay;
-    uint64_t delay_nsec;
 
     switch(pppoes->protocol) {
         case PROTOCOL_LCP:
@@ -267,35 +264,9 @@ bbl_a10nsp_pppoes_handler(bbl_interface_s *interface,
                 udp = (bbl_udp_t*)ipv4->next;
                 if(udp->protocol == UDP_PROTOCOL_BBL) {
                     bbl = (bbl_bbl_t*)udp->next;
-                    search = dict_search(ctx->stream_flow_dict, &bbl->flow_id);
-                    if(search) {
-                        stream = *search;
-                        stream->packets_rx++;
-                        stream->rx_len = eth->length;
-                        stream->rx_priority = ipv4->tos;
-                        stream->rx_outer_vlan_pbit = eth->vlan_outer_priority;
-                        stream->rx_inner_vlan_pbit = eth->vlan_inner_priority;
-                        timespec_sub(&delay, &eth->timestamp, &bbl->timestamp);
-                        delay_nsec = delay.tv_sec * 1e9 + delay.tv_nsec;
-                        if(delay_nsec > stream->max_delay_ns) {
-                            stream->max_delay_ns = delay_nsec;
-                        }
-                        if(stream->min_delay_ns) {
-                            if(delay_nsec < stream->min_delay_ns) {
-                                stream->min_delay_ns = delay_nsec;
-                            }
-                        } else {
-                            stream->min_delay_ns = delay_nsec;
-                        }
-                        if(!stream->rx_first_seq) {
-                            stream->rx_first_seq = bbl->flow_seq;
-                            interface->ctx->stats.stream_traffic_flows_verified++;
-                        } else {
-                            if(stream->rx_last_seq +1 != bbl->flow_seq) {
-                                stream->loss++;
-                            }
-                        }
-                        stream->rx_last_seq = bbl->flow_seq;
+                    stream = bbl_stream_get(ctx, bbl->flow_id);
+                    if(stream) {
+                        bbl_rx_stream_account(interface, stream, eth, bbl, ipv4->tos);
                     } else {
                         if(bbl->flow_id == session->access_ipv4_tx_flow_id) {
                             interface->stats.session_ipv4_rx++;
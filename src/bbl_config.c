@@ -11,11 +11,16 @@
 #include "bbl.h"
 #include "bbl_config.h"
 #include "bbl_stream.h"
+#include "bbl_throughput.h"
 #include <sys/stat.h>
 
 const char g_default_user[] = "user{session-global}@rtbrick.com";
 const char g_default_pass[] = "test";
 
+static const char *g_tx_class_names[BBL_TX_CLASS_MAX] = {
+    "discovery", "lcp", "auth", "ncp", "dhcp", "misc", "traffic"
+};
+
 static void
 add_secondary_ipv4(bbl_ctx_s *ctx, uint32_t ipv4) {
     bbl_secondary_ip_s  *secondary_ip;
@@ -647,6 +652,274 @@ json_parse_a10nsp_interface (bbl_ctx_s *ctx, json_t *a10nsp_interface, bbl_a10ns
     return true;
 }
 
+static bool
+json_parse_throughput_search (json_t *config, bbl_throughput_s *search) {
+    json_t *value = NULL;
+    json_t *sub = NULL;
+    int i, size;
+
+    search->trial_time = 10;
+    search->drain_time = 2;
+    search->verify_timeout = 60;
+    search->rate_max = 100;
+    search->rate_resolution = 0.5;
+    search->teardown = true;
+
+    value = json_object_get(config, "trial-time");
+    if (value) {
+        if (!json_is_number(value) || json_number_value(value) < 1 || json_number_value(value) > 3600) {
+            fprintf(stderr, "JSON config error: Invalid value for throughput-search->trial-time\n");
+            return false;
+        }
+        search->trial_time = json_number_value(value);
+    }
+    value = json_object_get(config, "drain-time");
+    if (value) {
+        /* Counters of stream threads are synchronised with
+         * the main thread every STREAM_THREAD_SYNC_INTERVAL. */
+        if (!json_is_number(value) || json_number_value(value) <= STREAM_THREAD_SYNC_INTERVAL || json_number_value(value) > 3600) {
+            fprintf(stderr, "JSON config error: Invalid value for throughput-search->drain-time (valid range is %u-3600)\n",
+                    STREAM_THREAD_SYNC_INTERVAL + 1);
+            return false;
+        }
+        search->drain_time = json_number_value(value);
+    }
+    value = json_object_get(config, "verify-timeout");
+    if (value) {
+        if (!json_is_number(value) || json_number_value(value) < 1 || json_number_value(value) > 65535) {
+            fprintf(stderr, "JSON config error: Invalid value for throughput-search->verify-timeout\n");
+            return false;
+        }
+        search->verify_timeout = json_number_value(value);
+    }
+    value = json_object_get(config, "loss-tolerance");
+    if (json_is_number(value)) {
+        search->loss_tolerance = json_number_value(value);
+    }
+    value = json_object_get(config, "rate-min");
+    if (json_is_number(value)) {
+        search->rate_min = json_number_value(value);
+    }
+    value = json_object_get(config, "rate-max");
+    if (json_is_number(value)) {
+        search->rate_max = json_number_value(value);
+    }
+    value = json_object_get(config, "rate-resolution");
+    if (json_is_number(value)) {
+        search->rate_resolution = json_number_value(value);
+    }
+    if (search->loss_tolerance < 0 || search->loss_tolerance >= 100 ||
+        search->rate_min < 0 || search->rate_max <= search->rate_min ||
+        search->rate_resolution <= 0) {
+        fprintf(stderr, "JSON config error: Invalid rate or loss-tolerance in throughput-search\n");
+        return false;
+    }
+    value = json_object_get(config, "teardown");
+    if (json_is_boolean(value)) {
+        search->teardown = json_boolean_value(value);
+    }
+
+    sub = json_object_get(config, "lengths");
+    if (json_is_array(sub)) {
+        size = json_array_size(sub);
+        if (size > BBL_THROUGHPUT_LENGTHS_MAX) {
+            fprintf(stderr, "JSON config error: Too many throughput-search->lengths (max %u)\n", BBL_THROUGHPUT_LENGTHS_MAX);
+            return false;
+        }
+        for (i = 0; i < size; i++) {
+            value = json_array_get(sub, i);
+            if (!json_is_number(value) || json_number_value(value) < 76 || json_number_value(value) > 9000) {
+                fprintf(stderr, "JSON config error: Invalid value for throughput-search->lengths\n");
+                return false;
+            }
+            search->length[search->length_count++] = json_number_value(value);
+        }
+    }
+    if (!search->length_count) {
+        /* Search with configured stream lengths. */
+        search->length_count = 1;
+    }
+    return true;
+}
+
+static bool
+json_parse_stream_imix_add (bbl_stream_config *stream_config, double length, double weight) {
+    if (stream_config->imix_count >= STREAM_IMIX_MAX) {
+        fprintf(stderr, "JSON config error: Too many lengths (max %u) for stream %s\n", STREAM_IMIX_MAX, stream_config->name);
+        return false;
+    }
+    if (length < 76 || length > 9000) {
+        fprintf(stderr, "JSON config error: Invalid IMIX length for stream %s\n", stream_config->name);
+        return false;
+    }
+    if (weight < 1 || weight > STREAM_IMIX_SEQUENCE_MAX) {
+        fprintf(stderr, "JSON config error: Invalid IMIX weight for stream %s\n", stream_config->name);
+        return false;
+    }
+    stream_config->imix_length[stream_config->imix_count] = length;
+    stream_config->imix_weight[stream_config->imix_count] = weight;
+    stream_config->imix_count++;
+    return true;
+}
+
+/*
+ * Parse optional rate profile of a stream, which is a list
+ * of (time offset, pps) points starting with time offset zero.
+ * The cumulative number of packets to be sent until each point
+ * is precomputed, so that the send window can compute the
+ * packets expected at any time offset without iteration.
+ */
+static bool
+json_parse_stream_rate_profile (json_t *stream, bbl_stream_config *stream_config) {
+    json_t *sub = NULL;
+    json_t *point = NULL;
+    json_t *value = NULL;
+    const char *s = NULL;
+    double time, pps, max = 0;
+    int i, size;
+
+    sub = json_object_get(stream, "rate-profile");
+    if (!sub) {
+        return true;
+    }
+    size = json_array_size(sub);
+    if (!json_is_array(sub) || size < 1 || size > STREAM_RATE_PROFILE_MAX) {
+        fprintf(stderr, "JSON config error: Invalid rate-profile (1 - %u points) for stream %s\n", STREAM_RATE_PROFILE_MAX, stream_config->name);
+        return false;
+    }
+
+    if (json_unpack(stream, "{s:s}", "rate-profile-mode", &s) == 0) {
+        if (strcmp(s, "linear") == 0) {
+            stream_config->rate_profile_linear = true;
+        } else if (strcmp(s, "step") != 0) {
+            fprintf(stderr, "JSON config error: Invalid value for stream->rate-profile-mode\n");
+            return false;
+        }
+    }
+    value = json_object_get(stream, "rate-profile-repeat");
+    if (json_is_boolean(value)) {
+        stream_config->rate_profile_repeat = json_boolean_value(value);
+    }
+
+    stream_config->rate_profile_time = calloc(size, sizeof(double));
+    stream_config->rate_profile_pps = calloc(size, sizeof(double));
+    stream_config->rate_profile_packets = calloc(size, sizeof(double));
+    if (!(stream_config->rate_profile_time && stream_config->rate_profile_pps && stream_config->rate_profile_packets)) {
+        fprintf(stderr, "JSON config error: Failed to allocate rate profile for stream %s\n", stream_config->name);
+        return false;
+    }
+    for (i = 0; i < size; i++) {
+        point = json_array_get(sub, i);
+        time = json_number_value(json_object_get(point, "time"));
+        pps = json_number_value(json_object_get(point, "pps"));
+        if ((i == 0 && time != 0) || (i > 0 && time <= stream_config->rate_profile_time[i-1])) {
+            fprintf(stderr, "JSON config error: Rate profile time offsets of stream %s must start with 0 and increase\n", stream_config->name);
+            return false;
+        }
+        if (pps < 0) {
+            fprintf(stderr, "JSON config error: Invalid rate profile pps for stream %s\n", stream_config->name);
+            return false;
+        }
+        stream_config->rate_profile_time[i] = time;
+        stream_config->rate_profile_pps[i] = pps;
+        if (i > 0) {
+            stream_config->rate_profile_packets[i] = stream_config->rate_profile_packets[i-1] + (time - stream_config->rate_profile_time[i-1]) *
+                (stream_config->rate_profile_linear ? (stream_config->rate_profile_pps[i-1] + pps) / 2.0 : stream_config->rate_profile_pps[i-1]);
+        }
+        if (pps > max) max = pps;
+    }
+    if (max <= 0) {
+        fprintf(stderr, "JSON config error: Rate profile of stream %s without pps\n", stream_config->name);
+        return false;
+    }
+    stream_config->rate_profile_count = size;
+    stream_config->pps = max;
+    return true;
+}
+
+/*
+ * Parse optional IMIX definition of a stream, which is either a
+ * weighted list of lengths (imix) or a range of lengths with equal
+ * weight (length-min, length-max and length-step). The lengths are
+ * interleaved using smooth weighted round robin.
+ */
+static bool
+json_parse_stream_imix (json_t *stream, bbl_stream_config *stream_config) {
+    json_t *sub = NULL;
+    json_t *value = NULL;
+    json_t *weight = NULL;
+    double min, max, step;
+    int32_t current[STREAM_IMIX_MAX] = {0};
+    uint32_t total = 0;
+    uint64_t sum = 0;
+    size_t i;
+    uint8_t best;
+
+    sub = json_object_get(stream, "imix");
+    if (json_is_array(sub)) {
+        for (i = 0; i < json_array_size(sub); i++) {
+            value = json_object_get(json_array_get(sub, i), "length");
+            weight = json_object_get(json_array_get(sub, i), "weight");
+            if (!value) {
+                fprintf(stderr, "JSON config error: Missing value for stream->imix->length\n");
+                return false;
+            }
+            if (!json_parse_stream_imix_add(stream_config, json_number_value(value),
+                                            weight ? json_number_value(weight) : 1)) {
+                return false;
+            }
+        }
+    } else if (json_object_get(stream, "length-min") || json_object_get(stream, "length-max")) {
+        value = json_object_get(stream, "length-min");
+        min = value ? json_number_value(value) : 76;
+        value = json_object_get(stream, "length-max");
+        max = value ? json_number_value(value) : 1500;
+        value = json_object_get(stream, "length-step");
+        step = value ? json_number_value(value) : 64;
+        if (min > max || step < 1) {
+            fprintf(stderr, "JSON config error: Invalid length range for stream %s\n", stream_config->name);
+            return false;
+        }
+        for (; min < max; min += step) {
+            if (!json_parse_stream_imix_add(stream_config, min, 1)) {
+                return false;
+            }
+        }
+        if (!json_parse_stream_imix_add(stream_config, max, 1)) {
+            return false;
+        }
+    }
+    if (!stream_config->imix_count) {
+        return true;
+    }
+
+    for (i = 0; i < stream_config->imix_count; i++) {
+        total += stream_config->imix_weight[i];
+        sum += stream_config->imix_length[i] * stream_config->imix_weight[i];
+    }
+    if (total > STREAM_IMIX_SEQUENCE_MAX) {
+        fprintf(stderr, "JSON config error: Sum of IMIX weights exceeds %u for stream %s\n", STREAM_IMIX_SEQUENCE_MAX, stream_config->name);
+        return false;
+    }
+    stream_config->length = sum / total;
+    stream_config->imix_sequence = malloc(total);
+    if (!stream_config->imix_sequence) {
+        fprintf(stderr, "JSON config error: Failed to allocate IMIX sequence for stream %s\n", stream_config->name);
+        return false;
+    }
+    stream_config->imix_sequence_len = total;
+    for (total = 0; total < stream_config->imix_sequence_len; total++) {
+        best = 0;
+        for (i = 0; i < stream_config->imix_count; i++) {
+            current[i] += stream_config->imix_weight[i];
+            if (current[i] > current[best]) best = i;
+        }
+        current[best] -= stream_config->imix_sequence_len;
+        stream_config->imix_sequence[total] = best;
+    }
+    return true;
+}
+
 static bool
 json_parse_stream (bbl_ctx_s *ctx, json_t *stream, bbl_stream_config *stream_config) {
     json_t *value = NULL;
@@ -717,6 +990,11 @@ json_parse_stream (bbl_ctx_s *ctx, json_t *stream, bbl_stream_config *stream_con
         stream_config->length = 128;
     }
 
+    /* IMIX */
+    if (!json_parse_stream_imix(stream, stream_config)) {
+        return false;
+    }
+
     value = json_object_get(stream, "priority");
     if (value) {
         stream_config->priority = json_number_value(value);
@@ -748,6 +1026,34 @@ json_parse_stream (bbl_ctx_s *ctx, json_t *stream, bbl_stream_config *stream_con
     }
     if (!stream_config->pps) stream_config->pps = 1;
 
+    /* Rate Profile */
+    if (!json_parse_stream_rate_profile(stream, stream_config)) {
+        return false;
+    }
+
+    /* Burst */
+    value = json_object_get(stream, "burst-size");
+    if (value) {
+        if (json_number_value(value) < 1 || json_number_value(value) > STREAM_BURST_MAX) {
+            fprintf(stderr, "JSON config error: Invalid value for stream->burst-size (1 - %u)\n", STREAM_BURST_MAX);
+            return false;
+        }
+        if (stream_config->rate_profile_count) {
+            fprintf(stderr, "JSON config error: Stream %s with rate-profile and burst-size\n", stream_config->name);
+            return false;
+        }
+        stream_config->burst_size = json_number_value(value);
+        value = json_object_get(stream, "burst-interval");
+        if (value) {
+            /* The burst interval in milliseconds has priority over pps and bps. */
+            if (json_number_value(value) <= 0) {
+                fprintf(stderr, "JSON config error: Invalid value for stream->burst-interval\n");
+                return false;
+            }
+            stream_config->pps = stream_config->burst_size * 1000.0 / json_number_value(value);
+        }
+    }
+
     value = json_object_get(stream, "max-packets");
     if (value) {
         stream_config->max_packets = json_number_value(value);
@@ -860,6 +1166,30 @@ json_parse_stream (bbl_ctx_s *ctx, json_t *stream, bbl_stream_config *stream_con
         }
     }
 
+    /* Payload verification */
+    if (json_unpack(stream, "{s:s}", "payload-pattern", &s) == 0) {
+        if (strcmp(s, "zero") == 0) {
+            stream_config->payload_pattern = BBL_PADDING_ZERO;
+        } else if (strcmp(s, "counter") == 0) {
+            stream_config->payload_pattern = BBL_PADDING_COUNTER;
+        } else if (strcmp(s, "prbs") == 0) {
+            stream_config->payload_pattern = BBL_PADDING_PRBS;
+        } else {
+            fprintf(stderr, "JSON config error: Invalid value for stream->payload-pattern\n");
+            return false;
+        }
+    }
+    value = json_object_get(stream, "payload-verify");
+    if (value) {
+        if (!json_is_integer(value) ||
+            json_integer_value(value) < 0 ||
+            json_integer_value(value) > UINT32_MAX) {
+            fprintf(stderr, "JSON config error: Invalid value for stream->payload-verify (valid range is 0-%u)\n", UINT32_MAX);
+            return false;
+        }
+        stream_config->payload_verify = json_integer_value(value);
+    }
+
     /* Validate configuration */
     if (stream_config->stream_group_id == 0) {
         /* RAW stream */
@@ -935,6 +1265,14 @@ json_parse_config (json_t *root, bbl_ctx_s *ctx) {
         if (json_is_number(value)) {
             ctx->config.sessions_start_delay = json_number_value(value);
         }
+        value = json_object_get(section, "setup-slices");
+        if (json_is_number(value)) {
+            ctx->config.session_slices = json_number_value(value);
+            if (ctx->config.session_slices < 1 || ctx->config.session_slices > BBL_SESSION_SLICES_MAX) {
+                fprintf(stderr, "JSON config error: Invalid value for sessions->setup-slices\n");
+                return false;
+            }
+        }
     }
 
     /* IPoE Configuration */
@@ -1208,6 +1546,14 @@ json_parse_config (json_t *root, bbl_ctx_s *ctx) {
         if (json_is_boolean(value)) {
             ctx->config.igmp_combined_leave_join = json_boolean_value(value);
         }
+        value = json_object_get(section, "max-groups");
+        if (json_is_number(value)) {
+            if (json_number_value(value) < 1 || json_number_value(value) > BBL_IGMP_MAX_GROUPS_MAX) {
+                fprintf(stderr, "JSON config error: Invalid value for igmp->max-groups\n");
+                return false;
+            }
+            ctx->config.igmp_max_groups = json_number_value(value);
+        }
         value = json_object_get(section, "autostart");
         if (json_is_boolean(value)) {
             ctx->config.igmp_autostart = json_boolean_value(value);
@@ -1363,6 +1709,27 @@ json_parse_config (json_t *root, bbl_ctx_s *ctx) {
         if (json_is_number(value)) {
             ctx->config.io_stream_max_ppi = json_number_value(value);
         }
+        value = json_object_get(section, "rate-slices");
+        if (json_is_number(value)) {
+            if (json_number_value(value) < 1 || json_number_value(value) > 1000) {
+                fprintf(stderr, "JSON config error: Invalid value for interfaces->rate-slices\n");
+                return false;
+            }
+            ctx->config.rate_slices = json_number_value(value);
+        }
+        sub = json_object_get(section, "tx-class-weights");
+        if (json_is_object(sub)) {
+            for(i = 0; i < BBL_TX_CLASS_MAX; i++) {
+                value = json_object_get(sub, g_tx_class_names[i]);
+                if (json_is_number(value)) {
+                    if (json_number_value(value) < 1 || json_number_value(value) > UINT16_MAX) {
+                        fprintf(stderr, "JSON config error: Invalid value for interfaces->tx-class-weights->%s\n", g_tx_class_names[i]);
+                        return false;
+                    }
+                    ctx->config.tx_class_weight[i] = json_number_value(value);
+                }
+            }
+        }
 
         /* Network Interface Configuration Section */
         sub = json_object_get(section, "network");
@@ -1559,6 +1926,15 @@ json_parse_config (json_t *root, bbl_ctx_s *ctx) {
         }
     }
 
+    /* Throughput Search Configuration */
+    section = json_object_get(root, "throughput-search");
+    if (json_is_object(section)) {
+        ctx->throughput = calloc(1, sizeof(bbl_throughput_s));
+        if (!json_parse_throughput_search(section, ctx->throughput)) {
+            return false;
+        }
+    }
+
     /* Access Line Profiles Configuration */
     section = json_object_get(root, "access-line-profiles");
     if (json_is_array(section)) {
@@ -1684,11 +2060,20 @@ bbl_config_init_defaults (bbl_ctx_s *ctx) {
     ctx->config.rx_interval = 5 * MSEC;
     ctx->config.io_slots = 1024;
     ctx->config.io_stream_max_ppi = 32;
+    ctx->config.rate_slices = 1;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_DISCOVERY] = 8;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_LCP] = 8;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_AUTH] = 8;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_NCP] = 8;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_DHCP] = 8;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_MISC] = 4;
+    ctx->config.tx_class_weight[BBL_TX_CLASS_TRAFFIC] = 1;
     ctx->config.qdisc_bypass = true;
     ctx->config.sessions = 1;
     ctx->config.sessions_max_outstanding = 800;
     ctx->config.sessions_start_rate = 400;
     ctx->config.sessions_stop_rate = 400;
+    ctx->config.session_slices = 1;
     ctx->config.pppoe_discovery_timeout = 5;
     ctx->config.pppoe_discovery_retry = 10;
     ctx->config.ppp_mru = 1492;
@@ -1722,6 +2107,7 @@ bbl_config_init_defaults (bbl_ctx_s *ctx) {
     ctx->config.dhcpv6_retry = 10;
     ctx->config.igmp_autostart = true;
     ctx->config.igmp_version = IGMP_VERSION_3;
+    ctx->config.igmp_max_groups = 8;
     ctx->config.igmp_start_delay = 1;
     ctx->config.igmp_group = 0;
     ctx->config.igmp_group_iter = htobe32(1);
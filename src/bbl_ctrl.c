@@ -24,6 +24,7 @@
 #include "bbl_logging.h"
 #include "bbl_session.h"
 #include "bbl_stream.h"
+#include "bbl_throughput.h"
 #include "bbl_dhcp.h"
 #include "bbl_dhcpv6.h"
 
@@ -156,18 +157,20 @@ bbl_ctrl_igmp_join(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* argument
     /* Search session */
     session = bbl_session_get(ctx, session_id);
     if(session) {
-        /* Search for free slot ... */
-        for(i=0; i < IGMP_MAX_GROUPS; i++) {
-            if(!session->igmp_groups[i].zapping) {
-                if (session->igmp_groups[i].group == group_address) {
-                    group = &session->igmp_groups[i];
-                    if(group->state == IGMP_GROUP_IDLE) {
-                        break;
-                    } else {
-                        return bbl_ctrl_status(fd, "error", 409, "group already exists");
-                    }
-                } else if(session->igmp_groups[i].state == IGMP_GROUP_IDLE) {
+        /* Search for existing group ... */
+        group = bbl_igmp_group_get(session, group_address);
+        if(group && !group->zapping) {
+            if(group->state != IGMP_GROUP_IDLE) {
+                return bbl_ctrl_status(fd, "error", 409, "group already exists");
+            }
+        } else {
+            /* Search for free slot ... */
+            group = NULL;
+            for(i=0; i < session->igmp_group_count; i++) {
+                if(!session->igmp_groups[i].zapping &&
+                   session->igmp_groups[i].state == IGMP_GROUP_IDLE) {
                     group = &session->igmp_groups[i];
+                    break;
                 }
             }
         }
@@ -175,8 +178,14 @@ bbl_ctrl_igmp_join(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* argument
             return bbl_ctrl_status(fd, "error", 409, "no igmp group slot available");
         }
 
+        bbl_igmp_group_unindex(group);
         memset(group, 0x0, sizeof(bbl_igmp_group_s));
         group->group = group_address;
+        if(!bbl_igmp_group_index(ctx, session, group)) {
+            bbl_igmp_group_unindex(group);
+            group->group = 0;
+            return bbl_ctrl_status(fd, "error", 500, "failed to add igmp group");
+        }
         if(source1) group->source[0] = source1;
         if(source2) group->source[1] = source2;
         if(source3) group->source[2] = source3;
@@ -200,7 +209,6 @@ bbl_ctrl_igmp_leave(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* argumen
     const char *s;
     uint32_t group_address = 0;
     bbl_igmp_group_s *group = NULL;
-    int i;
 
     if(session_id == 0) {
         /* session-id is mandatory */
@@ -217,12 +225,7 @@ bbl_ctrl_igmp_leave(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* argumen
     session = bbl_session_get(ctx, session_id);
     if(session) {
         /* Search for group ... */
-        for(i=0; i < IGMP_MAX_GROUPS; i++) {
-            if (session->igmp_groups[i].group == group_address) {
-                group = &session->igmp_groups[i];
-                break;
-            }
-        }
+        group = bbl_igmp_group_get(session, group_address);
         if(!group) {
             return bbl_ctrl_status(fd, "warning", 404, "group not found");
         }
@@ -270,7 +273,7 @@ bbl_ctrl_igmp_info(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* argument
     if(session) {
         groups = json_array();
         /* Add group informations */
-        for(i=0; i < IGMP_MAX_GROUPS; i++) {
+        for(i=0; i < session->igmp_group_count; i++) {
             group = &session->igmp_groups[i];
             if(group->group) {
                 sources = json_array();
@@ -1147,12 +1150,13 @@ bbl_ctrl_cfm_cc_rdi_off(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* arg
 ssize_t
 bbl_ctrl_stream_stats(int fd, bbl_ctx_s *ctx, uint32_t session_id __attribute__((unused)), json_t* arguments __attribute__((unused))) {
     ssize_t result = 0;
-    json_t *root = json_pack("{ss si s{si si}}",
+    json_t *root = json_pack("{ss si s{si si so*}}",
                              "status", "ok",
                              "code", 200,
                              "stream-stats",
                              "total-flows", ctx->stats.stream_traffic_flows,
-                             "verified-flows", ctx->stats.stream_traffic_flows_verified);
+                             "verified-flows", ctx->stats.stream_traffic_flows_verified,
+                             "threads", bbl_stream_thread_json(ctx));
     if(root) {
         result = json_dumpfd(root, fd, 0);
         json_decref(root);
@@ -1168,7 +1172,6 @@ bbl_ctrl_stream_info(int fd, bbl_ctx_s *ctx, uint32_t session_id __attribute__((
     json_t *json_stream = NULL;
 
     bbl_stream *stream;
-    void **search = NULL;
 
     int number = 0;
     uint64_t flow_id;
@@ -1179,12 +1182,8 @@ bbl_ctrl_stream_info(int fd, bbl_ctx_s *ctx, uint32_t session_id __attribute__((
     }
 
     flow_id = number;
-    search = dict_search(ctx->stream_flow_dict, &flow_id);
-    if(search) {
-        stream = *search;
-        if(stream->thread.thread) {
-            pthread_mutex_lock(&stream->thread.mutex);
-        }
+    stream = bbl_stream_get(ctx, flow_id);
+    if(stream) {
         json_stream = bbl_stream_json(stream);
         root = json_pack("{ss si so*}",
                          "status", "ok",
@@ -1197,15 +1196,126 @@ bbl_ctrl_stream_info(int fd, bbl_ctx_s *ctx, uint32_t session_id __attribute__((
             result = bbl_ctrl_status(fd, "error", 500, "internal error");
             json_decref(json_stream);
         }
-        if(stream->thread.thread) {
-            pthread_mutex_unlock(&stream->thread.mutex);
-        }
         return result;
     } else {
         return bbl_ctrl_status(fd, "warning", 404, "stream not found");
     }
 }
 
+ssize_t
+bbl_ctrl_throughput_search(int fd, bbl_ctx_s *ctx, uint32_t session_id __attribute__((unused)), json_t* arguments __attribute__((unused))) {
+    ssize_t result = 0;
+    json_t *root;
+
+    if(!ctx->throughput) {
+        return bbl_ctrl_status(fd, "warning", 404, "throughput search not configured");
+    }
+    root = json_pack("{ss si so*}",
+                     "status", "ok",
+                     "code", 200,
+                     "throughput-search", bbl_throughput_json(ctx));
+    if(root) {
+        result = json_dumpfd(root, fd, 0);
+        json_decref(root);
+    }
+    return result;
+}
+
+static bool
+bbl_ctrl_stream_rate_match(bbl_stream *stream, uint32_t session_id, int stream_group_id) {
+    if(session_id && !(stream->session && stream->session->session_id == session_id)) {
+        return false;
+    }
+    if(stream_group_id >= 0 && stream->config->stream_group_id != stream_group_id) {
+        return false;
+    }
+    return true;
+}
+
+ssize_t
+bbl_ctrl_stream_rate(int fd, bbl_ctx_s *ctx, uint32_t session_id, json_t* arguments) {
+    ssize_t result = 0;
+
+    json_t *root;
+    json_t *value;
+
+    struct dict_itor *itor;
+    bbl_stream *stream;
+
+    double pps = 0;
+    double scale = 0;
+    int stream_group_id = -1;
+    uint32_t streams = 0;
+
+    /* Unpack further arguments */
+    value = json_object_get(arguments, "pps");
+    if(value) {
+        if(!json_is_number(value) || json_number_value(value) <= 0) {
+            return bbl_ctrl_status(fd, "error", 400, "invalid pps");
+        }
+        pps = json_number_value(value);
+    }
+    value = json_object_get(arguments, "scale");
+    if(value) {
+        if(!json_is_number(value) || json_number_value(value) <= 0) {
+            return bbl_ctrl_status(fd, "error", 400, "invalid scale");
+        }
+        scale = json_number_value(value);
+    }
+    if((pps > 0) == (scale > 0)) {
+        return bbl_ctrl_status(fd, "error", 400, "either pps or scale required");
+    }
+    value = json_object_get(arguments, "stream-group-id");
+    if(value) {
+        if(!json_is_integer(value)) {
+            return bbl_ctrl_status(fd, "error", 400, "invalid stream-group-id");
+        }
+        stream_group_id = json_integer_value(value);
+    }
+
+    value = json_object_get(arguments, "flow-id");
+    if(value) {
+        if(!json_is_integer(value)) {
+            return bbl_ctrl_status(fd, "error", 400, "invalid flow-id");
+        }
+        stream = bbl_stream_get(ctx, json_integer_value(value));
+        if(!(stream && bbl_ctrl_stream_rate_match(stream, session_id, stream_group_id))) {
+            return bbl_ctrl_status(fd, "warning", 404, "stream not found");
+        }
+        if(!bbl_stream_set_rate(stream, scale > 0 ? stream->pps * scale : pps)) {
+            return bbl_ctrl_status(fd, "error", 500, "failed to change stream rate");
+        }
+        streams++;
+    } else {
+        /* Iterate over all streams */
+        itor = dict_itor_new(ctx->stream_flow_dict);
+        dict_itor_first(itor);
+        for (; dict_itor_valid(itor); dict_itor_next(itor)) {
+            stream = (bbl_stream*)*dict_itor_datum(itor);
+            if(!bbl_ctrl_stream_rate_match(stream, session_id, stream_group_id)) {
+                continue;
+            }
+            if(bbl_stream_set_rate(stream, scale > 0 ? stream->pps * scale : pps)) {
+                streams++;
+            }
+        }
+        dict_itor_free(itor);
+        if(!streams) {
+            return bbl_ctrl_status(fd, "warning", 404, "stream not found");
+        }
+    }
+
+    root = json_pack("{ss si si}",
+                     "status", "ok",
+                     "code", 200,
+                     "streams", streams);
+    if(root) {
+        result = json_dumpfd(root, fd, 0);
+        json_decref(root);
+    }
+    return result;
+}
+
 ssize_t
 bbl_ctrl_traffic(int fd, bbl_ctx_s *ctx, uint32_t session_id, bool status) {
     bbl_session_s *session;
@@ -1279,6 +1389,8 @@ struct action actions[] = {
     {"stream-traffic-stop", bbl_ctrl_stream_traffic_stop},
     {"stream-info", bbl_ctrl_stream_info},
     {"stream-stats", bbl_ctrl_stream_stats},
+    {"stream-rate", bbl_ctrl_stream_rate},
+    {"throughput-search", bbl_ctrl_throughput_search},
     {"sessions-pending", bbl_ctrl_sessions_pending},
     {"cfm-cc-start", bbl_ctrl_cfm_cc_start},
     {"cfm-cc-stop", bbl_ctrl_cfm_cc_stop},
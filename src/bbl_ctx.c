@@ -67,13 +67,12 @@ bbl_ctx_add (void)
 
     /* Allocate scratchpad memory. */
     ctx->sp_rx = malloc(SCRATCHPAD_LEN);
+    ctx->sp_rx_batch = malloc(IO_RX_BATCH * SCRATCHPAD_FAST_LEN);
     ctx->sp_tx = malloc(SCRATCHPAD_LEN);
 
     /* Initialize timer root. */
     timer_init_root(&ctx->timer_root);
 
-    CIRCLEQ_INIT(&ctx->sessions_idle_qhead);
-    CIRCLEQ_INIT(&ctx->sessions_teardown_qhead);
     CIRCLEQ_INIT(&ctx->interface_qhead);
 
     ctx->flow_id = 1;
@@ -81,6 +80,8 @@ bbl_ctx_add (void)
 
     /* Initialize hash table dictionaries. */
     ctx->vlan_session_dict = hashtable_dict_new((dict_compare_func)bbl_compare_key64, bbl_key64_hash, BBL_SESSION_HASHTABLE_SIZE);
+    ctx->ipoe_vlan_dict = hashtable_dict_new((dict_compare_func)bbl_compare_key64, bbl_key64_hash, BBL_SESSION_HASHTABLE_SIZE);
+    ctx->igmp_group_dict = hashtable_dict_new((dict_compare_func)bbl_compare_key32, bbl_key32_hash, BBL_IGMP_GROUP_HASHTABLE_SIZE);
     ctx->l2tp_session_dict = hashtable_dict_new((dict_compare_func)bbl_compare_key32, bbl_key32_hash, BBL_SESSION_HASHTABLE_SIZE);
     ctx->li_flow_dict = hashtable_dict_new((dict_compare_func)bbl_compare_key32, bbl_key32_hash, BBL_LI_HASHTABLE_SIZE);
     ctx->stream_flow_dict = hashtable_dict_new((dict_compare_func)bbl_compare_key64, bbl_key64_hash, BBL_STREAM_FLOW_HASHTABLE_SIZE);
@@ -99,7 +100,6 @@ void
 bbl_ctx_del (bbl_ctx_s *ctx) {
     bbl_access_config_s *access_config = ctx->config.access_config;
     void *p = NULL;
-    uint32_t i;
 
     /* Free access configuration memory. */
     while(access_config) {
@@ -111,16 +111,37 @@ bbl_ctx_del (bbl_ctx_s *ctx) {
     if(ctx->sp_rx) {
         free(ctx->sp_rx);
     }
+    if(ctx->sp_rx_batch) {
+        free(ctx->sp_rx_batch);
+    }
     if(ctx->sp_tx) {
         free(ctx->sp_tx);
     }
 
     /* Free session memory. */
-    for(i = 0; i < ctx->sessions; i++) {
-        p = ctx->session_list[i];
-        if(p) {
-            free(p);
-        }
+    if(ctx->session_arena) {
+        free(ctx->session_arena);
+    }
+    if(ctx->session_list) {
+        free(ctx->session_list);
+    }
+    if(ctx->igmp_group_pool) {
+        free(ctx->igmp_group_pool);
+    }
+    if(ctx->igmp_group_hash_pool) {
+        free(ctx->igmp_group_hash_pool);
+    }
+    if(ctx->session_slices) {
+        free(ctx->session_slices);
+    }
+    if(ctx->rate_sweep.entry) {
+        free(ctx->rate_sweep.entry);
+    }
+    if(ctx->stream_flow_table) {
+        free(ctx->stream_flow_table);
+    }
+    if(ctx->throughput) {
+        free(ctx->throughput);
     }
 
     pcapng_free(ctx);
@@ -29,6 +29,8 @@ typedef struct bbl_ctx_
 {
     struct timer_root_ timer_root; /* Root for our timers */
     struct timer_ *control_timer;
+    struct timer_ *session_slice_timer;
+    struct timer_ *session_traffic_timer[BBL_SESSION_TRAFFIC_MAX];
     struct timer_ *smear_timer;
     struct timer_ *stats_timer;
     struct timer_ *keyboard_timer;
@@ -61,17 +63,29 @@ typedef struct bbl_ctx_
     uint32_t l2tp_tunnels_established;
     uint32_t l2tp_tunnels_established_max;
 
-    CIRCLEQ_HEAD(sessions_idle_, bbl_session_ ) sessions_idle_qhead;
-    CIRCLEQ_HEAD(sessions_teardown_, bbl_session_ ) sessions_teardown_qhead;
     CIRCLEQ_HEAD(interface_, bbl_interface_ ) interface_qhead; /* list of interfaces */
 
     bbl_session_s **session_list; /* list for sessions */
+    bbl_session_s *session_arena; /* memory for all sessions */
+    bbl_igmp_group_s *igmp_group_pool; /* memory for all session IGMP groups */
+    uint16_t *igmp_group_hash_pool; /* memory for all session IGMP group indexes */
+
+    bbl_rate_sweep_s rate_sweep; /* rate computation of sessions and streams */
+
+    bbl_session_slice_s *session_slices; /* list of session slices */
+    uint16_t session_slice_cursor; /* next slice to be served */
 
     dict *vlan_session_dict; /* hashtable for 1:1 vlan sessions */
+    dict *ipoe_vlan_dict; /* hashtable for IPoE N:1 vlan session lists */
+    dict *igmp_group_dict; /* hashtable for IGMP group members */
     dict *l2tp_session_dict; /* hashtable for L2TP sessions */
     dict *li_flow_dict; /* hashtable for LI flows */
     dict *stream_flow_dict; /* hashtable for traffic stream flows */
 
+    /* Traffic streams directly indexed by flow-id */
+    void **stream_flow_table;
+    uint64_t stream_flow_table_size;
+
     uint16_t next_tunnel_id;
 
     uint64_t flow_id;
@@ -81,6 +95,8 @@ typedef struct bbl_ctx_
 
     void *stream_thread; /* single linked list of threads */
 
+    void *throughput; /* throughput search (RFC 2544) */
+
     /* Interfaces */
     struct {
         uint8_t count;
@@ -98,6 +114,7 @@ typedef struct bbl_ctx_
 
     /* Scratchpad memory */
     uint8_t *sp_rx;
+    uint8_t *sp_rx_batch; /* IO_RX_BATCH * SCRATCHPAD_FAST_LEN */
     uint8_t *sp_tx;
 
     /* PCAP */
@@ -139,6 +156,8 @@ typedef struct bbl_ctx_
 
         uint16_t io_slots;
         uint16_t io_stream_max_ppi; /* Traffic stream max packets per interval */
+        uint16_t rate_slices;
+        uint16_t tx_class_weight[BBL_TX_CLASS_MAX]; /* Send class weights indexed by bbl_tx_class_t */
 
         bool qdisc_bypass;
         bbl_io_mode_t io_mode;
@@ -171,6 +190,7 @@ typedef struct bbl_ctx_
         uint16_t sessions_start_rate;
         uint16_t sessions_stop_rate;
         uint16_t sessions_start_delay;
+        uint16_t session_slices;
 
         bool iterate_outer_vlan;
 
@@ -262,6 +282,7 @@ typedef struct bbl_ctx_
         bool igmp_autostart;
         uint8_t  igmp_version;
         uint8_t  igmp_combined_leave_join;
+        uint16_t igmp_max_groups;
         uint16_t igmp_start_delay;
         uint32_t igmp_group;
         uint32_t igmp_group_iter;
@@ -3,30 +3,35 @@
 
 #define IO_BUFFER_LEN               9216
 #define SCRATCHPAD_LEN              4096
+#define SCRATCHPAD_FAST_LEN         256 /* per frame in RX batch */
+#define IO_RX_BATCH                 32
 #define CHALLENGE_LEN               16
+#define CACHE_LINE_SIZE             64
 
 #define FILE_PATH_LEN               128
 
 #define BBL_SESSION_HASHTABLE_SIZE 128993 /* is a prime number */
 #define BBL_LI_HASHTABLE_SIZE 32771 /* is a prime number */
 #define BBL_STREAM_FLOW_HASHTABLE_SIZE 128993 /* is a prime number */
+#define BBL_STREAM_FLOW_TABLE_SIZE 4096 /* initial size, doubled as needed */
+#define BBL_IGMP_GROUP_HASHTABLE_SIZE 32771 /* is a prime number */
+#define BBL_SESSION_SLICES_MAX 1000
+#define BBL_IGMP_MAX_GROUPS_MAX 4096
+#define BBL_SESSION_STRING_CHUNK 65536
 
 /* Access Interface Send Mask */
 #define BBL_SEND_DISCOVERY          0x00000001
-#define BBL_SEND_LCP_RESPONSE       0x00000002
-#define BBL_SEND_LCP_REQUEST        0x00000004
+#define BBL_SEND_LCP_REQUEST        0x00000002
+#define BBL_SEND_LCP_RESPONSE       0x00000004
 #define BBL_SEND_PAP_REQUEST        0x00000008
 #define BBL_SEND_CHAP_RESPONSE      0x00000010
-#define BBL_SEND_IPCP_RESPONSE      0x00000020
-#define BBL_SEND_IPCP_REQUEST       0x00000040
+#define BBL_SEND_IPCP_REQUEST       0x00000020
+#define BBL_SEND_IPCP_RESPONSE      0x00000040
 #define BBL_SEND_IP6CP_REQUEST      0x00000080
 #define BBL_SEND_IP6CP_RESPONSE     0x00000100
 #define BBL_SEND_ICMPV6_RS          0x00000200
 #define BBL_SEND_DHCPV6_REQUEST     0x00000400
 #define BBL_SEND_IGMP               0x00000800
-#define BBL_SEND_SESSION_IPV4       0x00002000
-#define BBL_SEND_SESSION_IPV6       0x00004000
-#define BBL_SEND_SESSION_IPV6PD     0x00008000
 #define BBL_SEND_ARP_REQUEST        0x00010000
 #define BBL_SEND_ARP_REPLY          0x00020000
 #define BBL_SEND_DHCP_REQUEST       0x00040000
@@ -35,6 +40,23 @@
 #define BBL_SEND_ICMPV6_NA          0x00200000
 #define BBL_SEND_CFM_CC             0x00400000
 
+/* Access Interface Send Classes
+ *
+ * The requests within a class are served in order of
+ * their bit position (lowest bit first). The ICMPv6
+ * reply, NS and NA requests have no session send handler,
+ * are not part of any class and must not be requested. */
+#define BBL_SEND_CLASS_DISCOVERY    (BBL_SEND_DISCOVERY)
+#define BBL_SEND_CLASS_LCP          (BBL_SEND_LCP_REQUEST | BBL_SEND_LCP_RESPONSE)
+#define BBL_SEND_CLASS_AUTH         (BBL_SEND_PAP_REQUEST | BBL_SEND_CHAP_RESPONSE)
+#define BBL_SEND_CLASS_NCP          (BBL_SEND_IPCP_REQUEST | BBL_SEND_IPCP_RESPONSE | \
+                                     BBL_SEND_IP6CP_REQUEST | BBL_SEND_IP6CP_RESPONSE | \
+                                     BBL_SEND_ICMPV6_RS)
+#define BBL_SEND_CLASS_DHCP         (BBL_SEND_DHCPV6_REQUEST | BBL_SEND_ARP_REQUEST | \
+                                     BBL_SEND_ARP_REPLY | BBL_SEND_DHCP_REQUEST)
+#define BBL_SEND_CLASS_MISC         (BBL_SEND_IGMP | BBL_SEND_CFM_CC)
+#define BBL_SEND_CLASS_TRAFFIC      0 /* served by the session traffic generator */
+
 /* Network Interface Send Mask */
 #define BBL_IF_SEND_ARP_REQUEST     0x00000001
 #define BBL_IF_SEND_ICMPV6_NS       0x00000002
@@ -63,6 +85,30 @@ typedef enum {
     INTERFACE_TYPE_A10NSP
 } __attribute__ ((__packed__)) bbl_interface_type_t;
 
+/*
+ * Access interface send classes in order of priority
+ */
+typedef enum {
+    BBL_TX_CLASS_DISCOVERY = 0,
+    BBL_TX_CLASS_LCP,
+    BBL_TX_CLASS_AUTH,
+    BBL_TX_CLASS_NCP,
+    BBL_TX_CLASS_DHCP,
+    BBL_TX_CLASS_MISC,
+    BBL_TX_CLASS_TRAFFIC,
+    BBL_TX_CLASS_MAX
+} __attribute__ ((__packed__)) bbl_tx_class_t;
+
+/*
+ * Session traffic flow types
+ */
+typedef enum {
+    BBL_SESSION_TRAFFIC_IPV4 = 0,
+    BBL_SESSION_TRAFFIC_IPV6,
+    BBL_SESSION_TRAFFIC_IPV6PD,
+    BBL_SESSION_TRAFFIC_MAX
+} __attribute__ ((__packed__)) bbl_session_traffic_t;
+
 typedef enum {
     ACCESS_TYPE_PPPOE = 0,
     ACCESS_TYPE_IPOE
@@ -10,6 +10,7 @@
 #include "bbl.h"
 #include "bbl_dhcp.h"
 #include "bbl_session.h"
+#include "bbl_session_traffic.h"
 
 /**
  * bbl_dhcp_stop
@@ -33,7 +34,7 @@ bbl_dhcp_stop(bbl_session_s *session) {
     session->dns2 = 0;
 
     /* Stop session traffic */
-    timer_del(session->timer_session_traffic_ipv4);
+    bbl_session_traffic_stop(session, BBL_SESSION_TRAFFIC_IPV4);
 
     /* Stop multicast ... */
     timer_del(session->timer_igmp);
@@ -31,11 +31,11 @@ bbl_dhcpv6_stop(bbl_session_s *session) {
     if(session->access_type == ACCESS_TYPE_IPOE) {
         session->ipv6_prefix.len = 0;
         memset(session->ipv6_address, 0x0, IPV6_ADDR_LEN);
-        timer_del(session->timer_session_traffic_ipv6);
+        bbl_session_traffic_stop(session, BBL_SESSION_TRAFFIC_IPV6);
     }
     session->delegated_ipv6_prefix.len = 0;
     memset(session->delegated_ipv6_address, 0x0, IPV6_ADDR_LEN);
-    timer_del(session->timer_session_traffic_ipv6pd);
+    bbl_session_traffic_stop(session, BBL_SESSION_TRAFFIC_IPV6PD);
 
     /* Reset DHCPv6 */
     timer_del(session->timer_dhcpv6);
@@ -574,20 +574,20 @@ bbl_stats_job (timer_s *timer)
 
                 bbl_stream *stream = session->stream;
                 while(stream) {
-                    tx_kbps = stream->rate_packets_tx.avg * stream->tx_len * 8 / 1000;
-                    rx_kbps = stream->rate_packets_rx.avg * stream->rx_len * 8 / 1000;
+                    tx_kbps = STREAM_COUNTER_GET(stream->rate_bytes_tx.avg) * 8 / 1000;
+                    rx_kbps = stream->rate_bytes_rx.avg * 8 / 1000;
                     wprintw(stats_win, "  %-16.16s | %-9.9s | %7lu | %10lu | %7lu | %10lu | %8lu\n", stream->config->name,
                             stream->direction == STREAM_DIRECTION_UP ? "up" : "down",
-                            stream->rate_packets_tx.avg, tx_kbps, stream->rate_packets_rx.avg, rx_kbps, stream->loss);
+                            STREAM_COUNTER_GET(stream->rate_packets_tx.avg), tx_kbps, stream->rate_packets_rx.avg, rx_kbps, stream->loss);
 
                     if(stream->direction == STREAM_DIRECTION_UP) {
-                        stream_sum_up_tx_pps += stream->rate_packets_tx.avg;
+                        stream_sum_up_tx_pps += STREAM_COUNTER_GET(stream->rate_packets_tx.avg);
                         stream_sum_up_tx_kbps += tx_kbps;
                         stream_sum_up_rx_pps += stream->rate_packets_rx.avg;
                         stream_sum_up_rx_kbps += rx_kbps;
                         stream_sum_up_loss += stream->loss;
                     } else {
-                        stream_sum_down_tx_pps += stream->rate_packets_tx.avg;
+                        stream_sum_down_tx_pps += STREAM_COUNTER_GET(stream->rate_packets_tx.avg);
                         stream_sum_down_tx_kbps += tx_kbps;
                         stream_sum_down_rx_pps += stream->rate_packets_rx.avg;
                         stream_sum_down_rx_kbps += rx_kbps;
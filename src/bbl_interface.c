@@ -88,6 +88,7 @@ bbl_add_interface(bbl_ctx_s *ctx, char *interface_name)
 {
     bbl_interface_s *interface;
     struct ifreq ifr;
+    int i;
 
     int fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
 
@@ -113,7 +114,9 @@ bbl_add_interface(bbl_ctx_s *ctx, char *interface_name)
     /*
      * TX list init.
      */
-    CIRCLEQ_INIT(&interface->session_tx_qhead);
+    for(i = 0; i < BBL_TX_CLASS_MAX; i++) {
+        CIRCLEQ_INIT(&interface->session_tx_class_qhead[i]);
+    }
     CIRCLEQ_INIT(&interface->l2tp_tx_qhead);
 
     /*
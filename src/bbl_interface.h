@@ -10,6 +10,23 @@
 #ifndef __BBL_INTERFACE_H__
 #define __BBL_INTERFACE_H__
 
+/*
+ * Session traffic generator
+ *
+ * Dense array of all sessions with session traffic
+ * of one flow type. The generator sends one packet per
+ * session and round, starting at the cursor. A new round
+ * is started by the session traffic job of the flow type.
+ */
+typedef struct bbl_session_traffic_gen_
+{
+    struct bbl_session_ **session;
+    uint32_t count;
+    uint32_t size;
+    uint32_t cursor;
+    uint32_t pending; /* packets left in the current round */
+} bbl_session_traffic_gen_s;
+
 typedef struct bbl_interface_
 {
     CIRCLEQ_ENTRY(bbl_interface_) interface_qnode;
@@ -76,7 +93,7 @@ typedef struct bbl_interface_
     bool gateway_resolve_wait;
 
     uint8_t *mc_packets;
-    uint16_t mc_packet_len;
+    bbl_template_t *mc_templates;
     uint64_t mc_packet_seq;
     uint16_t mc_packet_cursor;
 
@@ -166,6 +183,8 @@ typedef struct bbl_interface_
         bbl_rate_s rate_session_ipv6pd_rx;
         uint64_t session_ipv6pd_loss;
 
+        uint64_t session_traffic_dropped; /* not sent within session traffic round */
+
         uint64_t session_ipv4_wrong_session;
         uint64_t session_ipv6_wrong_session;
         uint64_t session_ipv6pd_wrong_session;
@@ -192,7 +211,9 @@ typedef struct bbl_interface_
     struct timespec tx_timestamp; /* user space timestamps */
     struct timespec rx_timestamp; /* user space timestamps */
 
-    CIRCLEQ_HEAD(session_tx_, bbl_session_ ) session_tx_qhead; /* list of sessions that want to transmit */
+    CIRCLEQ_HEAD(session_tx_class_, bbl_session_ ) session_tx_class_qhead[BBL_TX_CLASS_MAX]; /* per class list of sessions that want to transmit (access) */
+    uint16_t session_tx_class_credit[BBL_TX_CLASS_MAX];
+    bbl_session_traffic_gen_s session_traffic[BBL_SESSION_TRAFFIC_MAX]; /* per flow type session traffic generator */
     CIRCLEQ_HEAD(l2tp_tx_, bbl_l2tp_queue_ ) l2tp_tx_qhead; /* list of messages that want to transmit */
 } bbl_interface_s;
 
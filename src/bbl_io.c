@@ -15,6 +15,44 @@
 #include "bbl_io_netmap.h"
 #endif
 
+/**
+ * bbl_io_packet_mmap_vlan
+ *
+ * Restore the outer VLAN which is stripped
+ * from header and reported in the ring.
+ *
+ * @param tphdr packet ring header
+ * @param eth decoded ethernet header
+ */
+static void
+bbl_io_packet_mmap_vlan(struct tpacket2_hdr *tphdr, bbl_ethernet_header_t *eth) {
+    uint16_t vlan;
+
+    vlan = tphdr->tp_vlan_tci & ETH_VLAN_ID_MAX;
+    if(eth->vlan_outer != vlan) {
+        /* The outer VLAN is stripped from header */
+        eth->vlan_inner = eth->vlan_outer;
+        eth->vlan_inner_priority = eth->vlan_outer_priority;
+        eth->vlan_outer = vlan;
+        eth->vlan_outer_priority = tphdr->tp_vlan_tci >> 13;
+        if(tphdr->tp_vlan_tpid == ETH_TYPE_QINQ) {
+            eth->qinq = true;
+        }
+    }
+}
+
+/**
+ * bbl_io_packet_mmap_rx_job
+ *
+ * Frames are processed in batches of up to IO_RX_BATCH frames
+ * collected from the ring. The frame headers are prefetched
+ * first, followed by the sessions and streams of BBL traffic
+ * recognised by the fast path, before the handlers are called
+ * for the whole batch. This overlaps the cache misses instead
+ * of serialising them per frame.
+ *
+ * @param timer RX job timer
+ */
 void
 bbl_io_packet_mmap_rx_job (timer_s *timer) {
     bbl_interface_s *interface;
@@ -24,9 +62,11 @@ bbl_io_packet_mmap_rx_job (timer_s *timer) {
     uint8_t *frame_ptr;
     struct tpacket2_hdr *tphdr;
 
-    uint8_t *eth_start;
-    uint16_t eth_len;
-    uint16_t vlan;
+    bbl_rx_batch_t batch[IO_RX_BATCH];
+    bbl_rx_batch_t *frame;
+    uint16_t count;
+    uint16_t i;
+    uint32_t cursor;
 
     bbl_ethernet_header_t *eth;
     protocol_error_t decode_result;
@@ -56,62 +96,95 @@ bbl_io_packet_mmap_rx_job (timer_s *timer) {
     clock_gettime(CLOCK_MONOTONIC, &interface->rx_timestamp);
 
     while (tphdr->tp_status & TP_STATUS_USER) {
-        eth_start = (uint8_t*)tphdr + tphdr->tp_mac;
-        eth_len = tphdr->tp_len;
-        interface->stats.packets_rx++;
-        interface->stats.bytes_rx += eth_len;
+        /* Collect batch and prefetch frame headers. */
+        count = 0;
+        cursor = interface->io.cursor_rx;
+        while (count < IO_RX_BATCH && count < interface->io.req_rx.tp_frame_nr &&
+               (tphdr->tp_status & TP_STATUS_USER)) {
+            frame = &batch[count++];
+            frame->slot = tphdr;
+            frame->eth_start = (uint8_t*)tphdr + tphdr->tp_mac;
+            frame->eth_len = tphdr->tp_len;
+            __builtin_prefetch(frame->eth_start);
+            __builtin_prefetch(frame->eth_start + 64);
+
+            cursor = (cursor + 1) % interface->io.req_rx.tp_frame_nr;
+            frame_ptr = interface->io.ring_rx + (cursor * interface->io.req_rx.tp_frame_size);
+            tphdr = (struct tpacket2_hdr*)frame_ptr;
+        }
 
-        /* Dump the packet into pcap file. */
-        if (ctx->pcap.write_buf) {
-            pcapng_push_packet_header(ctx, &interface->rx_timestamp, eth_start, eth_len,
-                                      interface->pcap_index, PCAPNG_EPB_FLAGS_INBOUND);
+        /* Fast-path for BBL test traffic and prefetch sessions. */
+        for(i = 0; i < count; i++) {
+            frame = &batch[i];
+            interface->stats.packets_rx++;
+            interface->stats.bytes_rx += frame->eth_len;
+
+            /* Dump the packet into pcap file. */
+            if (ctx->pcap.write_buf) {
+                pcapng_push_packet_header(ctx, &interface->rx_timestamp, frame->eth_start, frame->eth_len,
+                                          interface->pcap_index, PCAPNG_EPB_FLAGS_INBOUND);
+            }
+
+            if(decode_bbl_fast(frame->eth_start, frame->eth_len,
+                               ctx->sp_rx_batch + (i * SCRATCHPAD_FAST_LEN), SCRATCHPAD_FAST_LEN,
+                               &frame->eth, &frame->tos) == PROTOCOL_SUCCESS) {
+                bbl_io_packet_mmap_vlan(frame->slot, frame->eth);
+                frame->eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
+                frame->eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
+                bbl_rx_prefetch_session(frame, interface);
+            } else {
+                frame->eth = NULL;
+            }
         }
 
-        decode_result = decode_ethernet(eth_start, eth_len, interface->ctx->sp_rx, SCRATCHPAD_LEN, &eth);
-        if(decode_result == PROTOCOL_SUCCESS) {
-            vlan = tphdr->tp_vlan_tci & ETH_VLAN_ID_MAX;
-            if(eth->vlan_outer != vlan) {
-                /* The outer VLAN is stripped from header */
-                eth->vlan_inner = eth->vlan_outer;
-                eth->vlan_inner_priority = eth->vlan_outer_priority;
-                eth->vlan_outer = vlan;
-                eth->vlan_outer_priority = tphdr->tp_vlan_tci >> 13;
-                if(tphdr->tp_vlan_tpid == ETH_TYPE_QINQ) {
-                    eth->qinq = true;
-                }
+        /* Prefetch streams. */
+        for(i = 0; i < count; i++) {
+            if(batch[i].eth) {
+                bbl_rx_prefetch_stream(&batch[i], interface);
+            }
+        }
+
+        /* Handle batch */
+        for(i = 0; i < count; i++) {
+            frame = &batch[i];
+            if(frame->eth && bbl_rx_handler_fast(frame, interface)) {
+                goto NEXT;
             }
+
+            decode_result = decode_ethernet_header(frame->eth_start, frame->eth_len, ctx->sp_rx, SCRATCHPAD_LEN, &eth);
+            if(decode_result == PROTOCOL_SUCCESS) {
+                bbl_io_packet_mmap_vlan(frame->slot, eth);
 #if 0
-            /* Copy RX timestamp */
-            eth->timestamp.tv_sec = tphdr->tp_sec; /* ktime/hw timestamp */
-            eth->timestamp.tv_nsec = tphdr->tp_nsec; /* ktime/hw timestamp */
+                /* Copy RX timestamp */
+                eth->timestamp.tv_sec = ((struct tpacket2_hdr*)frame->slot)->tp_sec; /* ktime/hw timestamp */
+                eth->timestamp.tv_nsec = ((struct tpacket2_hdr*)frame->slot)->tp_nsec; /* ktime/hw timestamp */
 #endif
-            /* Copy RX timestamp */
-            eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
-            eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
-            switch(interface->type) {
-                case INTERFACE_TYPE_ACCESS:
-                    bbl_rx_handler_access(eth, interface);
-                    break;
-                case INTERFACE_TYPE_NETWORK:
-                    bbl_rx_handler_network(eth, interface);
-                    break;
-                case INTERFACE_TYPE_A10NSP:
-                    bbl_rx_handler_a10nsp(eth, interface);
-                    break;
-                default:
-                    break;
+                /* Copy RX timestamp */
+                eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
+                eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
+                switch(interface->type) {
+                    case INTERFACE_TYPE_ACCESS:
+                        bbl_rx_handler_access(eth, interface);
+                        break;
+                    case INTERFACE_TYPE_NETWORK:
+                        bbl_rx_handler_network(eth, interface);
+                        break;
+                    case INTERFACE_TYPE_A10NSP:
+                        bbl_rx_handler_a10nsp(eth, interface);
+                        break;
+                    default:
+                        break;
+                }
+            } else if (decode_result == UNKNOWN_PROTOCOL) {
+                interface->stats.packets_rx_drop_unknown++;
+            } else {
+                interface->stats.packets_rx_drop_decode_error++;
             }
-        } else if (decode_result == UNKNOWN_PROTOCOL) {
-            interface->stats.packets_rx_drop_unknown++;
-        } else {
-            interface->stats.packets_rx_drop_decode_error++;
+NEXT:
+            /* Return ownership back to kernel */
+            ((struct tpacket2_hdr*)frame->slot)->tp_status = TP_STATUS_KERNEL;
+            interface->io.cursor_rx = (interface->io.cursor_rx + 1) % interface->io.req_rx.tp_frame_nr;
         }
-
-        tphdr->tp_status = TP_STATUS_KERNEL; /* Return ownership back to kernel */
-        interface->io.cursor_rx = (interface->io.cursor_rx + 1) % interface->io.req_rx.tp_frame_nr;
-
-        frame_ptr = interface->io.ring_rx + (interface->io.cursor_rx * interface->io.req_rx.tp_frame_size);
-        tphdr = (struct tpacket2_hdr*)frame_ptr;
     }
     pcapng_fflush(ctx);
 }
@@ -126,6 +199,7 @@ bbl_io_raw_rx_job (timer_s *timer) {
 
     bbl_ethernet_header_t *eth;
     protocol_error_t decode_result;
+    bbl_rx_batch_t frame = {0};
 
     ssize_t recv_result;
 
@@ -152,7 +226,18 @@ bbl_io_raw_rx_job (timer_s *timer) {
                                       interface->pcap_index, PCAPNG_EPB_FLAGS_INBOUND);
         }
 
-        decode_result = decode_ethernet(interface->io.rx_buf, interface->io.rx_len, interface->ctx->sp_rx, SCRATCHPAD_LEN, &eth);
+        /* Fast-path for BBL test traffic */
+        if(decode_bbl_fast(interface->io.rx_buf, interface->io.rx_len, interface->ctx->sp_rx, SCRATCHPAD_LEN, &frame.eth, &frame.tos) == PROTOCOL_SUCCESS) {
+            frame.eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
+            frame.eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
+            bbl_rx_prefetch_session(&frame, interface);
+            bbl_rx_prefetch_stream(&frame, interface);
+            if(bbl_rx_handler_fast(&frame, interface)) {
+                continue;
+            }
+        }
+
+        decode_result = decode_ethernet_header(interface->io.rx_buf, interface->io.rx_len, interface->ctx->sp_rx, SCRATCHPAD_LEN, &eth);
         if(decode_result == PROTOCOL_SUCCESS) {
             /* Copy RX timestamp */
             eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
@@ -15,6 +15,14 @@
 
 #ifdef BNGBLASTER_NETMAP
 
+/**
+ * bbl_io_netmap_rx_job
+ *
+ * Frames are processed in batches as described
+ * for bbl_io_packet_mmap_rx_job.
+ *
+ * @param timer RX job timer
+ */
 void
 bbl_io_netmap_rx_job (timer_s *timer)
 {
@@ -24,8 +32,10 @@ bbl_io_netmap_rx_job (timer_s *timer)
 	struct netmap_ring *ring;
 	unsigned int i;
 
-    uint8_t *eth_start;
-    uint16_t eth_len;
+    bbl_rx_batch_t batch[IO_RX_BATCH];
+    bbl_rx_batch_t *frame;
+    uint16_t count;
+    uint16_t n;
 
     bbl_ethernet_header_t *eth;
     protocol_error_t decode_result;
@@ -41,51 +51,89 @@ bbl_io_netmap_rx_job (timer_s *timer)
 
     ring = NETMAP_RXRING(interface->io.port->nifp, 0);
     while (!nm_ring_empty(ring)) {
-
+        /* Collect batch and prefetch frame headers. */
+        count = 0;
         i = ring->cur;
-        eth_start = (uint8_t*)NETMAP_BUF(ring, ring->slot[i].buf_idx);
-        eth_len = ring->slot[i].len;
-        interface->stats.packets_rx++;
-        interface->stats.bytes_rx += eth_len;
-
-        /*
-	     * Dump the packet into pcap file.
-	     */
-        if (ctx->pcap.write_buf) {
-	        pcapng_push_packet_header(ctx, &interface->rx_timestamp, eth_start, eth_len,
-				                      interface->pcap_index, PCAPNG_EPB_FLAGS_INBOUND);
+        while (count < IO_RX_BATCH && i != ring->tail) {
+            frame = &batch[count++];
+            frame->slot = &ring->slot[i];
+            frame->eth_start = (uint8_t*)NETMAP_BUF(ring, ring->slot[i].buf_idx);
+            frame->eth_len = ring->slot[i].len;
+            __builtin_prefetch(frame->eth_start);
+            __builtin_prefetch(frame->eth_start + 64);
+            i = nm_ring_next(ring, i);
+        }
+
+        /* Fast-path for BBL test traffic and prefetch sessions. */
+        for(n = 0; n < count; n++) {
+            frame = &batch[n];
+            interface->stats.packets_rx++;
+            interface->stats.bytes_rx += frame->eth_len;
+
+            /*
+             * Dump the packet into pcap file.
+             */
+            if (ctx->pcap.write_buf) {
+                pcapng_push_packet_header(ctx, &interface->rx_timestamp, frame->eth_start, frame->eth_len,
+                                          interface->pcap_index, PCAPNG_EPB_FLAGS_INBOUND);
+            }
+
+            if(decode_bbl_fast(frame->eth_start, frame->eth_len,
+                               ctx->sp_rx_batch + (n * SCRATCHPAD_FAST_LEN), SCRATCHPAD_FAST_LEN,
+                               &frame->eth, &frame->tos) == PROTOCOL_SUCCESS) {
+                frame->eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
+                frame->eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
+                bbl_rx_prefetch_session(frame, interface);
+            } else {
+                frame->eth = NULL;
+            }
         }
 
-        decode_result = decode_ethernet(eth_start, eth_len, interface->ctx->sp_rx, SCRATCHPAD_LEN, &eth);
-        if(decode_result == PROTOCOL_SUCCESS) {
+        /* Prefetch streams. */
+        for(n = 0; n < count; n++) {
+            if(batch[n].eth) {
+                bbl_rx_prefetch_stream(&batch[n], interface);
+            }
+        }
+
+        /* Handle batch */
+        for(n = 0; n < count; n++) {
+            frame = &batch[n];
+            if(frame->eth && bbl_rx_handler_fast(frame, interface)) {
+                goto NEXT;
+            }
+
+            decode_result = decode_ethernet_header(frame->eth_start, frame->eth_len, ctx->sp_rx, SCRATCHPAD_LEN, &eth);
+            if(decode_result == PROTOCOL_SUCCESS) {
 #if 0
-            /* Copy RX timestamp */
-            eth->timestamp.tv_sec = ring->ts.tv_sec;
-            eth->timestamp.tv_nsec = ring->ts.tv_usec * 1000;
+                /* Copy RX timestamp */
+                eth->timestamp.tv_sec = ring->ts.tv_sec;
+                eth->timestamp.tv_nsec = ring->ts.tv_usec * 1000;
 #endif
-            /* Copy RX timestamp */
-            eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
-            eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
-            switch(interface->type) {
-                case INTERFACE_TYPE_ACCESS:
-                    bbl_rx_handler_access(eth, interface);
-                    break;
-                case INTERFACE_TYPE_NETWORK:
-                    bbl_rx_handler_network(eth, interface);
-                    break;
-                case INTERFACE_TYPE_A10NSP:
-                    bbl_rx_handler_a10nsp(eth, interface);
-                    break;
-                default:
-                    break;
+                /* Copy RX timestamp */
+                eth->timestamp.tv_sec = interface->rx_timestamp.tv_sec;
+                eth->timestamp.tv_nsec = interface->rx_timestamp.tv_nsec;
+                switch(interface->type) {
+                    case INTERFACE_TYPE_ACCESS:
+                        bbl_rx_handler_access(eth, interface);
+                        break;
+                    case INTERFACE_TYPE_NETWORK:
+                        bbl_rx_handler_network(eth, interface);
+                        break;
+                    case INTERFACE_TYPE_A10NSP:
+                        bbl_rx_handler_a10nsp(eth, interface);
+                        break;
+                    default:
+                        break;
+                }
+            } else if (decode_result == UNKNOWN_PROTOCOL) {
+                interface->stats.packets_rx_drop_unknown++;
+            } else {
+                interface->stats.packets_rx_drop_decode_error++;
             }
-        } else if (decode_result == UNKNOWN_PROTOCOL) {
-            interface->stats.packets_rx_drop_unknown++;
-        } else {
-            interface->stats.packets_rx_drop_decode_error++;
+NEXT:
+            ring->head = ring->cur = nm_ring_next(ring, ring->cur);
         }
-
-        ring->head = ring->cur = nm_ring_next(ring, i);
     }
     pcapng_fflush(ctx);
     ioctl(interface->io.port->fd, NIOCRXSYNC, NULL);
@@ -10,6 +10,7 @@
 #include "bbl.h"
 #include "bbl_l2tp_avp.h"
 #include "bbl_stream.h"
+#include "bbl_rx.h"
 #include "bbl_session.h"
 #include <openssl/md5.h>
 #include <openssl/rand.h>
@@ -895,10 +896,7 @@ bbl_l2tp_data_rx(bbl_ethernet_header_t *eth, bbl_l2tp_t *l2tp, bbl_interface_s *
     char reply_message[sizeof(L2TP_REPLY_MESSAGE)+16];
 
     bbl_stream *stream;
-    void **search = NULL;
 
-    struct timespec delay;
-    uint64_t delay_nsec;
     uint64_t loss;
 
     UNUSED(ctx);
@@ -1021,35 +1019,9 @@ bbl_l2tp_data_rx(bbl_ethernet_header_t *eth, bbl_l2tp_t *l2tp, bbl_interface_s *
                 udp = (bbl_udp_t*)ipv4->next;
                 if(udp->protocol == UDP_PROTOCOL_BBL) {
                     bbl = (bbl_bbl_t*)udp->next;
-                    search = dict_search(ctx->stream_flow_dict, &bbl->flow_id);
-                    if(search) {
-                        stream = *search;
-                        stream->packets_rx++;
-                        stream->rx_len = eth->length;
-                        stream->rx_priority = ipv4->tos;
-                        stream->rx_outer_vlan_pbit = eth->vlan_outer_priority;
-                        stream->rx_inner_vlan_pbit = eth->vlan_inner_priority;
-                        timespec_sub(&delay, &eth->timestamp, &bbl->timestamp);
-                        delay_nsec = delay.tv_sec * 1e9 + delay.tv_nsec;
-                        if(delay_nsec > stream->max_delay_ns) {
-                            stream->max_delay_ns = delay_nsec;
-                        }
-                        if(stream->min_delay_ns) {
-                            if(delay_nsec < stream->min_delay_ns) {
-                                stream->min_delay_ns = delay_nsec;
-                            }
-                        } else {
-                            stream->min_delay_ns = delay_nsec;
-                        }
-                        if(!stream->rx_first_seq) {
-                            stream->rx_first_seq = bbl->flow_seq;
-                            interface->ctx->stats.stream_traffic_flows_verified++;
-                        } else {
-                            if(stream->rx_last_seq +1 != bbl->flow_seq) {
-                                stream->loss++;
-                            }
-                        }
-                        stream->rx_last_seq = bbl->flow_seq;
+                    stream = bbl_stream_get(ctx, bbl->flow_id);
+                    if(stream) {
+                        bbl_rx_stream_account(interface, stream, eth, bbl, ipv4->tos);
                     } else {
                         if(l2tp_session->pppoe_session) {
                             pppoe_session = l2tp_session->pppoe_session;
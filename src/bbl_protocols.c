@@ -8,6 +8,11 @@
  */
 #include "bbl.h"
 #include "bbl_protocols.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 protocol_error_t decode_l2tp(uint8_t *buf, uint16_t len, uint8_t *sp, uint16_t sp_len, bbl_l2tp_t **_l2tp);
 protocol_error_t encode_l2tp(uint8_t *buf, uint16_t *len, bbl_l2tp_t *l2tp);
@@ -16,27 +21,110 @@ protocol_error_t encode_l2tp(uint8_t *buf, uint16_t *len, bbl_l2tp_t *l2tp);
  * CHECKSUM
  * ------------------------------------------------------------------------*/
 
+/*
+ * Sum of 16 bit words in host byte order. The one's complement
+ * sum is independent of the word size (RFC 1071), so 32 bit words
+ * or vector lanes can be summed and folded later. The vector paths
+ * sum in blocks of CHECKSUM_BLOCK bytes into 32 bit lanes which
+ * can't overflow within one block.
+ */
+#define CHECKSUM_BLOCK 16384
+
 static uint32_t
-_checksum(void *buf, ssize_t len) {
-    uint32_t result = 0;
-    uint16_t *cur = buf;
-    while (len > 1) {
-        result += *cur++;
-        len -= 2;
+_fold(uint32_t sum) {
+    while (sum>>16) {
+        sum = (sum & 0xffff) + (sum >> 16);
     }
-    /*  Add left-over byte, if any */
-    if (len) {
-        result += *(uint8_t*)cur;
+    return sum;
+}
+
+static uint32_t
+_fold64(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    return _fold((sum & 0xffff) + (sum >> 16));
+}
+
+#if defined(__AVX2__)
+static uint64_t
+_checksum_vector(uint8_t **buf, ssize_t *len) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc, v;
+    uint32_t lanes[8];
+    uint64_t result = 0;
+    ssize_t block;
+    int i;
+
+    while (*len >= 32) {
+        acc = _mm256_setzero_si256();
+        block = *len < CHECKSUM_BLOCK ? *len : CHECKSUM_BLOCK;
+        while (block >= 32) {
+            v = _mm256_loadu_si256((const __m256i*)*buf);
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+            *buf += 32; *len -= 32; block -= 32;
+        }
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        for (i = 0; i < 8; i++) {
+            result += lanes[i];
+        }
+    }
+    return result;
+}
+#elif defined(__SSE2__)
+static uint64_t
+_checksum_vector(uint8_t **buf, ssize_t *len) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc, v;
+    uint32_t lanes[4];
+    uint64_t result = 0;
+    ssize_t block;
+    int i;
+
+    while (*len >= 16) {
+        acc = _mm_setzero_si128();
+        block = *len < CHECKSUM_BLOCK ? *len : CHECKSUM_BLOCK;
+        while (block >= 16) {
+            v = _mm_loadu_si128((const __m128i*)*buf);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+            *buf += 16; *len -= 16; block -= 16;
+        }
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        for (i = 0; i < 4; i++) {
+            result += lanes[i];
+        }
     }
     return result;
 }
+#endif
 
+/*
+ * Returns the folded (16 bit) one's complement
+ * sum which can be safely added by the caller.
+ */
 static uint32_t
-_fold(uint32_t sum) {
-    while (sum>>16) {
-        sum = (sum & 0xffff) + (sum >> 16);
+_checksum(void *buf, ssize_t len) {
+    uint64_t result = 0;
+    uint8_t *cur = buf;
+#if defined(__AVX2__) || defined(__SSE2__)
+    result = _checksum_vector(&cur, &len);
+#endif
+    while (len > 3) {
+        result += *(uint32_t*)cur;
+        cur += 4;
+        len -= 4;
+    }
+    if (len > 1) {
+        result += *(uint16_t*)cur;
+        cur += 2;
+        len -= 2;
     }
-    return sum;
+    /*  Add left-over byte, if any */
+    if (len) {
+        result += *cur;
+    }
+    return _fold64(result);
 }
 
 uint16_t
@@ -44,6 +132,41 @@ bbl_checksum(uint8_t *buf, uint16_t len) {
     return ~_fold(_checksum(buf, len));
 }
 
+/*
+ * bbl_checksum_update16
+ *
+ * Incremental checksum update (RFC 1624 eqn. 3) for
+ * a single 16 bit field changed from old to new value.
+ *
+ * HC' = ~(~HC + ~m + m')
+ */
+uint16_t
+bbl_checksum_update16(uint16_t checksum, uint16_t old, uint16_t new) {
+    uint32_t result;
+    result  = (uint16_t)~checksum;
+    result += (uint16_t)~old;
+    result += new;
+    return ~_fold(result);
+}
+
+/*
+ * bbl_checksum_update
+ *
+ * Incremental checksum update (RFC 1624 eqn. 3) for a
+ * field of len bytes changed from old to new content.
+ * The field must start at an even offset relative to the
+ * checksummed data and must have an even length unless
+ * it is the end of the checksummed data.
+ */
+uint16_t
+bbl_checksum_update(uint16_t checksum, void *old, void *new, uint16_t len) {
+    uint32_t result;
+    result  = (uint16_t)~checksum;
+    result += (uint16_t)~_checksum(old, len);
+    result += _checksum(new, len);
+    return ~_fold(result);
+}
+
 uint16_t
 bbl_ipv4_udp_checksum(uint32_t src, uint32_t dst, uint8_t *udp, uint16_t udp_len) {
     uint32_t result;
@@ -80,6 +203,107 @@ bbl_ipv6_icmpv6_checksum(ipv6addr_t src, ipv6addr_t dst, uint8_t *icmp, uint16_t
     return ~_fold(result);
 }
 
+/*
+ * TEMPLATE
+ * ------------------------------------------------------------------------*/
+
+static uint16_t
+_swap16(uint32_t sum) {
+    return ((sum << 8) | (sum >> 8)) & 0xffff;
+}
+
+/*
+ * bbl_template_init
+ *
+ * Compile an encoded BBL packet into a template by recording
+ * the offsets of all fields which change per packet. The BBL
+ * sequence number and timestamp are always the last 16 bytes.
+ * The UDP checksum position is reported by the encoder in
+ * bbl->udp_checksum if the checksum is set (IPv6).
+ *
+ * @param tpl template
+ * @param buf encoded packet (owned by the caller)
+ * @param len encoded packet length
+ * @param bbl BBL header used to encode the packet
+ */
+void
+bbl_template_init(bbl_template_t *tpl, uint8_t *buf, uint16_t len, bbl_bbl_t *bbl) {
+    tpl->buf = buf;
+    tpl->len = len;
+    tpl->seq_offset = len - 16;
+    tpl->timestamp_offset = len - 8;
+    tpl->udp_checksum_offset = 0;
+    if(bbl && bbl->udp_checksum >= buf && bbl->udp_checksum < buf + len) {
+        tpl->udp_checksum_offset = bbl->udp_checksum - buf;
+    }
+}
+
+/*
+ * bbl_template_patch
+ *
+ * Patch sequence number and timestamp of a packet created from
+ * the template. The packet may be the template buffer itself.
+ * A UDP checksum is updated incrementally (RFC 1624) from the
+ * bytes currently present in the packet.
+ *
+ * @param tpl template
+ * @param buf packet
+ * @param seq BBL sequence number
+ * @param timestamp BBL timestamp
+ */
+void
+bbl_template_patch(bbl_template_t *tpl, uint8_t *buf, uint64_t seq, struct timespec *timestamp) {
+    uint32_t ts[2];
+    uint32_t old_sum;
+    uint32_t new_sum;
+    uint32_t result;
+    uint16_t *checksum;
+
+    ts[0] = timestamp->tv_sec;
+    ts[1] = timestamp->tv_nsec;
+
+    if(tpl->udp_checksum_offset) {
+        checksum = (uint16_t*)(buf + tpl->udp_checksum_offset);
+        old_sum = _fold(_checksum(buf + tpl->seq_offset, sizeof(uint64_t)) +
+                        _checksum(buf + tpl->timestamp_offset, sizeof(ts)));
+        new_sum = _fold(_checksum(&seq, sizeof(uint64_t)) +
+                        _checksum(ts, sizeof(ts)));
+        if((tpl->seq_offset - tpl->udp_checksum_offset) & 1) {
+            /* Fields are not 16 bit aligned to the UDP header. */
+            old_sum = _swap16(old_sum);
+            new_sum = _swap16(new_sum);
+        }
+        result  = (uint16_t)~*checksum;
+        result += (uint16_t)~old_sum;
+        result += new_sum;
+        *checksum = ~_fold(result);
+        if(*checksum == 0) {
+            *checksum = 0xffff;
+        }
+    }
+    *(uint64_t*)(buf + tpl->seq_offset) = seq;
+    *(uint32_t*)(buf + tpl->timestamp_offset) = ts[0];
+    *(uint32_t*)(buf + tpl->timestamp_offset + 4) = ts[1];
+}
+
+/*
+ * bbl_template_write
+ *
+ * Create a packet from the template by copy and patch.
+ *
+ * @param tpl template
+ * @param buf packet buffer
+ * @param seq BBL sequence number
+ * @param timestamp BBL timestamp
+ * @return packet length
+ */
+uint16_t
+bbl_template_write(bbl_template_t *tpl, uint8_t *buf, uint64_t seq, struct timespec *timestamp) {
+    memcpy(buf, tpl->buf, tpl->len);
+    bbl_template_patch(tpl, buf, seq, timestamp);
+    return tpl->len;
+}
+
 /*
  * ENCODE
  * ------------------------------------------------------------------------*/
@@ -445,6 +669,43 @@ encode_dhcp(uint8_t *buf, uint16_t *len,
     return PROTOCOL_SUCCESS;
 }
 
+/*
+ * encode_bbl_padding
+ *
+ * Fill padding with a pattern derived from seed, which
+ * allows to verify the payload of received packets.
+ */
+static void
+encode_bbl_padding(uint8_t *buf, uint16_t len, uint8_t pattern, uint64_t seed) {
+    uint64_t state;
+    uint16_t i;
+
+    switch(pattern) {
+        case BBL_PADDING_COUNTER:
+            for(i = 0; i < len; i++) {
+                buf[i] = seed + i;
+            }
+            break;
+        case BBL_PADDING_PRBS:
+            /* Xorshift64 pseudo random bit sequence
+             * with the seed spread over all bits. */
+            state = (seed + 1) * 0x9e3779b97f4a7c15ULL;
+            if(!state) state = 1;
+            for(i = 0; i < len; i++) {
+                if((i & 7) == 0) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                }
+                buf[i] = state >> ((i & 7) * 8);
+            }
+            break;
+        default:
+            memset(buf, 0x0, len);
+            break;
+    }
+}
+
 /*
  * encode_bbl
  */
@@ -452,8 +713,9 @@ protocol_error_t
 encode_bbl(uint8_t *buf, uint16_t *len,
            bbl_bbl_t *bbl) {
 
+    bbl->padding_data = buf;
     if(bbl->padding) {
-        memset(buf, 0x0, bbl->padding);
+        encode_bbl_padding(buf, bbl->padding, bbl->padding_pattern, bbl->padding_seed);
         BUMP_WRITE_BUFFER(buf, len, bbl->padding);
     }
     *(uint64_t*)buf = BBL_MAGIC_NUMBER;
@@ -779,9 +1041,14 @@ encode_ipv6(uint8_t *buf, uint16_t *len,
             ipv6_len = *len - ipv6_len;
             /* Update UDP length */
             *(uint16_t*)(buf + 4) = htobe16(ipv6_len);
-            if(((bbl_udp_t*)ipv6->next)->protocol != UDP_PROTOCOL_BBL) {
-                /* Update UDP checksum */
-                *(uint16_t*)(buf + 6) = bbl_ipv6_udp_checksum(ipv6->src, ipv6->dst, buf, ipv6_len);
+            /* Update UDP checksum which is mandatory for IPv6 (RFC 8200),
+             * BBL templates patch this checksum incrementally. */
+            *(uint16_t*)(buf + 6) = bbl_ipv6_udp_checksum(ipv6->src, ipv6->dst, buf, ipv6_len);
+            if(*(uint16_t*)(buf + 6) == 0) {
+                *(uint16_t*)(buf + 6) = 0xffff;
+            }
+            if(((bbl_udp_t*)ipv6->next)->protocol == UDP_PROTOCOL_BBL) {
+                ((bbl_bbl_t*)((bbl_udp_t*)ipv6->next)->next)->udp_checksum = buf + 6;
             }
             break;
         default:
@@ -2372,6 +2639,8 @@ decode_bbl(uint8_t *buf, uint16_t len,
     /* Init BBL header */
     bbl = (bbl_bbl_t*)sp; BUMP_BUFFER(sp, sp_len, sizeof(bbl_bbl_t));
 
+    bbl->padding = len - 48;
+    bbl->padding_data = buf;
     if(len > 48) {
         /* Bump padding... */
         BUMP_BUFFER(buf, len, (len - 48));
@@ -3492,12 +3761,17 @@ decode_arp(uint8_t *buf, uint16_t len,
 }
 
 /*
- * decode_ethernet
+ * decode_ethernet_header
+ *
+ * Decode the link layer (ethernet, VLAN and MPLS) only. All
+ * headers above are decoded on demand with decode_ethernet_next,
+ * allowing RX handlers to drop or forward packets based on the
+ * link layer without paying for the full protocol decode.
  */
 protocol_error_t
-decode_ethernet(uint8_t *buf, uint16_t len,
-                uint8_t *sp, uint16_t sp_len,
-                bbl_ethernet_header_t **ethernet) {
+decode_ethernet_header(uint8_t *buf, uint16_t len,
+                       uint8_t *sp, uint16_t sp_len,
+                       bbl_ethernet_header_t **ethernet) {
 
     bbl_ethernet_header_t *eth;
     bbl_mpls_t *mpls;
@@ -3593,17 +3867,206 @@ decode_ethernet(uint8_t *buf, uint16_t len,
         }
     }
 
+    eth->payload = buf;
+    eth->payload_len = len;
+    eth->sp = sp;
+    eth->sp_len = sp_len;
+    return PROTOCOL_SUCCESS;
+}
+
+/*
+ * decode_ethernet_next
+ *
+ * Decode all headers following the link layer of an ethernet
+ * header returned by decode_ethernet_header. The result is
+ * remembered, so this can be called multiple times per packet.
+ */
+protocol_error_t
+decode_ethernet_next(bbl_ethernet_header_t *eth) {
+
+    protocol_error_t ret_val;
+
+    uint8_t *buf = eth->payload;
+    uint16_t len = eth->payload_len;
+
+    if(eth->decoded) {
+        return eth->decode_result;
+    }
+    eth->decoded = true;
+
     if(eth->type == ETH_TYPE_PPPOE_SESSION) {
-        return decode_pppoe_session(buf, len, sp, sp_len, (bbl_pppoe_session_t**)&eth->next);
+        ret_val = decode_pppoe_session(buf, len, eth->sp, eth->sp_len, (bbl_pppoe_session_t**)&eth->next);
     } else if(eth->type == ETH_TYPE_PPPOE_DISCOVERY) {
-        return decode_pppoe_discovery(buf, len, sp, sp_len, (bbl_pppoe_discovery_t**)&eth->next);
+        ret_val = decode_pppoe_discovery(buf, len, eth->sp, eth->sp_len, (bbl_pppoe_discovery_t**)&eth->next);
     } else if(eth->type == ETH_TYPE_ARP) {
-        return decode_arp(buf, len, sp, sp_len, (bbl_arp_t**)&eth->next);
+        ret_val = decode_arp(buf, len, eth->sp, eth->sp_len, (bbl_arp_t**)&eth->next);
     } else if(eth->type == ETH_TYPE_IPV4) {
-        return decode_ipv4(buf, len, sp, sp_len, (bbl_ipv4_t**)&eth->next);
+        ret_val = decode_ipv4(buf, len, eth->sp, eth->sp_len, (bbl_ipv4_t**)&eth->next);
     } else if(eth->type == ETH_TYPE_IPV6) {
-        return decode_ipv6(buf, len, sp, sp_len, (bbl_ipv6_t**)&eth->next);
+        ret_val = decode_ipv6(buf, len, eth->sp, eth->sp_len, (bbl_ipv6_t**)&eth->next);
+    } else {
+        ret_val = UNKNOWN_PROTOCOL;
+    }
+    eth->decode_result = ret_val;
+    return ret_val;
+}
+
+/*
+ * decode_ethernet
+ */
+protocol_error_t
+decode_ethernet(uint8_t *buf, uint16_t len,
+                uint8_t *sp, uint16_t sp_len,
+                bbl_ethernet_header_t **ethernet) {
+
+    protocol_error_t ret_val;
+
+    ret_val = decode_ethernet_header(buf, len, sp, sp_len, ethernet);
+    if(ret_val != PROTOCOL_SUCCESS) {
+        return ret_val;
     }
+    return decode_ethernet_next(*ethernet);
+}
 
-    return UNKNOWN_PROTOCOL;
+/*
+ * decode_bbl_fast
+ *
+ * Fast-path classifier for BBL test traffic. Ethernet with up to
+ * two VLAN tags, optional PPPoE session header, unfragmented IPv4
+ * without options or IPv6 without extension headers, and UDP to
+ * the BBL port are recognised with fixed offset compares. Only the
+ * ethernet header and the BBL header (eth->next) are filled.
+ *
+ * All other frames (including MPLS) return IGNORED and must
+ * be passed to decode_ethernet.
+ */
+protocol_error_t
+decode_bbl_fast(uint8_t *buf, uint16_t len,
+                uint8_t *sp, uint16_t sp_len,
+                bbl_ethernet_header_t **ethernet, uint8_t *tos) {
+
+    bbl_ethernet_header_t *eth;
+    bbl_bbl_t *bbl;
+
+    uint16_t type;
+    uint16_t ip_len;
+    uint16_t udp_len;
+    uint16_t offset = 12;
+    uint8_t *ip;
+    uint8_t *udp;
+
+    /* Smallest possible BBL frame is ethernet (14),
+     * IPv4 (20), UDP (8) and BBL header (48). */
+    if(len < 90 || sp_len < sizeof(bbl_ethernet_header_t)) {
+        return IGNORED;
+    }
+
+    type = be16toh(*(uint16_t*)(buf+offset));
+    if(type != ETH_TYPE_IPV4 && type != ETH_TYPE_IPV6 &&
+       type != ETH_TYPE_PPPOE_SESSION && type != ETH_TYPE_VLAN &&
+       type != ETH_TYPE_QINQ) {
+        return IGNORED;
+    }
+
+    eth = (bbl_ethernet_header_t*)sp; BUMP_BUFFER(sp, sp_len, sizeof(bbl_ethernet_header_t));
+    memset(eth, 0x0, sizeof(bbl_ethernet_header_t));
+    eth->length = len;
+    eth->dst = buf;
+    eth->src = buf+ETH_ADDR_LEN;
+
+    if(type == ETH_TYPE_VLAN || type == ETH_TYPE_QINQ) {
+        eth->qinq = (type == ETH_TYPE_QINQ);
+        eth->vlan_outer_priority = buf[offset+2] >> 5;
+        eth->vlan_outer = be16toh(*(uint16_t*)(buf+offset+2)) & ETH_VLAN_ID_MAX;
+        offset += 4;
+        type = be16toh(*(uint16_t*)(buf+offset));
+        if(type == ETH_TYPE_VLAN || type == ETH_TYPE_QINQ) {
+            eth->vlan_inner_priority = buf[offset+2] >> 5;
+            eth->vlan_inner = be16toh(*(uint16_t*)(buf+offset+2)) & ETH_VLAN_ID_MAX;
+            offset += 4;
+            type = be16toh(*(uint16_t*)(buf+offset));
+        }
+    }
+    eth->type = type;
+    offset += 2;
+
+    if(type == ETH_TYPE_PPPOE_SESSION) {
+        /* PPPoE version/type (0x11), code (0x00), session,
+         * length and PPP protocol. */
+        if(len < offset + 8 + 76 || buf[offset] != 0x11 || buf[offset+1] != 0) {
+            return IGNORED;
+        }
+        switch(be16toh(*(uint16_t*)(buf+offset+6))) {
+            case PROTOCOL_IPV4:
+                type = ETH_TYPE_IPV4;
+                break;
+            case PROTOCOL_IPV6:
+                type = ETH_TYPE_IPV6;
+                break;
+            default:
+                return IGNORED;
+        }
+        offset += 8;
+    }
+
+    ip = buf+offset;
+    if(type == ETH_TYPE_IPV4) {
+        /* Version 4, IHL 5, no fragments and protocol UDP */
+        if(len < offset + 76 || ip[0] != 0x45 ||
+           (be16toh(*(uint16_t*)(ip+6)) & ~IPV4_DF) ||
+           ip[9] != PROTOCOL_IPV4_UDP) {
+            return IGNORED;
+        }
+        ip_len = be16toh(*(uint16_t*)(ip+2));
+        if(ip_len < 76 || ip_len > len - offset) {
+            return IGNORED;
+        }
+        *tos = ip[1];
+        udp = ip+20;
+        ip_len -= 20;
+    } else if(type == ETH_TYPE_IPV6) {
+        /* Version 6 and next header UDP */
+        if(len < offset + 96 || (ip[0] >> 4) != 6 ||
+           ip[6] != IPV6_NEXT_HEADER_UDP) {
+            return IGNORED;
+        }
+        ip_len = be16toh(*(uint16_t*)(ip+4));
+        if(ip_len < 56 || ip_len > len - offset - 40) {
+            return IGNORED;
+        }
+        *tos = be16toh(*(uint16_t*)ip) >> 4;
+        udp = ip+40;
+    } else {
+        return IGNORED;
+    }
+
+    udp_len = be16toh(*(uint16_t*)(udp+4));
+    if(be16toh(*(uint16_t*)(udp+2)) != BBL_UDP_PORT ||
+       udp_len < 8 + BBL_HEADER_LEN || udp_len > ip_len) {
+        return IGNORED;
+    }
+    udp_len -= 8;
+    udp += 8;
+
+    /* The BBL header is located at the end of the UDP payload. */
+    if(*(uint64_t*)(udp + udp_len - BBL_HEADER_LEN) != BBL_MAGIC_NUMBER) {
+        return IGNORED;
+    }
+    if(decode_bbl(udp, udp_len, sp, sp_len, &bbl) != PROTOCOL_SUCCESS) {
+        return IGNORED;
+    }
+    /* The BBL sub-type must match the IP version, otherwise
+     * the frame is left to the regular decode path. */
+    if(type == ETH_TYPE_IPV4) {
+        if(bbl->sub_type != BBL_SUB_TYPE_IPV4) {
+            return IGNORED;
+        }
+    } else if(bbl->sub_type != BBL_SUB_TYPE_IPV6 &&
+              bbl->sub_type != BBL_SUB_TYPE_IPV6PD) {
+        return IGNORED;
+    }
+    eth->next = bbl;
+    eth->decoded = true;
+    *ethernet = eth;
+    return PROTOCOL_SUCCESS;
 }
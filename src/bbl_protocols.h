@@ -30,6 +30,10 @@
 #define BBL_SUB_TYPE_IPV4               1
 #define BBL_SUB_TYPE_IPV6               2
 #define BBL_SUB_TYPE_IPV6PD             3
+
+#define BBL_PADDING_ZERO                0
+#define BBL_PADDING_COUNTER             1
+#define BBL_PADDING_PRBS                2
 #define BBL_DIRECTION_UP                1
 #define BBL_DIRECTION_DOWN              2
 
@@ -503,6 +507,14 @@ typedef struct bbl_ethernet_header_ {
     bbl_mpls_t *mpls; /* MPLS */
     void       *next; /* next header */
 
+    /* Lazy decode state, see decode_ethernet_next */
+    uint8_t    *payload; /* ethernet payload after VLAN/MPLS */
+    uint16_t    payload_len; /* ethernet payload length */
+    uint8_t    *sp; /* remaining scratchpad */
+    uint16_t    sp_len; /* remaining scratchpad length */
+    bool        decoded; /* next header decoded */
+    uint8_t     decode_result; /* protocol_error_t of next header decode */
+
     struct timespec timestamp; /* receive timestamp */
 } bbl_ethernet_header_t;
 
@@ -816,6 +828,9 @@ typedef struct bbl_l2tp_ {
 
 typedef struct bbl_bbl_ {
     uint16_t     padding;
+    uint8_t      padding_pattern; /* BBL_PADDING_* */
+    uint64_t     padding_seed;
+    uint8_t     *padding_data; /* set by encode and decode */
     uint8_t      type;
     uint8_t      sub_type;
     uint8_t      direction;
@@ -829,8 +844,21 @@ typedef struct bbl_bbl_ {
     uint64_t     flow_id;
     uint64_t     flow_seq;
     struct timespec timestamp;
+    uint8_t     *udp_checksum; /* set by encode if UDP checksum is present */
 } bbl_bbl_t;
 
+/*
+ * BBL packet template with the offsets
+ * of all fields changing per packet.
+ */
+typedef struct bbl_template_ {
+    uint8_t     *buf;
+    uint16_t     len;
+    uint16_t     seq_offset;
+    uint16_t     timestamp_offset;
+    uint16_t     udp_checksum_offset; /* 0 if UDP checksum is not set */
+} bbl_template_t;
+
 typedef struct bbl_qmx_li_ {
     uint32_t     header;
     uint8_t      direction;
@@ -856,6 +884,30 @@ typedef struct bbl_cfm_ {
     uint8_t    *ma_name;
 } bbl_cfm_t;
 
+/*
+ * Internet checksum
+ */
+uint16_t
+bbl_checksum(uint8_t *buf, uint16_t len);
+
+uint16_t
+bbl_checksum_update16(uint16_t checksum, uint16_t old, uint16_t new);
+
+uint16_t
+bbl_checksum_update(uint16_t checksum, void *old, void *new, uint16_t len);
+
+/*
+ * BBL packet templates
+ */
+void
+bbl_template_init(bbl_template_t *tpl, uint8_t *buf, uint16_t len, bbl_bbl_t *bbl);
+
+void
+bbl_template_patch(bbl_template_t *tpl, uint8_t *buf, uint64_t seq, struct timespec *timestamp);
+
+uint16_t
+bbl_template_write(bbl_template_t *tpl, uint8_t *buf, uint64_t seq, struct timespec *timestamp);
+
 /*
  * decode_ethernet
  */
@@ -864,6 +916,28 @@ decode_ethernet(uint8_t *buf, uint16_t len,
                 uint8_t *sp, uint16_t sp_len,
                 bbl_ethernet_header_t **ethernet);
 
+/*
+ * decode_ethernet_header
+ */
+protocol_error_t
+decode_ethernet_header(uint8_t *buf, uint16_t len,
+                       uint8_t *sp, uint16_t sp_len,
+                       bbl_ethernet_header_t **ethernet);
+
+/*
+ * decode_ethernet_next
+ */
+protocol_error_t
+decode_ethernet_next(bbl_ethernet_header_t *eth);
+
+/*
+ * decode_bbl_fast
+ */
+protocol_error_t
+decode_bbl_fast(uint8_t *buf, uint16_t len,
+                uint8_t *sp, uint16_t sp_len,
+                bbl_ethernet_header_t **ethernet, uint8_t *tos);
+
 /*
  * encode_ethernet
  */
@@ -15,6 +15,7 @@
 #include "bbl_dhcpv6.h"
 #include "bbl_tx.h"
 #include "bbl_session_traffic.h"
+#include "bbl_rx.h"
 #include <openssl/md5.h>
 #include <openssl/rand.h>
 
@@ -176,7 +177,9 @@ bbl_igmp_zapping(timer_s *timer)
     }
 
     /* Join next group ... */
+    bbl_igmp_group_unindex(group);
     group->group = next_group;
+    bbl_igmp_group_index(ctx, session, group);
     group->state = IGMP_GROUP_JOINING;
     group->robustness_count = session->igmp_robustness;
     group->send = true;
@@ -235,8 +238,10 @@ bbl_igmp_initial_join(timer_s *timer)
     initial_group = htobe32(be32toh(ctx->config.igmp_group) + (group_start_index * be32toh(ctx->config.igmp_group_iter)));
 
     group = &session->igmp_groups[0];
+    bbl_igmp_group_unindex(group);
     memset(group, 0x0, sizeof(bbl_igmp_group_s));
     group->group = initial_group;
+    bbl_igmp_group_index(ctx, session, group);
     group->source[0] = ctx->config.igmp_source;
     group->robustness_count = session->igmp_robustness;
     group->state = IGMP_GROUP_JOINING;
@@ -248,12 +253,14 @@ bbl_igmp_initial_join(timer_s *timer)
     LOG(IGMP, "IGMP (ID: %u) initial join for group %s\n",
         session->session_id, format_ipv4_address(&group->group));
 
-    if(ctx->config.igmp_group_count > 1 && ctx->config.igmp_zap_interval > 0) {
+    if(ctx->config.igmp_group_count > 1 && ctx->config.igmp_zap_interval > 0 &&
+       session->igmp_group_count > 1) {
         /* Start/Init Zapping Logic ... */
         group->zapping = true;
         session->zapping_joined_group = group;
         group = &session->igmp_groups[1];
         session->zapping_leaved_group = group;
+        bbl_igmp_group_unindex(group);
         memset(group, 0x0, sizeof(bbl_igmp_group_s));
         group->zapping = true;
         group->source[0] = ctx->config.igmp_source;
@@ -271,65 +278,188 @@ bbl_igmp_initial_join(timer_s *timer)
     }
 }
 
-static void
-bbl_rx_stream(bbl_interface_s *interface, bbl_ethernet_header_t *eth, bbl_bbl_t *bbl, uint8_t tos) {
-
-    bbl_stream *stream;
-    void **search = NULL;
+/**
+ * bbl_rx_stream_account
+ *
+ * Account received stream traffic. This is shared by all
+ * interfaces receiving stream traffic (access, network,
+ * A10NSP and L2TP LNS).
+ *
+ * @param interface receiving interface
+ * @param stream traffic stream
+ * @param eth received packet
+ * @param bbl BBL header of received packet
+ * @param tos IPv4 TOS or IPv6 traffic class
+ */
+void
+bbl_rx_stream_account(bbl_interface_s *interface, bbl_stream *stream, bbl_ethernet_header_t *eth, bbl_bbl_t *bbl, uint8_t tos) {
 
     struct timespec delay;
     uint64_t delay_nsec;
 
-    uint64_t loss;
-
     bbl_mpls_t *mpls;
 
-    search = dict_search(interface->ctx->stream_flow_dict, &bbl->flow_id);
-    if(search) {
-        stream = *search;
-        stream->packets_rx++;
-        stream->rx_len = eth->length;
-        stream->rx_priority = tos;
-        stream->rx_outer_vlan_pbit = eth->vlan_outer_priority;
-        stream->rx_inner_vlan_pbit = eth->vlan_inner_priority;
-
-        mpls = eth->mpls;
+    stream->packets_rx++;
+    stream->bytes_rx += eth->length;
+    stream->rx_len = eth->length;
+    stream->rx_l3_len = bbl->padding + BBL_HEADER_LEN + (bbl->sub_type == BBL_SUB_TYPE_IPV4 ? 28 : 48);
+    stream->rx_priority = tos;
+    stream->rx_outer_vlan_pbit = eth->vlan_outer_priority;
+    stream->rx_inner_vlan_pbit = eth->vlan_inner_priority;
+
+    mpls = eth->mpls;
+    if(mpls) {
+        stream->rx_mpls1 = true;
+        stream->rx_mpls1_label = mpls->label;
+        stream->rx_mpls1_exp = mpls->exp;
+        stream->rx_mpls1_ttl = mpls->ttl;
+        mpls = mpls->next;
         if(mpls) {
-            stream->rx_mpls1 = true;
-            stream->rx_mpls1_label = mpls->label;
-            stream->rx_mpls1_exp = mpls->exp;
-            stream->rx_mpls1_ttl = mpls->ttl;
-            mpls = mpls->next;
-            if(mpls) {
-                stream->rx_mpls2 = true;
-                stream->rx_mpls2_label = mpls->label;
-                stream->rx_mpls2_exp = mpls->exp;
-                stream->rx_mpls2_ttl = mpls->ttl;
-            }
+            stream->rx_mpls2 = true;
+            stream->rx_mpls2_label = mpls->label;
+            stream->rx_mpls2_exp = mpls->exp;
+            stream->rx_mpls2_ttl = mpls->ttl;
         }
+    }
 
-        timespec_sub(&delay, &eth->timestamp, &bbl->timestamp);
-        delay_nsec = delay.tv_sec * 1000000000 + delay.tv_nsec;
-        if(delay_nsec > stream->max_delay_ns) {
-            stream->max_delay_ns = delay_nsec;
-        }
-        if(stream->min_delay_ns) {
-            if(delay_nsec < stream->min_delay_ns) {
-                stream->min_delay_ns = delay_nsec;
+    timespec_sub(&delay, &eth->timestamp, &bbl->timestamp);
+    delay_nsec = delay.tv_sec * 1000000000 + delay.tv_nsec;
+    bbl_delay_add(&stream->rx_delay, delay_nsec);
+    bbl_stream_rx_seq(interface->ctx, stream, bbl->flow_seq);
+    if(stream->config->payload_verify) {
+        bbl_stream_rx_payload(stream, bbl);
+    }
+}
+
+/**
+ * bbl_rx_stream
+ *
+ * Account stream traffic using the stream looked up
+ * by bbl_rx_prefetch_stream if present.
+ *
+ * @param interface receiving interface
+ * @param stream stream looked up before or NULL
+ * @param eth received packet
+ * @param bbl BBL header of received packet
+ * @param tos IPv4 TOS or IPv6 traffic class
+ */
+static void
+bbl_rx_stream(bbl_interface_s *interface, bbl_stream *stream, bbl_ethernet_header_t *eth, bbl_bbl_t *bbl, uint8_t tos) {
+
+    if(!(stream && stream->flow_id == bbl->flow_id)) {
+        stream = bbl_stream_get(interface->ctx, bbl->flow_id);
+    }
+    if(stream) {
+        bbl_rx_stream_account(interface, stream, eth, bbl, tos);
+    }
+}
+
+/**
+ * bbl_rx_session_bbl
+ *
+ * Account BBL unicast session traffic or session bound
+ * stream traffic received on access interfaces.
+ *
+ * @param eth received packet
+ * @param interface receiving interface
+ * @param session corresponding session
+ * @param stream stream looked up before or NULL
+ * @param bbl BBL header of received packet
+ * @param tos IPv4 TOS or IPv6 traffic class
+ */
+static void
+bbl_rx_session_bbl(bbl_ethernet_header_t *eth, bbl_interface_s *interface, bbl_session_s *session,
+                   bbl_stream *stream, bbl_bbl_t *bbl, uint8_t tos) {
+
+    uint64_t loss;
+
+    switch (bbl->sub_type) {
+        case BBL_SUB_TYPE_IPV4:
+            if(bbl->outer_vlan_id != session->vlan_key.outer_vlan_id ||
+               bbl->inner_vlan_id != session->vlan_key.inner_vlan_id) {
+                interface->stats.session_ipv4_wrong_session++;
+                break;
             }
-        } else {
-            stream->min_delay_ns = delay_nsec;
-        }
-        if(!stream->rx_first_seq) {
-            stream->rx_first_seq = bbl->flow_seq;
-            interface->ctx->stats.stream_traffic_flows_verified++;
-        } else {
-            if((stream->rx_last_seq +1) < bbl->flow_seq) {
-                loss = bbl->flow_seq - (stream->rx_last_seq +1);
-                stream->loss += loss;
+            if(bbl->flow_id == session->network_ipv4_tx_flow_id) {
+                /* Session traffic */
+                interface->stats.session_ipv4_rx++;
+                session->stats.access_ipv4_rx++;
+                if(!session->access_ipv4_rx_first_seq) {
+                    session->access_ipv4_rx_first_seq = bbl->flow_seq;
+                    interface->ctx->stats.session_traffic_flows_verified++;
+                    session->session_traffic_flows_verified++;
+                } else {
+                    if((session->access_ipv4_rx_last_seq +1) < bbl->flow_seq) {
+                        loss = bbl->flow_seq - (session->access_ipv4_rx_last_seq +1);
+                        interface->stats.session_ipv4_loss += loss;
+                        session->stats.access_ipv4_loss += loss;
+                        LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                            session->session_id, bbl->flow_id, bbl->flow_seq, session->access_ipv4_rx_last_seq);
+                    }
+                }
+                session->access_ipv4_rx_last_seq = bbl->flow_seq;
+            } else {
+                bbl_rx_stream(interface, stream, eth, bbl, tos);
             }
-        }
-        stream->rx_last_seq = bbl->flow_seq;
+            break;
+        case BBL_SUB_TYPE_IPV6:
+            if(bbl->outer_vlan_id != session->vlan_key.outer_vlan_id ||
+               bbl->inner_vlan_id != session->vlan_key.inner_vlan_id) {
+                interface->stats.session_ipv6_wrong_session++;
+                break;
+            }
+            if(bbl->flow_id == session->network_ipv6_tx_flow_id) {
+                /* Session traffic */
+                interface->stats.session_ipv6_rx++;
+                session->stats.access_ipv6_rx++;
+                if(!session->access_ipv6_rx_first_seq) {
+                    session->access_ipv6_rx_first_seq = bbl->flow_seq;
+                    interface->ctx->stats.session_traffic_flows_verified++;
+                    session->session_traffic_flows_verified++;
+                } else {
+                    if((session->access_ipv6_rx_last_seq +1) < bbl->flow_seq) {
+                        loss = bbl->flow_seq - (session->access_ipv6_rx_last_seq +1);
+                        interface->stats.session_ipv6_loss += loss;
+                        session->stats.access_ipv6_loss += loss;
+                        LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                            session->session_id, bbl->flow_id, bbl->flow_seq, session->access_ipv6_rx_last_seq);
+                    }
+                }
+                session->access_ipv6_rx_last_seq = bbl->flow_seq;
+            } else {
+                bbl_rx_stream(interface, stream, eth, bbl, tos);
+            }
+            break;
+        case BBL_SUB_TYPE_IPV6PD:
+            if(bbl->outer_vlan_id != session->vlan_key.outer_vlan_id ||
+               bbl->inner_vlan_id != session->vlan_key.inner_vlan_id) {
+                interface->stats.session_ipv6pd_wrong_session++;
+                break;
+            }
+            if(bbl->flow_id == session->network_ipv6pd_tx_flow_id) {
+                /* Session traffic */
+                interface->stats.session_ipv6pd_rx++;
+                session->stats.access_ipv6pd_rx++;
+                if(!session->access_ipv6pd_rx_first_seq) {
+                    session->access_ipv6pd_rx_first_seq = bbl->flow_seq;
+                    interface->ctx->stats.session_traffic_flows_verified++;
+                    session->session_traffic_flows_verified++;
+                } else {
+                    if((session->access_ipv6pd_rx_last_seq +1) < bbl->flow_seq) {
+                        loss = bbl->flow_seq - (session->access_ipv6pd_rx_last_seq +1);
+                        interface->stats.session_ipv6pd_loss += loss;
+                        session->stats.access_ipv6pd_loss += loss;
+                        LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                            session->session_id, bbl->flow_id, bbl->flow_seq, session->access_ipv6pd_rx_last_seq);
+                    }
+                }
+                session->access_ipv6pd_rx_last_seq = bbl->flow_seq;
+            } else {
+                bbl_rx_stream(interface, stream, eth, bbl, tos);
+            }
+            break;
+        default:
+            break;
     }
 }
 
@@ -338,7 +468,6 @@ bbl_rx_udp_ipv6(bbl_ethernet_header_t *eth, bbl_ipv6_t *ipv6, bbl_interface_s *i
 
     bbl_udp_t *udp = (bbl_udp_t*)ipv6->next;
     bbl_bbl_t *bbl = NULL;
-    uint64_t loss;
 
     switch(udp->dst) {
         case DHCPV6_UDP_CLIENT:
@@ -348,8 +477,6 @@ bbl_rx_udp_ipv6(bbl_ethernet_header_t *eth, bbl_ipv6_t *ipv6, bbl_interface_s *i
             return bbl_dhcpv6_rx(eth, (bbl_dhcpv6_t*)udp->next, session);
         case BBL_UDP_PORT:
             bbl = (bbl_bbl_t*)udp->next;
-            session->stats.accounting_packets_rx++;
-            session->stats.accounting_bytes_rx += eth->length;
             break;
         default:
             break;
@@ -357,66 +484,7 @@ bbl_rx_udp_ipv6(bbl_ethernet_header_t *eth, bbl_ipv6_t *ipv6, bbl_interface_s *i
 
     /* BBL receive handler */
     if(bbl && bbl->type == BBL_TYPE_UNICAST_SESSION) {
-        switch (bbl->sub_type) {
-            case BBL_SUB_TYPE_IPV6:
-                if(bbl->outer_vlan_id != session->vlan_key.outer_vlan_id ||
-                   bbl->inner_vlan_id != session->vlan_key.inner_vlan_id) {
-                    interface->stats.session_ipv6_wrong_session++;
-                    return;
-                }
-                if(bbl->flow_id == session->network_ipv6_tx_flow_id) {
-                    /* Session traffic */
-                    interface->stats.session_ipv6_rx++;
-                    session->stats.access_ipv6_rx++;
-                    if(!session->access_ipv6_rx_first_seq) {
-                        session->access_ipv6_rx_first_seq = bbl->flow_seq;
-                        interface->ctx->stats.session_traffic_flows_verified++;
-                        session->session_traffic_flows_verified++;
-                    } else {
-                        if((session->access_ipv6_rx_last_seq +1) < bbl->flow_seq) {
-                            loss = bbl->flow_seq - (session->access_ipv6_rx_last_seq +1);
-                            interface->stats.session_ipv6_loss += loss;
-                            session->stats.access_ipv6_loss += loss;
-                            LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                                session->session_id, bbl->flow_id, bbl->flow_seq, session->access_ipv6_rx_last_seq);
-                        }
-                    }
-                    session->access_ipv6_rx_last_seq = bbl->flow_seq;
-                } else {
-                    bbl_rx_stream(interface, eth, bbl, ipv6->tos);
-                }
-                break;
-            case BBL_SUB_TYPE_IPV6PD:
-                if(bbl->outer_vlan_id != session->vlan_key.outer_vlan_id ||
-                   bbl->inner_vlan_id != session->vlan_key.inner_vlan_id) {
-                    interface->stats.session_ipv6pd_wrong_session++;
-                    return;
-                }
-                if(bbl->flow_id == session->network_ipv6pd_tx_flow_id) {
-                    /* Session traffic */
-                    interface->stats.session_ipv6pd_rx++;
-                    session->stats.access_ipv6pd_rx++;
-                    if(!session->access_ipv6pd_rx_first_seq) {
-                        session->access_ipv6pd_rx_first_seq = bbl->flow_seq;
-                        interface->ctx->stats.session_traffic_flows_verified++;
-                        session->session_traffic_flows_verified++;
-                    } else {
-                        if((session->access_ipv6pd_rx_last_seq +1) < bbl->flow_seq) {
-                            loss = bbl->flow_seq - (session->access_ipv6pd_rx_last_seq +1);
-                            interface->stats.session_ipv6pd_loss += loss;
-                            session->stats.access_ipv6pd_loss += loss;
-                            LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                                session->session_id, bbl->flow_id, bbl->flow_seq, session->access_ipv6pd_rx_last_seq);
-                        }
-                    }
-                    session->access_ipv6pd_rx_last_seq = bbl->flow_seq;
-                } else {
-                    bbl_rx_stream(interface, eth, bbl, ipv6->tos);
-                }
-                break;
-            default:
-                break;
-        }
+        bbl_rx_session_bbl(eth, interface, session, NULL, bbl, ipv6->tos);
     }
 }
 
@@ -527,8 +595,6 @@ bbl_rx_icmpv6(bbl_ethernet_header_t *eth, bbl_ipv6_t *ipv6, bbl_interface_s *int
                 bbl_session_tx_qnode_insert(session);
             }
         }
-    } else if(icmpv6->type == IPV6_ICMPV6_NEIGHBOR_SOLICITATION) {
-        session->send_requests |= BBL_SEND_ICMPV6_NA;
     } else if(icmpv6->type == IPV6_ICMPV6_ECHO_REQUEST) {
         bbl_send_icmpv6_echo_reply(interface, session, eth, ipv6, icmpv6);
     }
@@ -557,17 +623,14 @@ bbl_rx_igmp(bbl_ipv4_t *ipv4, bbl_session_s *session) {
 
         if(igmp->group) {
             /* Group Specfic Query */
-            for(i=0; i < IGMP_MAX_GROUPS; i++) {
-                group = &session->igmp_groups[i];
-                if(group->group == igmp->group &&
-                   group->state == IGMP_GROUP_ACTIVE) {
-                    group->send = true;
-                    send = true;
-                }
+            group = bbl_igmp_group_get(session, igmp->group);
+            if(group && group->state == IGMP_GROUP_ACTIVE) {
+                group->send = true;
+                send = true;
             }
         } else {
             /* General Query */
-            for(i=0; i < IGMP_MAX_GROUPS; i++) {
+            for(i=0; i < session->igmp_group_count; i++) {
                 group = &session->igmp_groups[i];
                 if(group->state == IGMP_GROUP_ACTIVE) {
                     group->send = true;
@@ -601,7 +664,6 @@ bbl_rx_ipv4(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_s *inter
     bbl_bbl_t *bbl = NULL;
     bbl_igmp_group_s *group = NULL;
     uint64_t loss;
-    int i;
 
     if(ipv4->offset & ~IPV4_DF) {
         /* Reassembling of fragmented IPv4 packets is currently not supported. */
@@ -642,75 +704,11 @@ bbl_rx_ipv4(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_s *inter
     /* BBL receive handler */
     if(bbl) {
         if(bbl->type == BBL_TYPE_UNICAST_SESSION) {
-            if(bbl->outer_vlan_id != session->vlan_key.outer_vlan_id ||
-               bbl->inner_vlan_id != session->vlan_key.inner_vlan_id) {
-                interface->stats.session_ipv4_wrong_session++;
-                return;
-            }
-            if(bbl->flow_id == session->network_ipv4_tx_flow_id) {
-                /* Session traffic */
-                interface->stats.session_ipv4_rx++;
-                session->stats.access_ipv4_rx++;
-                if(!session->access_ipv4_rx_first_seq) {
-                    session->access_ipv4_rx_first_seq = bbl->flow_seq;
-                    interface->ctx->stats.session_traffic_flows_verified++;
-                    session->session_traffic_flows_verified++;
-                } else {
-                    if((session->access_ipv4_rx_last_seq +1) < bbl->flow_seq) {
-                        loss = bbl->flow_seq - (session->access_ipv4_rx_last_seq +1);
-                        interface->stats.session_ipv4_loss += loss;
-                        session->stats.access_ipv4_loss += loss;
-                        LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                            session->session_id, bbl->flow_id, bbl->flow_seq, session->access_ipv4_rx_last_seq);
-                    }
-                }
-                session->access_ipv4_rx_last_seq = bbl->flow_seq;
-            } else {
-                bbl_rx_stream(interface, eth, bbl, ipv4->tos);
-            }
+            bbl_rx_session_bbl(eth, interface, session, NULL, bbl, ipv4->tos);
         } else if(bbl->type == BBL_TYPE_MULTICAST) {
             /* Multicast receive handler */
-            for(i=0; i < IGMP_MAX_GROUPS; i++) {
-                group = &session->igmp_groups[i];
-                if(ipv4->dst == group->group) {
-                    if(group->state >= IGMP_GROUP_ACTIVE) {
-                        interface->stats.mc_rx++;
-                        session->stats.mc_rx++;
-                        group->packets++;
-                        if(!group->first_mc_rx_time.tv_sec) {
-                            group->first_mc_rx_time.tv_sec = eth->timestamp.tv_sec;
-                            group->first_mc_rx_time.tv_nsec = eth->timestamp.tv_nsec;
-                        } else if((session->mc_rx_last_seq +1) < bbl->flow_seq) {
-                            loss = bbl->flow_seq - (session->mc_rx_last_seq +1);
-                            interface->stats.mc_loss += loss;
-                            session->stats.mc_loss += loss;
-                            group->loss += loss;
-                            LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                                session->session_id, bbl->flow_id, bbl->flow_seq, session->mc_rx_last_seq);
-                        }
-                        session->mc_rx_last_seq = bbl->flow_seq;
-                    } else {
-                        interface->stats.mc_rx++;
-                        session->stats.mc_rx++;
-                        group->packets++;
-                        group->last_mc_rx_time.tv_sec = eth->timestamp.tv_sec;
-                        group->last_mc_rx_time.tv_nsec = eth->timestamp.tv_nsec;
-                        if(session->zapping_joined_group &&
-                            session->zapping_leaved_group == group) {
-                            if(session->zapping_joined_group->first_mc_rx_time.tv_sec) {
-                                session->stats.mc_old_rx_after_first_new++;
-                            }
-                        }
-                    }
-                    break;
-                }
-            }
-        }
-    } else {
-        /* Multicast receive handler */
-        for(i=0; i < IGMP_MAX_GROUPS; i++) {
-            group = &session->igmp_groups[i];
-            if(ipv4->dst == group->group) {
+            group = bbl_igmp_group_get(session, ipv4->dst);
+            if(group) {
                 if(group->state >= IGMP_GROUP_ACTIVE) {
                     interface->stats.mc_rx++;
                     session->stats.mc_rx++;
@@ -718,7 +716,15 @@ bbl_rx_ipv4(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_s *inter
                     if(!group->first_mc_rx_time.tv_sec) {
                         group->first_mc_rx_time.tv_sec = eth->timestamp.tv_sec;
                         group->first_mc_rx_time.tv_nsec = eth->timestamp.tv_nsec;
+                    } else if((session->mc_rx_last_seq +1) < bbl->flow_seq) {
+                        loss = bbl->flow_seq - (session->mc_rx_last_seq +1);
+                        interface->stats.mc_loss += loss;
+                        session->stats.mc_loss += loss;
+                        group->loss += loss;
+                        LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                            session->session_id, bbl->flow_id, bbl->flow_seq, session->mc_rx_last_seq);
                     }
+                    session->mc_rx_last_seq = bbl->flow_seq;
                 } else {
                     interface->stats.mc_rx++;
                     session->stats.mc_rx++;
@@ -726,7 +732,7 @@ bbl_rx_ipv4(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_s *inter
                     group->last_mc_rx_time.tv_sec = eth->timestamp.tv_sec;
                     group->last_mc_rx_time.tv_nsec = eth->timestamp.tv_nsec;
                     if(session->zapping_joined_group &&
-                       session->zapping_leaved_group == group) {
+                        session->zapping_leaved_group == group) {
                         if(session->zapping_joined_group->first_mc_rx_time.tv_sec) {
                             session->stats.mc_old_rx_after_first_new++;
                         }
@@ -734,6 +740,32 @@ bbl_rx_ipv4(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_s *inter
                 }
             }
         }
+    } else {
+        /* Multicast receive handler */
+        group = bbl_igmp_group_get(session, ipv4->dst);
+        if(group) {
+            if(group->state >= IGMP_GROUP_ACTIVE) {
+                interface->stats.mc_rx++;
+                session->stats.mc_rx++;
+                group->packets++;
+                if(!group->first_mc_rx_time.tv_sec) {
+                    group->first_mc_rx_time.tv_sec = eth->timestamp.tv_sec;
+                    group->first_mc_rx_time.tv_nsec = eth->timestamp.tv_nsec;
+                }
+            } else {
+                interface->stats.mc_rx++;
+                session->stats.mc_rx++;
+                group->packets++;
+                group->last_mc_rx_time.tv_sec = eth->timestamp.tv_sec;
+                group->last_mc_rx_time.tv_nsec = eth->timestamp.tv_nsec;
+                if(session->zapping_joined_group &&
+                   session->zapping_leaved_group == group) {
+                    if(session->zapping_joined_group->first_mc_rx_time.tv_sec) {
+                        session->stats.mc_old_rx_after_first_new++;
+                    }
+                }
+            }
+        }
     }
 }
 
@@ -1578,6 +1610,32 @@ bbl_rx_arp(bbl_ethernet_header_t *eth, bbl_interface_s *interface, bbl_session_s
     }
 }
 
+/**
+ * bbl_rx_decode
+ *
+ * Decode all headers following the link layer on demand,
+ * so that packets dropped or forwarded based on the link
+ * layer only are never fully decoded.
+ *
+ * @param eth pointer to ethernet header structure of received packet
+ * @param interface pointer to interface on which packet was received
+ * @return true if packet was decoded successfully
+ */
+static bool
+bbl_rx_decode(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
+    switch(decode_ethernet_next(eth)) {
+        case PROTOCOL_SUCCESS:
+            return true;
+        case UNKNOWN_PROTOCOL:
+            interface->stats.packets_rx_drop_unknown++;
+            break;
+        default:
+            interface->stats.packets_rx_drop_decode_error++;
+            break;
+    }
+    return false;
+}
+
 static uint32_t
 bbl_rx_session_id_from_vlan(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
     uint32_t session_id = 0;
@@ -1622,66 +1680,124 @@ bbl_rx_session_id_from_broadcast(bbl_ethernet_header_t *eth, bbl_interface_s *in
     return session_id;
 }
 
+static bbl_session_s *
+bbl_rx_ipoe_vlan_sessions(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
+    vlan_session_key_t key = {0};
+    void **search;
+
+    key.ifindex = interface->ifindex;
+    key.outer_vlan_id = eth->vlan_outer;
+    key.inner_vlan_id = eth->vlan_inner;
+
+    search = dict_search(interface->ctx->ipoe_vlan_dict, &key);
+    if(search) {
+        return *search;
+    }
+    return NULL;
+}
+
+static void
+bbl_rx_multicast_session(bbl_ethernet_header_t *eth, bbl_interface_s *interface, bbl_session_s *session) {
+    if(session->session_state == BBL_TERMINATED ||
+       session->session_state == BBL_IDLE) {
+        return;
+    }
+    session->stats.packets_rx++;
+    session->stats.bytes_rx += eth->length;
+    switch(eth->type) {
+        case ETH_TYPE_IPV4:
+            bbl_rx_ipv4(eth, (bbl_ipv4_t*)eth->next, interface, session);
+            break;
+        case ETH_TYPE_IPV6:
+            bbl_rx_ipv6(eth, (bbl_ipv6_t*)eth->next, interface, session);
+            break;
+        default:
+            interface->stats.packets_rx_drop_unknown++;
+            break;
+    }
+}
+
+/**
+ * bbl_rx_handler_access_multicast
+ *
+ * Multicast frames without session specific VLAN are
+ * passed to IPoE N:1 sessions. IPv4 multicast traffic
+ * outside of 224.0.0.0/24 is passed only to sessions
+ * with the destination address in one of its IGMP group
+ * slots, all other multicast frames are passed to all
+ * IPoE sessions of the receiving VLAN.
+ *
+ * @param eth pointer to ethernet header structure of received packet
+ * @param interface pointer to interface on which packet was received
+ */
 static void
 bbl_rx_handler_access_multicast(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
-    bbl_ctx_s *ctx;
     bbl_session_s *session;
-    uint32_t session_index;
-
-    ctx = interface->ctx;
+    bbl_ipv4_t *ipv4;
+    bbl_igmp_group_s *group;
+    bbl_igmp_members_s *members;
+    void **search;
 
-    for(session_index = 0; session_index < ctx->sessions; session_index++) {
-        session = ctx->session_list[session_index];
-        if(session->access_type == ACCESS_TYPE_IPOE) {
-            if(session->session_state != BBL_TERMINATED &&
-               session->session_state != BBL_IDLE) {
-                session->stats.packets_rx++;
-                session->stats.bytes_rx += eth->length;
-                switch(eth->type) {
-                    case ETH_TYPE_IPV4:
-                        bbl_rx_ipv4(eth, (bbl_ipv4_t*)eth->next, interface, session);
-                        break;
-                    case ETH_TYPE_IPV6:
-                        bbl_rx_ipv6(eth, (bbl_ipv6_t*)eth->next, interface, session);
-                        break;
-                    default:
-                        interface->stats.packets_rx_drop_unknown++;
-                        break;
+    if(eth->type == ETH_TYPE_IPV4) {
+        ipv4 = (bbl_ipv4_t*)eth->next;
+        if((be32toh(ipv4->dst) & 0xffffff00) != 0xe0000000) {
+            search = dict_search(interface->ctx->igmp_group_dict, &ipv4->dst);
+            if(!search) {
+                return;
+            }
+            members = *search;
+            LIST_FOREACH(group, &members->head, member_qnode) {
+                session = group->session;
+                if(session->interface == interface &&
+                   session->vlan_key.outer_vlan_id == eth->vlan_outer &&
+                   session->vlan_key.inner_vlan_id == eth->vlan_inner) {
+                    bbl_rx_multicast_session(eth, interface, session);
                 }
             }
+            return;
         }
     }
+
+    session = bbl_rx_ipoe_vlan_sessions(eth, interface);
+    while(session) {
+        bbl_rx_multicast_session(eth, interface, session);
+        session = session->ipoe_vlan_next;
+    }
 }
 
+/**
+ * bbl_rx_handler_access_broadcast
+ *
+ * Broadcast frames without session specific VLAN are
+ * passed to all IPoE N:1 sessions of the receiving VLAN.
+ *
+ * @param eth pointer to ethernet header structure of received packet
+ * @param interface pointer to interface on which packet was received
+ */
 static void
 bbl_rx_handler_access_broadcast(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
-    bbl_ctx_s *ctx;
     bbl_session_s *session;
-    uint32_t session_index;
-
-    ctx = interface->ctx;
 
-    for(session_index = 0; session_index < ctx->sessions; session_index++) {
-        session = ctx->session_list[session_index];
-        if(session->access_type == ACCESS_TYPE_IPOE) {
-            if(session->session_state != BBL_TERMINATED &&
-               session->session_state != BBL_IDLE) {
-                session->stats.packets_rx++;
-                session->stats.bytes_rx += eth->length;
-                switch(eth->type) {
-                    case ETH_TYPE_ARP:
-                        interface->stats.arp_rx++;
-                        bbl_rx_arp(eth, interface, session);
-                        break;
-                    case ETH_TYPE_IPV4:
-                        bbl_rx_ipv4(eth, (bbl_ipv4_t*)eth->next, interface, session);
-                        break;
-                    default:
-                        interface->stats.packets_rx_drop_unknown++;
-                        break;
-                }
+    session = bbl_rx_ipoe_vlan_sessions(eth, interface);
+    while(session) {
+        if(session->session_state != BBL_TERMINATED &&
+           session->session_state != BBL_IDLE) {
+            session->stats.packets_rx++;
+            session->stats.bytes_rx += eth->length;
+            switch(eth->type) {
+                case ETH_TYPE_ARP:
+                    interface->stats.arp_rx++;
+                    bbl_rx_arp(eth, interface, session);
+                    break;
+                case ETH_TYPE_IPV4:
+                    bbl_rx_ipv4(eth, (bbl_ipv4_t*)eth->next, interface, session);
+                    break;
+                default:
+                    interface->stats.packets_rx_drop_unknown++;
+                    break;
             }
         }
+        session = session->ipoe_vlan_next;
     }
 }
 
@@ -1703,6 +1819,9 @@ bbl_rx_handler_access(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
 
     if(memcmp(eth->dst, broadcast_mac, ETH_ADDR_LEN) == 0) {
         /* Broadcast destination MAC address (ff:ff:ff:ff:ff:ff) */
+        if(!bbl_rx_decode(eth, interface)) {
+            return;
+        }
         session_id = bbl_rx_session_id_from_broadcast(eth, interface);
         if(!session_id) {
             return bbl_rx_handler_access_broadcast(eth, interface);
@@ -1713,6 +1832,9 @@ bbl_rx_handler_access(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
          * as multicast frames- */
         session_id = bbl_rx_session_id_from_vlan(eth, interface);
         if(!session_id) {
+            if(!bbl_rx_decode(eth, interface)) {
+                return;
+            }
             return bbl_rx_handler_access_multicast(eth, interface);
         }
     } else {
@@ -1730,6 +1852,9 @@ bbl_rx_handler_access(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
     if(session) {
         if(session->session_state != BBL_TERMINATED &&
            session->session_state != BBL_IDLE) {
+            if(!bbl_rx_decode(eth, interface)) {
+                return;
+            }
             session->stats.packets_rx++;
             session->stats.bytes_rx += eth->length;
             switch (session->access_type) {
@@ -1842,6 +1967,110 @@ bbl_rx_network_icmp(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_
     }
 }
 
+/**
+ * bbl_rx_network_bbl
+ *
+ * Account BBL unicast session traffic or stream
+ * traffic received on network interfaces.
+ *
+ * @param eth received packet
+ * @param interface receiving interface
+ * @param session session of BBL header or NULL
+ * @param stream stream looked up before or NULL
+ * @param bbl BBL header of received packet
+ * @param tos IPv4 TOS or IPv6 traffic class
+ */
+static void
+bbl_rx_network_bbl(bbl_ethernet_header_t *eth, bbl_interface_s *interface, bbl_session_s *session,
+                   bbl_stream *stream, bbl_bbl_t *bbl, uint8_t tos) {
+
+    uint64_t loss;
+
+    if(bbl->type == BBL_TYPE_UNICAST_SESSION) {
+        if(session) {
+            switch (bbl->sub_type) {
+                case BBL_SUB_TYPE_IPV4:
+                    if(session->access_ipv4_tx_flow_id == bbl->flow_id) {
+                        interface->stats.session_ipv4_rx++;
+                        session->stats.network_ipv4_rx++;
+                        if(!session->network_ipv4_rx_first_seq) {
+                            session->network_ipv4_rx_first_seq = bbl->flow_seq;
+                            interface->ctx->stats.session_traffic_flows_verified++;
+                            session->session_traffic_flows_verified++;
+                        } else {
+                            if((session->network_ipv4_rx_last_seq +1) < bbl->flow_seq) {
+                                loss = bbl->flow_seq - (session->network_ipv4_rx_last_seq +1);
+                                interface->stats.session_ipv4_loss += loss;
+                                session->stats.network_ipv4_loss += loss;
+                                LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                                    session->session_id, bbl->flow_id, bbl->flow_seq, session->network_ipv4_rx_last_seq);
+                            }
+                        }
+                        session->network_ipv4_rx_last_seq = bbl->flow_seq;
+                    } else {
+                        bbl_rx_stream(interface, stream, eth, bbl, tos);
+                    }
+                    break;
+                case BBL_SUB_TYPE_IPV6:
+                    if(session->access_ipv6_tx_flow_id == bbl->flow_id) {
+                        interface->stats.session_ipv6_rx++;
+                        session->stats.network_ipv6_rx++;
+                        if(!session->network_ipv6_rx_first_seq) {
+                            session->network_ipv6_rx_first_seq = bbl->flow_seq;
+                            interface->ctx->stats.session_traffic_flows_verified++;
+                            session->session_traffic_flows_verified++;
+                        } else {
+                            if((session->network_ipv6_rx_last_seq +1) < bbl->flow_seq) {
+                                loss = bbl->flow_seq - (session->network_ipv6_rx_last_seq +1);
+                                interface->stats.session_ipv6_loss += loss;
+                                session->stats.network_ipv6_loss += loss;
+                                LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                                    session->session_id, bbl->flow_id, bbl->flow_seq, session->network_ipv6_rx_last_seq);
+                            }
+                        }
+                        session->network_ipv6_rx_last_seq = bbl->flow_seq;
+                    } else {
+                        bbl_rx_stream(interface, stream, eth, bbl, tos);
+                    }
+                    break;
+                case BBL_SUB_TYPE_IPV6PD:
+                    if(session->access_ipv6pd_tx_flow_id == bbl->flow_id) {
+                        interface->stats.session_ipv6pd_rx++;
+                        session->stats.network_ipv6pd_rx++;
+                        if(!session->network_ipv6pd_rx_first_seq) {
+                            session->network_ipv6pd_rx_first_seq = bbl->flow_seq;
+                            interface->ctx->stats.session_traffic_flows_verified++;
+                            session->session_traffic_flows_verified++;
+                        } else {
+                            if((session->network_ipv6pd_rx_last_seq +1) < bbl->flow_seq) {
+                                loss = bbl->flow_seq - (session->network_ipv6pd_rx_last_seq +1);
+                                interface->stats.session_ipv6pd_loss += loss;
+                                session->stats.network_ipv6pd_loss += loss;
+                                LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
+                                    session->session_id, bbl->flow_id, bbl->flow_seq, session->network_ipv6pd_rx_last_seq);
+                            }
+                        }
+                        session->network_ipv6pd_rx_last_seq = bbl->flow_seq;
+                    } else {
+                        bbl_rx_stream(interface, stream, eth, bbl, tos);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        } else {
+            /* Accept RAW streams */
+            switch (bbl->sub_type) {
+                case BBL_SUB_TYPE_IPV4:
+                case BBL_SUB_TYPE_IPV6:
+                case BBL_SUB_TYPE_IPV6PD:
+                    bbl_rx_stream(interface, stream, eth, bbl, tos);
+                    break;
+            }
+        }
+    }
+}
+
 /**
  * bbl_rx_handler_network
  *
@@ -1853,25 +2082,25 @@ bbl_rx_network_icmp(bbl_ethernet_header_t *eth, bbl_ipv4_t *ipv4, bbl_interface_
 void
 bbl_rx_handler_network(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
 
-    bbl_ctx_s *ctx;
-
     bbl_ipv4_t *ipv4 = NULL;
     bbl_ipv6_t *ipv6 = NULL;
     bbl_udp_t *udp = NULL;
     bbl_bbl_t *bbl = NULL;
-    bbl_session_s *session;
-    uint64_t loss;
-
-    ctx = interface->ctx;
 
     switch(eth->type) {
         case ETH_TYPE_ARP:
+            if(!bbl_rx_decode(eth, interface)) {
+                return;
+            }
             return bbl_rx_network_arp(eth, interface);
         case ETH_TYPE_IPV4:
             if(memcmp(interface->mac, eth->dst, ETH_ADDR_LEN) != 0) {
                 /* Drop wrong MAC */
                 return;
             }
+            if(!bbl_rx_decode(eth, interface)) {
+                return;
+            }
             ipv4 = (bbl_ipv4_t*)eth->next;
             if(ipv4->protocol == PROTOCOL_IPV4_UDP) {
                 udp = (bbl_udp_t*)ipv4->next;
@@ -1888,6 +2117,9 @@ bbl_rx_handler_network(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
             }
             break;
         case ETH_TYPE_IPV6:
+            if(!bbl_rx_decode(eth, interface)) {
+                return;
+            }
             ipv6 = (bbl_ipv6_t*)eth->next;
             if(ipv6->protocol == IPV6_NEXT_HEADER_UDP) {
                 if(memcmp(interface->mac, eth->dst, ETH_ADDR_LEN) != 0) {
@@ -1907,92 +2139,8 @@ bbl_rx_handler_network(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
     }
 
     if(bbl) {
-        if(bbl->type == BBL_TYPE_UNICAST_SESSION) {
-            session = bbl_session_get(ctx, bbl->session_id);
-            if(session) {
-                switch (bbl->sub_type) {
-                    case BBL_SUB_TYPE_IPV4:
-                        if(session->access_ipv4_tx_flow_id == bbl->flow_id) {
-                            interface->stats.session_ipv4_rx++;
-                            session->stats.network_ipv4_rx++;
-                            if(!session->network_ipv4_rx_first_seq) {
-                                session->network_ipv4_rx_first_seq = bbl->flow_seq;
-                                interface->ctx->stats.session_traffic_flows_verified++;
-                                session->session_traffic_flows_verified++;
-                            } else {
-                                if((session->network_ipv4_rx_last_seq +1) < bbl->flow_seq) {
-                                    loss = bbl->flow_seq - (session->network_ipv4_rx_last_seq +1);
-                                    interface->stats.session_ipv4_loss += loss;
-                                    session->stats.network_ipv4_loss += loss;
-                                    LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                                        session->session_id, bbl->flow_id, bbl->flow_seq, session->network_ipv4_rx_last_seq);
-                                }
-                            }
-                            session->network_ipv4_rx_last_seq = bbl->flow_seq;
-                        } else {
-                            if(ipv4) bbl_rx_stream(interface, eth, bbl, ipv4->tos);
-                        }
-                        break;
-                    case BBL_SUB_TYPE_IPV6:
-                        if(session->access_ipv6_tx_flow_id == bbl->flow_id) {
-                            interface->stats.session_ipv6_rx++;
-                            session->stats.network_ipv6_rx++;
-                            if(!session->network_ipv6_rx_first_seq) {
-                                session->network_ipv6_rx_first_seq = bbl->flow_seq;
-                                interface->ctx->stats.session_traffic_flows_verified++;
-                                session->session_traffic_flows_verified++;
-                            } else {
-                                if((session->network_ipv6_rx_last_seq +1) < bbl->flow_seq) {
-                                    loss = bbl->flow_seq - (session->network_ipv6_rx_last_seq +1);
-                                    interface->stats.session_ipv6_loss += loss;
-                                    session->stats.network_ipv6_loss += loss;
-                                    LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                                        session->session_id, bbl->flow_id, bbl->flow_seq, session->network_ipv6_rx_last_seq);
-                                }
-                            }
-                            session->network_ipv6_rx_last_seq = bbl->flow_seq;
-                        } else {
-                            if(ipv6) bbl_rx_stream(interface, eth, bbl, ipv6->tos);
-                        }
-                        break;
-                    case BBL_SUB_TYPE_IPV6PD:
-                        if(session->access_ipv6pd_tx_flow_id == bbl->flow_id) {
-                            interface->stats.session_ipv6pd_rx++;
-                            session->stats.network_ipv6pd_rx++;
-                            if(!session->network_ipv6pd_rx_first_seq) {
-                                session->network_ipv6pd_rx_first_seq = bbl->flow_seq;
-                                interface->ctx->stats.session_traffic_flows_verified++;
-                                session->session_traffic_flows_verified++;
-                            } else {
-                                if((session->network_ipv6pd_rx_last_seq +1) < bbl->flow_seq) {
-                                    loss = bbl->flow_seq - (session->network_ipv6pd_rx_last_seq +1);
-                                    interface->stats.session_ipv6pd_loss += loss;
-                                    session->stats.network_ipv6pd_loss += loss;
-                                    LOG(LOSS, "LOSS (ID: %u) flow: %lu seq: %lu last: %lu\n",
-                                        session->session_id, bbl->flow_id, bbl->flow_seq, session->network_ipv6pd_rx_last_seq);
-                                }
-                            }
-                            session->network_ipv6pd_rx_last_seq = bbl->flow_seq;
-                        } else {
-                            if(ipv6) bbl_rx_stream(interface, eth, bbl, ipv6->tos);
-                        }
-                        break;
-                    default:
-                        break;
-                }
-            } else {
-                /* Accept RAW streams */
-                switch (bbl->sub_type) {
-                    case BBL_SUB_TYPE_IPV4:
-                        if(ipv4) bbl_rx_stream(interface, eth, bbl, ipv4->tos);
-                        break;
-                    case BBL_SUB_TYPE_IPV6:
-                    case BBL_SUB_TYPE_IPV6PD:
-                        if(ipv6) bbl_rx_stream(interface, eth, bbl, ipv6->tos);
-                        break;
-                }
-            }
-        }
+        bbl_rx_network_bbl(eth, interface, bbl_session_get(interface->ctx, bbl->session_id), NULL,
+                           bbl, ipv4 ? ipv4->tos : ipv6->tos);
     } else {
         interface->stats.packets_rx_drop_unknown++;
     }
@@ -2025,6 +2173,199 @@ bbl_rx_handler_a10nsp(bbl_ethernet_header_t *eth, bbl_interface_s *interface) {
 
     session = bbl_session_get(ctx, session_id);
     if(session) {
+        if(!bbl_rx_decode(eth, interface)) {
+            return;
+        }
         bbl_a10nsp_rx(interface, session, eth);
     }
-}
\ No newline at end of file
+}
+static bool
+bbl_rx_access_fast(bbl_rx_batch_t *frame, bbl_bbl_t *bbl, bbl_interface_s *interface) {
+    bbl_ethernet_header_t *eth = frame->eth;
+    bbl_session_s *session = frame->session;
+
+    if(!session ||
+       session->session_state == BBL_TERMINATED ||
+       session->session_state == BBL_IDLE) {
+        return false;
+    }
+    if(session->access_type == ACCESS_TYPE_PPPOE) {
+        if(eth->type != ETH_TYPE_PPPOE_SESSION) {
+            return false;
+        }
+    } else if(eth->type == ETH_TYPE_PPPOE_SESSION) {
+        return false;
+    }
+
+    session->stats.packets_rx++;
+    session->stats.bytes_rx += eth->length;
+    session->stats.accounting_packets_rx++;
+    session->stats.accounting_bytes_rx += eth->length;
+    bbl_rx_session_bbl(eth, interface, session, frame->stream, bbl, frame->tos);
+    return true;
+}
+
+/**
+ * bbl_rx_handler_fast
+ *
+ * This function handles BBL unicast test traffic recognised
+ * by decode_bbl_fast without full protocol decode. The session
+ * and stream must be looked up before by bbl_rx_prefetch_session
+ * and bbl_rx_prefetch_stream.
+ *
+ * @param frame received frame decoded by decode_bbl_fast
+ * @param interface pointer to interface on which packet was received
+ * @return true if packet was handled or false if packet
+ *         must be passed to decode_ethernet and the RX handler
+ */
+bool
+bbl_rx_handler_fast(bbl_rx_batch_t *frame, bbl_interface_s *interface) {
+    bbl_ethernet_header_t *eth = frame->eth;
+    bbl_bbl_t *bbl = (bbl_bbl_t*)eth->next;
+
+    switch(interface->type) {
+        case INTERFACE_TYPE_ACCESS:
+            return bbl_rx_access_fast(frame, bbl, interface);
+        case INTERFACE_TYPE_NETWORK:
+            if(eth->type != ETH_TYPE_IPV4 && eth->type != ETH_TYPE_IPV6) {
+                return false;
+            }
+            if(memcmp(interface->mac, eth->dst, ETH_ADDR_LEN) != 0) {
+                /* Drop wrong MAC */
+                return true;
+            }
+            bbl_rx_network_bbl(eth, interface, frame->session, frame->stream, bbl, frame->tos);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * bbl_rx_fast_session
+ *
+ * Lookup the session of BBL unicast session traffic recognised
+ * by decode_bbl_fast without accessing the session itself.
+ *
+ * @param eth pointer to ethernet header structure of received packet
+ * @param bbl pointer to BBL header of received packet
+ * @param interface pointer to interface on which packet was received
+ * @return session or NULL
+ */
+static bbl_session_s *
+bbl_rx_fast_session(bbl_ethernet_header_t *eth, bbl_bbl_t *bbl, bbl_interface_s *interface) {
+    uint32_t session_id = 0;
+
+    if(bbl->type != BBL_TYPE_UNICAST_SESSION) {
+        return NULL;
+    }
+    switch(interface->type) {
+        case INTERFACE_TYPE_ACCESS:
+            if(*eth->dst & 0x01) {
+                return NULL;
+            }
+            session_id |= eth->dst[5];
+            session_id |= eth->dst[4] << 8;
+            session_id |= eth->dst[3] << 16;
+            break;
+        case INTERFACE_TYPE_NETWORK:
+            session_id = bbl->session_id;
+            break;
+        default:
+            return NULL;
+    }
+    return bbl_session_get(interface->ctx, session_id);
+}
+
+static inline void
+bbl_rx_prefetch_range(void *start, void *end) {
+    uintptr_t line = (uintptr_t)start & ~((uintptr_t)CACHE_LINE_SIZE - 1);
+
+    for(; line < (uintptr_t)end; line += CACHE_LINE_SIZE) {
+        __builtin_prefetch((void*)line, 1);
+    }
+}
+
+/**
+ * bbl_rx_prefetch_session
+ *
+ * Lookup and prefetch the session of BBL traffic recognised
+ * by decode_bbl_fast. This is called for all frames of a
+ * RX batch before bbl_rx_prefetch_stream and before
+ * the frames are passed to bbl_rx_handler_fast, so that
+ * the cache misses of the batch are overlapped. Only the
+ * cache lines used for the BBL sub-type are prefetched and
+ * the session itself is not accessed.
+ *
+ * @param frame received frame decoded by decode_bbl_fast
+ * @param interface pointer to interface on which packet was received
+ */
+void
+bbl_rx_prefetch_session(bbl_rx_batch_t *frame, bbl_interface_s *interface) {
+    bbl_bbl_t *bbl = (bbl_bbl_t*)frame->eth->next;
+    bbl_session_s *session;
+
+    session = bbl_rx_fast_session(frame->eth, bbl, interface);
+    frame->session = session;
+    if(!session) {
+        return;
+    }
+    /* Session state, VLAN key and per packet counters */
+    __builtin_prefetch(session, 1);
+    bbl_rx_prefetch_range(&session->stats.packets_tx, &session->stats.accounting_bytes_rx + 1);
+    /* Session traffic flows and counters of both directions */
+    switch(bbl->sub_type) {
+        case BBL_SUB_TYPE_IPV4:
+            bbl_rx_prefetch_range(&session->access_ipv4_tx_flow_id, &session->network_ipv4_rx_last_seq + 1);
+            bbl_rx_prefetch_range(&session->stats.access_ipv4_rx, &session->stats.network_ipv4_loss + 1);
+            break;
+        case BBL_SUB_TYPE_IPV6:
+            bbl_rx_prefetch_range(&session->access_ipv6_tx_flow_id, &session->network_ipv6_rx_last_seq + 1);
+            bbl_rx_prefetch_range(&session->stats.access_ipv6_rx, &session->stats.network_ipv6_loss + 1);
+            break;
+        case BBL_SUB_TYPE_IPV6PD:
+            bbl_rx_prefetch_range(&session->access_ipv6pd_tx_flow_id, &session->network_ipv6pd_rx_last_seq + 1);
+            bbl_rx_prefetch_range(&session->stats.access_ipv6pd_rx, &session->stats.network_ipv6pd_loss + 1);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * bbl_rx_prefetch_stream
+ *
+ * Lookup and prefetch the stream of BBL traffic recognised
+ * by decode_bbl_fast. All streams are stored in the flow
+ * table, flow identifiers outside of the table belong to
+ * session or multicast traffic. The stream itself is not
+ * accessed, the stream handler verifies the flow-id.
+ *
+ * @param frame received frame decoded by decode_bbl_fast
+ * @param interface pointer to interface on which packet was received
+ */
+void
+bbl_rx_prefetch_stream(bbl_rx_batch_t *frame, bbl_interface_s *interface) {
+    bbl_bbl_t *bbl = (bbl_bbl_t*)frame->eth->next;
+    bbl_ctx_s *ctx = interface->ctx;
+    bbl_stream *stream = NULL;
+
+    if(bbl->flow_id < ctx->stream_flow_table_size) {
+        stream = ctx->stream_flow_table[bbl->flow_id];
+    }
+    frame->stream = stream;
+    if(!stream) {
+        return;
+    }
+    /* All cache lines written per packet by bbl_rx_stream_account
+     * except delay histogram bucket and sequence window word. */
+    __builtin_prefetch(stream, 1);
+    bbl_rx_prefetch_range(&stream->rx_len, &stream->rx_last_seq + 1);
+    __builtin_prefetch(&stream->rx_priority, 1);
+    bbl_rx_prefetch_range(&stream->packets_rx, &stream->bytes_rx + 1);
+    bbl_rx_prefetch_range(&stream->loss, &stream->payload_verify_countdown + 1);
+    if(frame->eth->mpls) {
+        bbl_rx_prefetch_range(&stream->rx_mpls1, &stream->rx_mpls2_ttl + 1);
+    }
+    bbl_rx_prefetch_range(&stream->rx_delay, &stream->rx_delay.jitter + 1);
+}
@@ -11,6 +11,20 @@
 #ifndef __BBL_RX_H__
 #define __BBL_RX_H__
 
+/*
+ * Frame collected from the RX ring by the
+ * batched RX jobs before being handled.
+ */
+typedef struct bbl_rx_batch_ {
+    void *slot; /* ring slot to be released */
+    uint8_t *eth_start;
+    uint16_t eth_len;
+    uint8_t tos;
+    bbl_ethernet_header_t *eth; /* set if decoded by BBL fast path */
+    struct bbl_session_ *session; /* set by bbl_rx_prefetch_session */
+    struct bbl_stream_ *stream; /* set by bbl_rx_prefetch_stream */
+} bbl_rx_batch_t;
+
 void
 bbl_rx_established_ipoe(bbl_ethernet_header_t *eth, bbl_interface_s *interface, bbl_session_s *session);
 
@@ -23,4 +37,16 @@ bbl_rx_handler_network(bbl_ethernet_header_t *eth, bbl_interface_s *interface);
 void
 bbl_rx_handler_a10nsp(bbl_ethernet_header_t *eth, bbl_interface_s *interface);
 
+void
+bbl_rx_stream_account(bbl_interface_s *interface, struct bbl_stream_ *stream, bbl_ethernet_header_t *eth, bbl_bbl_t *bbl, uint8_t tos);
+
+bool
+bbl_rx_handler_fast(bbl_rx_batch_t *frame, bbl_interface_s *interface);
+
+void
+bbl_rx_prefetch_session(bbl_rx_batch_t *frame, bbl_interface_s *interface);
+
+void
+bbl_rx_prefetch_stream(bbl_rx_batch_t *frame, bbl_interface_s *interface);
+
 #endif
\ No newline at end of file
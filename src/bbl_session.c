@@ -9,6 +9,7 @@
 
 #include "bbl.h"
 #include "bbl_session.h"
+#include "bbl_session_traffic.h"
 #include "bbl_stream.h"
 #include "bbl_stats.h"
 
@@ -58,55 +59,171 @@ dhcp_state_string(uint32_t state) {
     }
 }
 
+const uint32_t bbl_session_tx_class_mask[BBL_TX_CLASS_MAX] = {
+    BBL_SEND_CLASS_DISCOVERY,
+    BBL_SEND_CLASS_LCP,
+    BBL_SEND_CLASS_AUTH,
+    BBL_SEND_CLASS_NCP,
+    BBL_SEND_CLASS_DHCP,
+    BBL_SEND_CLASS_MISC,
+    BBL_SEND_CLASS_TRAFFIC
+};
+
+/**
+ * bbl_session_tx_qnode_insert
+ *
+ * Add session to the TX queue of each send
+ * class with pending send requests.
+ *
+ * @param session session
+ */
 void
 bbl_session_tx_qnode_insert(bbl_session_s *session)
 {
     bbl_interface_s *interface = session->interface;
-    if(CIRCLEQ_NEXT(session, session_tx_qnode)) {
-        return;
+    int class;
+
+    for(class = 0; class < BBL_TX_CLASS_MAX; class++) {
+        if(!(session->send_requests & bbl_session_tx_class_mask[class])) {
+            continue;
+        }
+        if(CIRCLEQ_NEXT(session, session_tx_qnode[class])) {
+            continue;
+        }
+        CIRCLEQ_INSERT_TAIL(&interface->session_tx_class_qhead[class], session, session_tx_qnode[class]);
     }
-    CIRCLEQ_INSERT_TAIL(&interface->session_tx_qhead, session, session_tx_qnode);
 }
 
 void
-bbl_session_tx_qnode_remove(bbl_session_s *session)
+bbl_session_tx_qnode_remove(bbl_session_s *session, bbl_tx_class_t class)
 {
     bbl_interface_s *interface = session->interface;
-    CIRCLEQ_REMOVE(&interface->session_tx_qhead, session, session_tx_qnode);
-    CIRCLEQ_NEXT(session, session_tx_qnode) = NULL;
-    CIRCLEQ_PREV(session, session_tx_qnode) = NULL;
+    CIRCLEQ_REMOVE(&interface->session_tx_class_qhead[class], session, session_tx_qnode[class]);
+    CIRCLEQ_NEXT(session, session_tx_qnode[class]) = NULL;
+    CIRCLEQ_PREV(session, session_tx_qnode[class]) = NULL;
+}
+
+#define BBL_IGMP_GROUP_HASH(_session, _address) \
+    ((be32toh(_address) ^ (be32toh(_address) >> 16)) & (_session)->igmp_group_hash_mask)
+
+/**
+ * bbl_igmp_group_get
+ *
+ * Search IGMP group slot by group address
+ * using the session IGMP group index.
+ *
+ * @param session session
+ * @param address group address
+ * @return IGMP group slot or NULL if not found
+ */
+bbl_igmp_group_s *
+bbl_igmp_group_get(bbl_session_s *session, uint32_t address)
+{
+    bbl_igmp_group_s *group;
+    uint16_t slot;
+
+    slot = session->igmp_group_hash[BBL_IGMP_GROUP_HASH(session, address)];
+    while(slot) {
+        group = &session->igmp_groups[slot-1];
+        if(group->group == address) {
+            return group;
+        }
+        slot = group->hash_next;
+    }
+    return NULL;
 }
 
+/**
+ * bbl_igmp_group_unindex
+ *
+ * Remove IGMP group slot from session IGMP group
+ * index and group members. This must be called before
+ * the group address of an indexed slot is changed.
+ *
+ * @param group IGMP group slot
+ */
 void
-bbl_session_network_tx_qnode_insert(bbl_session_s *session)
+bbl_igmp_group_unindex(bbl_igmp_group_s *group)
 {
-    bbl_interface_s *interface = session->network_interface;
-    if(CIRCLEQ_NEXT(session, session_network_tx_qnode)) {
+    bbl_session_s *session = group->session;
+    uint16_t *slot;
+
+    if(!(session && group->group)) {
         return;
     }
-    if(interface) {
-        CIRCLEQ_INSERT_TAIL(&interface->session_tx_qhead, session, session_network_tx_qnode);
+    slot = &session->igmp_group_hash[BBL_IGMP_GROUP_HASH(session, group->group)];
+    while(*slot) {
+        if(&session->igmp_groups[*slot-1] == group) {
+            *slot = group->hash_next;
+            group->hash_next = 0;
+            break;
+        }
+        slot = &session->igmp_groups[*slot-1].hash_next;
+    }
+    if(group->members) {
+        LIST_REMOVE(group, member_qnode);
+        group->members = NULL;
     }
 }
 
-void
-bbl_session_network_tx_qnode_remove(bbl_session_s *session)
+/**
+ * bbl_igmp_group_index
+ *
+ * Add IGMP group slot to session IGMP group index
+ * and group members using the current group address.
+ * The group members are maintained for IPoE N:1
+ * sessions only, which receive multicast traffic
+ * without session specific VLAN.
+ *
+ * @param ctx global context
+ * @param session session
+ * @param group IGMP group slot
+ * @return false if group members could not be created
+ */
+bool
+bbl_igmp_group_index(bbl_ctx_s *ctx, bbl_session_s *session, bbl_igmp_group_s *group)
 {
-    bbl_interface_s *interface = session->network_interface;
-    if(interface) {
-        CIRCLEQ_REMOVE(&interface->session_tx_qhead, session, session_network_tx_qnode);
-        CIRCLEQ_NEXT(session, session_network_tx_qnode) = NULL;
-        CIRCLEQ_PREV(session, session_network_tx_qnode) = NULL;
+    bbl_igmp_members_s *members;
+    dict_insert_result result;
+    void **search;
+    uint16_t *slot;
+
+    group->session = session;
+    if(!group->group) {
+        return true;
     }
-}
+    slot = &session->igmp_group_hash[BBL_IGMP_GROUP_HASH(session, group->group)];
+    group->hash_next = *slot;
+    *slot = (group - session->igmp_groups) + 1;
 
-void
-bbl_session_rate_job (timer_s *timer) {
-    bbl_session_s *session = timer->data;
-    bbl_compute_avg_rate(&session->stats.rate_packets_tx, session->stats.packets_tx);
-    bbl_compute_avg_rate(&session->stats.rate_packets_rx, session->stats.packets_rx);
-    bbl_compute_avg_rate(&session->stats.rate_bytes_tx, session->stats.bytes_tx);
-    bbl_compute_avg_rate(&session->stats.rate_bytes_rx, session->stats.bytes_rx);
+    if(session->access_type != ACCESS_TYPE_IPOE ||
+       session->access_config->vlan_mode != VLAN_MODE_N1) {
+        return true;
+    }
+    search = dict_search(ctx->igmp_group_dict, &group->group);
+    if(search) {
+        members = *search;
+    } else {
+        members = calloc(1, sizeof(bbl_igmp_members_s));
+        if(!members) {
+            LOG(ERROR, "IGMP (ID: %u) failed to allocate members of group %s\n",
+                session->session_id, format_ipv4_address(&group->group));
+            return false;
+        }
+        members->group = group->group;
+        LIST_INIT(&members->head);
+        result = dict_insert(ctx->igmp_group_dict, &members->group);
+        if(!result.inserted) {
+            LOG(ERROR, "IGMP (ID: %u) failed to add members of group %s\n",
+                session->session_id, format_ipv4_address(&group->group));
+            free(members);
+            return false;
+        }
+        *result.datum_ptr = members;
+    }
+    group->members = members;
+    LIST_INSERT_HEAD(&members->head, group, member_qnode);
+    return true;
 }
 
 /**
@@ -198,9 +315,9 @@ bbl_session_update_state(bbl_ctx_s *ctx, bbl_session_s *session, session_state_t
             timer_del(session->timer_zapping);
             timer_del(session->timer_icmpv6);
             timer_del(session->timer_session);
-            timer_del(session->timer_session_traffic_ipv4);
-            timer_del(session->timer_session_traffic_ipv6);
-            timer_del(session->timer_session_traffic_ipv6pd);
+            bbl_session_traffic_stop(session, BBL_SESSION_TRAFFIC_IPV4);
+            bbl_session_traffic_stop(session, BBL_SESSION_TRAFFIC_IPV6);
+            bbl_session_traffic_stop(session, BBL_SESSION_TRAFFIC_IPV6PD);
 
             /* Reset all states */
             session->lcp_state = BBL_PPP_CLOSED;
@@ -218,7 +335,7 @@ bbl_session_update_state(bbl_ctx_s *ctx, bbl_session_s *session, session_state_t
                     if(ctx->config.pppoe_reconnect) {
                         /* Reset session for reconnect */
                         state = BBL_IDLE;
-                        CIRCLEQ_INSERT_TAIL(&ctx->sessions_idle_qhead, session, session_idle_qnode);
+                        CIRCLEQ_INSERT_TAIL(&BBL_SESSION_SLICE(ctx, session)->idle_qhead, session, session_idle_qnode);
                         memset(&session->server_mac, 0xff, ETH_ADDR_LEN); /* init with broadcast MAC */
                         session->pppoe_session_id = 0;
                         if(session->pppoe_ac_cookie) {
@@ -275,32 +392,32 @@ bbl_session_update_state(bbl_ctx_s *ctx, bbl_session_s *session, session_state_t
                         session->session_traffic_flows_verified = 0;
                         session->access_ipv4_tx_flow_id = 0;
                         session->access_ipv4_tx_seq = 0;
-                        session->access_ipv4_tx_packet_len = 0;
+                        session->access_ipv4_tx_template.len = 0;
                         session->access_ipv4_rx_first_seq = 0;
                         session->access_ipv4_rx_last_seq = 0;
                         session->network_ipv4_tx_flow_id = 0;
                         session->network_ipv4_tx_seq = 0;
-                        session->network_ipv4_tx_packet_len = 0;
+                        session->network_ipv4_tx_template.len = 0;
                         session->network_ipv4_rx_first_seq = 0;
                         session->network_ipv4_rx_last_seq = 0;
                         session->access_ipv6_tx_flow_id = 0;
                         session->access_ipv6_tx_seq = 0;
-                        session->access_ipv6_tx_packet_len = 0;
+                        session->access_ipv6_tx_template.len = 0;
                         session->access_ipv6_rx_first_seq = 0;
                         session->access_ipv6_rx_last_seq = 0;
                         session->network_ipv6_tx_flow_id = 0;
                         session->network_ipv6_tx_seq = 0;
-                        session->network_ipv6_tx_packet_len = 0;
+                        session->network_ipv6_tx_template.len = 0;
                         session->network_ipv6_rx_first_seq = 0;
                         session->network_ipv6_rx_last_seq = 0;
                         session->access_ipv6pd_tx_flow_id = 0;
                         session->access_ipv6pd_tx_seq = 0;
-                        session->access_ipv6pd_tx_packet_len = 0;
+                        session->access_ipv6pd_tx_template.len = 0;
                         session->access_ipv6pd_rx_first_seq = 0;
                         session->access_ipv6pd_rx_last_seq = 0;
                         session->network_ipv6pd_tx_flow_id = 0;
                         session->network_ipv6pd_tx_seq = 0;
-                        session->network_ipv6pd_tx_packet_len = 0;
+                        session->network_ipv6pd_tx_template.len = 0;
                         session->network_ipv6pd_rx_first_seq = 0;
                         session->network_ipv6pd_rx_last_seq = 0;
 
@@ -423,6 +540,34 @@ bbl_session_clear(bbl_ctx_s *ctx, bbl_session_s *session)
     }
 }
 
+/*
+ * Session strings are never freed, therefore
+ * they are carved from larger chunks of memory
+ * instead of allocating each string separately.
+ */
+static char *
+session_strdup(const char *source)
+{
+    static char *chunk = NULL;
+    static size_t chunk_free = 0;
+    size_t len = strlen(source) + 1;
+    char *s;
+
+    if(len > chunk_free) {
+        chunk_free = len > BBL_SESSION_STRING_CHUNK ? len : BBL_SESSION_STRING_CHUNK;
+        chunk = malloc(chunk_free);
+        if(!chunk) {
+            chunk_free = 0;
+            return NULL;
+        }
+    }
+    s = chunk;
+    memcpy(s, source, len);
+    chunk += len;
+    chunk_free -= len;
+    return s;
+}
+
 static void
 update_strings(char **target, const char *source, uint32_t *i, bbl_access_config_s *access_config)
 {
@@ -446,8 +591,51 @@ update_strings(char **target, const char *source, uint32_t *i, bbl_access_config
         s = replace_substring(s, "{session}", snum2);
         s = replace_substring(s, "{i1}", si1);
         s = replace_substring(s, "{i2}", si2);
-        if(s) *target = strdup(s);
+        if(s) {
+            if(strcmp(s, source) == 0) {
+                /* Nothing to replace, so all sessions can
+                 * share the configured string. */
+                *target = (char*)source;
+            } else {
+                *target = session_strdup(s);
+            }
+        }
+    }
+}
+
+/**
+ * bbl_session_slices_init
+ *
+ * Allocate and initialize session slices. The number
+ * of slices is limited to the number of sessions to
+ * prevent empty slices.
+ *
+ * @param ctx global context
+ * @return true if successful
+ */
+bool
+bbl_session_slices_init(bbl_ctx_s *ctx)
+{
+    bbl_session_slice_s *slice;
+    uint16_t i;
+
+    if(!ctx->config.session_slices) {
+        ctx->config.session_slices = 1;
     }
+    if(ctx->config.sessions && ctx->config.session_slices > ctx->config.sessions) {
+        ctx->config.session_slices = ctx->config.sessions;
+    }
+    ctx->session_slices = calloc(ctx->config.session_slices, sizeof(bbl_session_slice_s));
+    if(!ctx->session_slices) {
+        return false;
+    }
+    for(i = 0; i < ctx->config.session_slices; i++) {
+        slice = &ctx->session_slices[i];
+        CIRCLEQ_INIT(&slice->idle_qhead);
+        CIRCLEQ_INIT(&slice->teardown_qhead);
+    }
+    ctx->session_slice_cursor = 0;
+    return true;
 }
 
 bool
@@ -459,6 +647,7 @@ bbl_sessions_init(bbl_ctx_s *ctx)
     dict_insert_result result;
 
     uint32_t i = 1;  /* BNG Blaster internal session identifier */
+    uint32_t igmp_group_buckets;
 
     /* The variable t counts how many sessions are created in one
      * loop over all access configurations and is reset to zero
@@ -470,6 +659,27 @@ bbl_sessions_init(bbl_ctx_s *ctx)
 
     /* Init list of sessions */
     ctx->session_list = calloc(ctx->config.sessions, sizeof(session));
+    /* All sessions are carved from a single arena. */
+    ctx->session_arena = calloc(ctx->config.sessions, sizeof(bbl_session_s));
+    if(!(ctx->session_list && ctx->session_arena)) {
+        LOG(ERROR, "Failed to allocate memory for %u sessions!\n", ctx->config.sessions);
+        return false;
+    }
+    /* IGMP group slots and indexes are carved from
+     * pools sized by the configured max groups. */
+    igmp_group_buckets = 1;
+    while(igmp_group_buckets < ctx->config.igmp_max_groups) {
+        igmp_group_buckets <<= 1;
+    }
+    ctx->igmp_group_pool = calloc((size_t)ctx->config.sessions * ctx->config.igmp_max_groups, sizeof(bbl_igmp_group_s));
+    ctx->igmp_group_hash_pool = calloc((size_t)ctx->config.sessions * igmp_group_buckets, sizeof(uint16_t));
+    if(!(ctx->igmp_group_pool && ctx->igmp_group_hash_pool)) {
+        LOG(ERROR, "Failed to allocate memory for %u IGMP groups per session!\n", ctx->config.igmp_max_groups);
+        return false;
+    }
+    if(!bbl_session_slices_init(ctx)) {
+        return false;
+    }
     access_config = ctx->config.access_config;
 
     /* For equal distribution of sessions over access configurations
@@ -523,11 +733,7 @@ bbl_sessions_init(bbl_ctx_s *ctx)
         }
         t++;
         access_config->sessions++;
-        session = calloc(1, sizeof(bbl_session_s));
-        if (!session) {
-            LOG(ERROR, "Failed to allocate memory for session %u!\n", i);
-            return false;
-        }
+        session = &ctx->session_arena[i-1];
         memset(&session->server_mac, 0xff, ETH_ADDR_LEN); /* init with broadcast MAC */
         memset(&session->dhcp_server_mac, 0xff, ETH_ADDR_LEN); /* init with broadcast MAC */
         session->session_id = i; /* BNG Blaster internal session identifier */
@@ -606,6 +812,10 @@ bbl_sessions_init(bbl_ctx_s *ctx)
         session->igmp_autostart = access_config->igmp_autostart;
         session->igmp_version = access_config->igmp_version;
         session->igmp_robustness = 2; /* init robustness with 2 */
+        session->igmp_group_count = ctx->config.igmp_max_groups;
+        session->igmp_groups = &ctx->igmp_group_pool[(size_t)(i-1) * ctx->config.igmp_max_groups];
+        session->igmp_group_hash_mask = igmp_group_buckets - 1;
+        session->igmp_group_hash = &ctx->igmp_group_hash_pool[(size_t)(i-1) * igmp_group_buckets];
         session->zapping_group_max = be32toh(ctx->config.igmp_group) + ((ctx->config.igmp_group_count - 1) * be32toh(ctx->config.igmp_group_iter));
 
         /* Session traffic */
@@ -634,7 +844,7 @@ bbl_sessions_init(bbl_ctx_s *ctx)
         session->interface = access_config->access_if;
         session->network_interface = bbl_get_network_interface(ctx, access_config->network_interface);
         session->session_state = BBL_IDLE;
-        CIRCLEQ_INSERT_TAIL(&ctx->sessions_idle_qhead, session, session_idle_qnode);
+        CIRCLEQ_INSERT_TAIL(&BBL_SESSION_SLICE(ctx, session)->idle_qhead, session, session_idle_qnode);
         ctx->sessions++;
         if(session->access_type == ACCESS_TYPE_PPPOE) {
             ctx->sessions_pppoe++;
@@ -650,13 +860,31 @@ bbl_sessions_init(bbl_ctx_s *ctx)
             if (result.inserted) {
                 *result.datum_ptr = session;
             }
+        } else if(session->access_type == ACCESS_TYPE_IPOE) {
+            /* Add N:1 IPoE sessions to VLAN/session list dictionary
+             * used for broadcast and multicast RX dispatch. */
+            result = dict_insert(ctx->ipoe_vlan_dict, &session->vlan_key);
+            if(!result.datum_ptr) {
+                LOG(ERROR, "Failed to add session %u to VLAN dictionary!\n", session->session_id);
+                return false;
+            }
+            if (!result.inserted) {
+                session->ipoe_vlan_next = *result.datum_ptr;
+            }
+            *result.datum_ptr = session;
         }
         if(access_config->stream_group_id) {
             if(!bbl_stream_add(ctx, access_config, session)) {
                 LOG(ERROR, "Failed to create session traffic stream!\n");
                 return false;
             }
-            timer_add_periodic(&ctx->timer_root, &session->timer_rate, "Rate Computation", 1, 0, session, &bbl_session_rate_job);
+            if(!(bbl_rate_sweep_add(&ctx->rate_sweep, &session->stats.rate_packets_tx, &session->stats.packets_tx) &&
+                 bbl_rate_sweep_add(&ctx->rate_sweep, &session->stats.rate_packets_rx, &session->stats.packets_rx) &&
+                 bbl_rate_sweep_add(&ctx->rate_sweep, &session->stats.rate_bytes_tx, &session->stats.bytes_tx) &&
+                 bbl_rate_sweep_add(&ctx->rate_sweep, &session->stats.rate_bytes_rx, &session->stats.bytes_rx))) {
+                LOG(ERROR, "Failed to add session rates!\n");
+                return false;
+            }
         }
 
         if(access_config->access_line_profile_id) {
@@ -12,6 +12,13 @@
 
 typedef struct bbl_igmp_group_
 {
+    /* Membership of IPoE N:1 sessions used for
+     * multicast RX dispatch, see bbl_igmp_group_index. */
+    struct bbl_igmp_members_ *members;
+    LIST_ENTRY(bbl_igmp_group_) member_qnode;
+    struct bbl_session_ *session;
+    uint16_t hash_next; /* next group slot (index + 1) in same bucket */
+
     uint8_t  state;
     uint8_t  robustness_count;
     bool     send;
@@ -26,6 +33,18 @@ typedef struct bbl_igmp_group_
     struct timespec last_mc_rx_time;
 } bbl_igmp_group_s;
 
+/*
+ * IGMP group members
+ *
+ * List of all IGMP group slots of IPoE N:1
+ * sessions with the same group address.
+ */
+typedef struct bbl_igmp_members_
+{
+    uint32_t group;
+    LIST_HEAD(igmp_members_, bbl_igmp_group_) head;
+} bbl_igmp_members_s;
+
 typedef struct vlan_session_key_ {
     uint32_t ifindex;
     uint16_t outer_vlan_id;
@@ -37,24 +56,172 @@ typedef struct vlan_session_key_ {
  */
 typedef struct bbl_session_
 {
+    /* The leading fields are those touched per packet in
+     * RX/TX dispatch and traffic accounting (session state,
+     * session traffic flows and per packet counters) up to
+     * BBL_SESSION_HOT_END. All configuration, timers, strings,
+     * protocol states, control counters and rates are kept
+     * behind to limit the number of cache lines touched per
+     * packet. */
     uint32_t session_id; /* BNG Blaster internal session identifier */
 
     session_state_t session_state;
+    bbl_access_type_t access_type;
     uint32_t send_requests;
-    uint32_t network_send_requests;
 
-    CIRCLEQ_ENTRY(bbl_session_) session_tx_qnode;
-    CIRCLEQ_ENTRY(bbl_session_) session_idle_qnode;
-    CIRCLEQ_ENTRY(bbl_session_) session_teardown_qnode;
-    CIRCLEQ_ENTRY(bbl_session_) session_network_tx_qnode;
+    struct {
+        uint32_t ifindex;
+        uint16_t outer_vlan_id;
+        uint16_t inner_vlan_id;
+    } vlan_key;
 
     struct bbl_interface_ *interface; /* where this session is attached to */
     struct bbl_interface_ *network_interface; /* selected network interface */
-    struct bbl_access_config_ *access_config;
+    struct bbl_session_ *ipoe_vlan_next; /* next IPoE N:1 session with same VLAN */
 
     uint8_t *write_buf; /* pointer to the slot in the tx_ring */
     uint16_t write_idx;
 
+    uint8_t session_traffic_flows;
+    uint8_t session_traffic_flows_verified;
+
+    /* Multicast Traffic */
+    uint16_t igmp_group_hash_mask;
+    uint16_t *igmp_group_hash; /* group slot (index + 1) per bucket */
+    bbl_igmp_group_s *igmp_groups;
+    uint64_t mc_rx_last_seq;
+
+    /* Session Traffic */
+    uint64_t access_ipv4_tx_flow_id;
+    uint64_t access_ipv4_tx_seq;
+    bbl_template_t access_ipv4_tx_template;
+    uint64_t access_ipv4_rx_first_seq;
+    uint64_t access_ipv4_rx_last_seq;
+
+    uint64_t network_ipv4_tx_flow_id;
+    uint64_t network_ipv4_tx_seq;
+    bbl_template_t network_ipv4_tx_template;
+    uint64_t network_ipv4_rx_first_seq;
+    uint64_t network_ipv4_rx_last_seq;
+
+    uint64_t access_ipv6_tx_flow_id;
+    uint64_t access_ipv6_tx_seq;
+    bbl_template_t access_ipv6_tx_template;
+    uint64_t access_ipv6_rx_first_seq;
+    uint64_t access_ipv6_rx_last_seq;
+
+    uint64_t network_ipv6_tx_flow_id;
+    uint64_t network_ipv6_tx_seq;
+    bbl_template_t network_ipv6_tx_template;
+    uint64_t network_ipv6_rx_first_seq;
+    uint64_t network_ipv6_rx_last_seq;
+
+    uint64_t access_ipv6pd_tx_flow_id;
+    uint64_t access_ipv6pd_tx_seq;
+    bbl_template_t access_ipv6pd_tx_template;
+    uint64_t access_ipv6pd_rx_first_seq;
+    uint64_t access_ipv6pd_rx_last_seq;
+
+    uint64_t network_ipv6pd_tx_flow_id;
+    uint64_t network_ipv6pd_tx_seq;
+    bbl_template_t network_ipv6pd_tx_template;
+    uint64_t network_ipv6pd_rx_first_seq;
+    uint64_t network_ipv6pd_rx_last_seq;
+
+    struct {
+        /* Per packet counters */
+        uint64_t packets_tx;
+        uint64_t packets_rx;
+        uint64_t bytes_tx;
+        uint64_t bytes_rx;
+
+        /* Accounting relevant traffic (without control). */
+        uint64_t accounting_packets_tx;
+        uint64_t accounting_packets_rx;
+        uint64_t accounting_bytes_tx;
+        uint64_t accounting_bytes_rx;
+
+        uint64_t access_ipv4_rx;
+        uint64_t access_ipv4_tx;
+        uint64_t access_ipv4_loss;
+        uint64_t network_ipv4_rx;
+        uint64_t network_ipv4_tx;
+        uint64_t network_ipv4_loss;
+
+        uint64_t access_ipv6_rx;
+        uint64_t access_ipv6_tx;
+        uint64_t access_ipv6_loss;
+        uint64_t network_ipv6_rx;
+        uint64_t network_ipv6_tx;
+        uint64_t network_ipv6_loss;
+
+        uint64_t access_ipv6pd_rx;
+        uint64_t access_ipv6pd_tx;
+        uint64_t access_ipv6pd_loss;
+        uint64_t network_ipv6pd_rx;
+        uint64_t network_ipv6pd_tx;
+        uint64_t network_ipv6pd_loss;
+
+        uint32_t mc_rx;
+        uint32_t mc_loss; /* packet loss */
+
+        /* Control counters */
+        uint32_t igmp_rx;
+        uint32_t igmp_tx;
+
+        uint32_t min_join_delay;
+        uint32_t avg_join_delay;
+        uint32_t max_join_delay;
+
+        uint32_t min_leave_delay;
+        uint32_t avg_leave_delay;
+        uint32_t max_leave_delay;
+
+        /* This value counts all MC packets for old
+         * group received after first packet for new
+         * group received. */
+        uint32_t mc_old_rx_after_first_new;
+        uint32_t mc_not_received;
+        uint32_t arp_rx;
+        uint32_t arp_tx;
+        uint32_t icmp_rx;
+        uint32_t icmp_tx;
+        uint32_t icmpv6_rx;
+        uint32_t icmpv6_tx;
+        uint32_t ipv4_fragmented_rx;
+
+        uint32_t dhcp_tx;
+        uint32_t dhcp_rx;
+        uint32_t dhcp_tx_discover;
+        uint32_t dhcp_rx_offer;
+        uint32_t dhcp_tx_request;
+        uint32_t dhcp_rx_ack;
+        uint32_t dhcp_rx_nak;
+        uint32_t dhcp_tx_release;
+
+        uint32_t dhcpv6_tx;
+        uint32_t dhcpv6_rx;
+        uint32_t dhcpv6_tx_solicit;
+        uint32_t dhcpv6_rx_advertise;
+        uint32_t dhcpv6_tx_request;
+        uint32_t dhcpv6_rx_reply;
+        uint32_t dhcpv6_tx_renew;
+        uint32_t dhcpv6_tx_release;
+
+        uint32_t flapped; /* flap counter */
+
+        bbl_rate_s rate_packets_tx;
+        bbl_rate_s rate_packets_rx;
+        bbl_rate_s rate_bytes_tx;
+        bbl_rate_s rate_bytes_rx;
+    } stats;
+
+    CIRCLEQ_ENTRY(bbl_session_) session_tx_qnode[BBL_TX_CLASS_MAX];
+    CIRCLEQ_ENTRY(bbl_session_) session_idle_qnode;
+    CIRCLEQ_ENTRY(bbl_session_) session_teardown_qnode;
+
+    struct bbl_access_config_ *access_config;
+
     /* Session timer */
     struct timer_ *timer_arp;
     struct timer_ *timer_padi;
@@ -74,24 +241,12 @@ typedef struct bbl_session_
     struct timer_ *timer_zapping;
     struct timer_ *timer_icmpv6;
     struct timer_ *timer_session;
-    struct timer_ *timer_session_traffic_ipv4;
-    struct timer_ *timer_session_traffic_ipv6;
-    struct timer_ *timer_session_traffic_ipv6pd;
-    struct timer_ *timer_rate;
     struct timer_ *timer_cfm_cc;
 
-    bbl_access_type_t access_type;
-
     uint16_t stream_group_id;
     void *stream;
     bool stream_traffic;
 
-    struct {
-        uint32_t ifindex;
-        uint16_t outer_vlan_id;
-        uint16_t inner_vlan_id;
-    } vlan_key;
-
     uint16_t access_third_vlan;
 
     /* Set to true if session is tunnelled via L2TP. */
@@ -244,7 +399,7 @@ typedef struct bbl_session_
     bool     igmp_autostart;
     uint8_t  igmp_version;
     uint8_t  igmp_robustness;
-    bbl_igmp_group_s igmp_groups[IGMP_MAX_GROUPS];
+    uint16_t igmp_group_count; /* number of group slots */
 
     /* IGMP Zapping */
     bbl_igmp_group_s *zapping_joined_group;
@@ -257,154 +412,59 @@ typedef struct bbl_session_
     uint32_t zapping_leave_delay_count;
     struct timespec zapping_view_start_time;
 
-    /* Multicast Traffic */
-    uint64_t mc_rx_last_seq;
-
     /* Session Traffic */
     bool session_traffic;
 
-    uint8_t session_traffic_flows;
-    uint8_t session_traffic_flows_verified;
-
-    uint64_t access_ipv4_tx_flow_id;
-    uint64_t access_ipv4_tx_seq;
-    uint8_t *access_ipv4_tx_packet_template;
-    uint8_t  access_ipv4_tx_packet_len;
-    uint64_t access_ipv4_rx_first_seq;
-    uint64_t access_ipv4_rx_last_seq;
-
-    uint64_t network_ipv4_tx_flow_id;
-    uint64_t network_ipv4_tx_seq;
-    uint8_t *network_ipv4_tx_packet_template;
-    uint8_t  network_ipv4_tx_packet_len;
-    uint64_t network_ipv4_rx_first_seq;
-    uint64_t network_ipv4_rx_last_seq;
-
-    uint64_t access_ipv6_tx_flow_id;
-    uint64_t access_ipv6_tx_seq;
-    uint8_t *access_ipv6_tx_packet_template;
-    uint8_t  access_ipv6_tx_packet_len;
-    uint64_t access_ipv6_rx_first_seq;
-    uint64_t access_ipv6_rx_last_seq;
-
-    uint64_t network_ipv6_tx_flow_id;
-    uint64_t network_ipv6_tx_seq;
-    uint8_t *network_ipv6_tx_packet_template;
-    uint8_t  network_ipv6_tx_packet_len;
-    uint64_t network_ipv6_rx_first_seq;
-    uint64_t network_ipv6_rx_last_seq;
-
-    uint64_t access_ipv6pd_tx_flow_id;
-    uint64_t access_ipv6pd_tx_seq;
-    uint8_t *access_ipv6pd_tx_packet_template;
-    uint8_t  access_ipv6pd_tx_packet_len;
-    uint64_t access_ipv6pd_rx_first_seq;
-    uint64_t access_ipv6pd_rx_last_seq;
-
-    uint64_t network_ipv6pd_tx_flow_id;
-    uint64_t network_ipv6pd_tx_seq;
-    uint8_t *network_ipv6pd_tx_packet_template;
-    uint8_t  network_ipv6pd_tx_packet_len;
-    uint64_t network_ipv6pd_rx_first_seq;
-    uint64_t network_ipv6pd_rx_last_seq;
-
-    struct {
-        uint64_t packets_tx;
-        uint64_t packets_rx;
-        bbl_rate_s rate_packets_tx;
-        bbl_rate_s rate_packets_rx;
-        uint64_t bytes_tx;
-        uint64_t bytes_rx;
-        bbl_rate_s rate_bytes_tx;
-        bbl_rate_s rate_bytes_rx;
-
-        /* Accounting relevant traffic (without control). */
-        uint64_t accounting_packets_tx;
-        uint64_t accounting_packets_rx;
-        uint64_t accounting_bytes_tx;
-        uint64_t accounting_bytes_rx;
-
-        uint32_t igmp_rx;
-        uint32_t igmp_tx;
-
-        uint32_t min_join_delay;
-        uint32_t avg_join_delay;
-        uint32_t max_join_delay;
-
-        uint32_t min_leave_delay;
-        uint32_t avg_leave_delay;
-        uint32_t max_leave_delay;
-
-        /* This value counts all MC packets for old
-         * group received after first packet for new
-         * group received. */
-        uint32_t mc_old_rx_after_first_new;
-        uint32_t mc_rx;
-        uint32_t mc_loss; /* packet loss */
-        uint32_t mc_not_received;
-        uint32_t arp_rx;
-        uint32_t arp_tx;
-        uint32_t icmp_rx;
-        uint32_t icmp_tx;
-        uint32_t icmpv6_rx;
-        uint32_t icmpv6_tx;
-        uint32_t ipv4_fragmented_rx;
-
-        uint32_t dhcp_tx;
-        uint32_t dhcp_rx;
-        uint32_t dhcp_tx_discover;
-        uint32_t dhcp_rx_offer;
-        uint32_t dhcp_tx_request;
-        uint32_t dhcp_rx_ack;
-        uint32_t dhcp_rx_nak;
-        uint32_t dhcp_tx_release;
-
-        uint32_t dhcpv6_tx;
-        uint32_t dhcpv6_rx;
-        uint32_t dhcpv6_tx_solicit;
-        uint32_t dhcpv6_rx_advertise;
-        uint32_t dhcpv6_tx_request;
-        uint32_t dhcpv6_rx_reply;
-        uint32_t dhcpv6_tx_renew;
-        uint32_t dhcpv6_tx_release;
+    /* Position (starting with 1) in the session traffic
+     * generator of the access and network interface. */
+    uint32_t access_traffic_index[BBL_SESSION_TRAFFIC_MAX];
+    uint32_t network_traffic_index[BBL_SESSION_TRAFFIC_MAX];
+} bbl_session_s;
 
-        uint64_t access_ipv4_rx;
-        uint64_t access_ipv4_tx;
-        uint64_t access_ipv4_loss;
-        uint64_t network_ipv4_rx;
-        uint64_t network_ipv4_tx;
-        uint64_t network_ipv4_loss;
+/*
+ * All fields of bbl_session_s touched per packet
+ * are placed before BBL_SESSION_HOT_END, which must
+ * not exceed BBL_SESSION_HOT_LINES cache lines.
+ */
+#define BBL_SESSION_HOT_LINES 10
+#define BBL_SESSION_HOT_END offsetof(bbl_session_s, stats.igmp_rx)
 
-        uint64_t access_ipv6_rx;
-        uint64_t access_ipv6_tx;
-        uint64_t access_ipv6_loss;
-        uint64_t network_ipv6_rx;
-        uint64_t network_ipv6_tx;
-        uint64_t network_ipv6_loss;
+_Static_assert(BBL_SESSION_HOT_END <= BBL_SESSION_HOT_LINES * CACHE_LINE_SIZE,
+               "per packet fields of bbl_session_s exceed BBL_SESSION_HOT_LINES");
 
-        uint64_t access_ipv6pd_rx;
-        uint64_t access_ipv6pd_tx;
-        uint64_t access_ipv6pd_loss;
-        uint64_t network_ipv6pd_rx;
-        uint64_t network_ipv6pd_tx;
-        uint64_t network_ipv6pd_loss;
+/*
+ * Sessions are partitioned by session identifier
+ * into setup slices. Each slice owns its own idle and
+ * teardown queue and is served by the main loop in a
+ * dedicated time slice, such that session setup and
+ * teardown is spread equally over the second instead
+ * of being processed in one burst.
+ */
+typedef struct bbl_session_slice_
+{
+    CIRCLEQ_HEAD(session_slice_idle_, bbl_session_ ) idle_qhead;
+    CIRCLEQ_HEAD(session_slice_teardown_, bbl_session_ ) teardown_qhead;
+} bbl_session_slice_s;
 
-        uint32_t flapped; /* flap counter */
-    } stats;
+extern const uint32_t bbl_session_tx_class_mask[BBL_TX_CLASS_MAX];
 
-} bbl_session_s;
+#define BBL_SESSION_SLICE(_ctx, _session) \
+    (&(_ctx)->session_slices[((_session)->session_id - 1) % (_ctx)->config.session_slices])
 
 void
 bbl_session_tx_qnode_insert(struct bbl_session_ *session);
 
-void
-bbl_session_tx_qnode_remove(struct bbl_session_ *session);
+bbl_igmp_group_s *
+bbl_igmp_group_get(bbl_session_s *session, uint32_t address);
+
+bool
+bbl_igmp_group_index(bbl_ctx_s *ctx, bbl_session_s *session, bbl_igmp_group_s *group);
 
 void
-bbl_session_network_tx_qnode_insert(struct bbl_session_ *session);
+bbl_igmp_group_unindex(bbl_igmp_group_s *group);
 
 void
-bbl_session_network_tx_qnode_remove(struct bbl_session_ *session);
+bbl_session_tx_qnode_remove(struct bbl_session_ *session, bbl_tx_class_t class);
 
 const char *
 session_state_string(uint32_t state);
@@ -418,6 +478,9 @@ bbl_session_update_state(bbl_ctx_s *ctx, bbl_session_s *session, session_state_t
 void
 bbl_session_clear(bbl_ctx_s *ctx, bbl_session_s *session);
 
+bool
+bbl_session_slices_init(bbl_ctx_s *ctx);
+
 bool
 bbl_sessions_init(bbl_ctx_s *ctx);
 
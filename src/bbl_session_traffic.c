@@ -9,85 +9,238 @@
 
 #include "bbl.h"
 #include "bbl_session.h"
+#include "bbl_session_traffic.h"
 
 extern bool g_traffic;
 
-void
-bbl_session_traffic_ipv4(timer_s *timer)
+static uint32_t *
+bbl_session_traffic_index(bbl_interface_s *interface, bbl_session_s *session, bbl_session_traffic_t type)
 {
-    bbl_session_s *session = timer->data;
+    if(interface->type == INTERFACE_TYPE_ACCESS) {
+        return &session->access_traffic_index[type];
+    }
+    return &session->network_traffic_index[type];
+}
 
-    if(session->access_type == ACCESS_TYPE_PPPOE) {
-        if(session->session_state != BBL_ESTABLISHED ||
-            session->ipcp_state != BBL_PPP_OPENED) {
-            return;
-        }
-        if(session->l2tp && session->l2tp_session == NULL) {
-            return;
-        }
-    } else {
-        if(session->session_state != BBL_ESTABLISHED) {
-            return;
+/**
+ * bbl_session_traffic_gen_add
+ *
+ * Add session to the session traffic generator
+ * of the given interface and flow type.
+ *
+ * @param interface interface
+ * @param session session
+ * @param type flow type
+ * @return false if memory allocation failed
+ */
+static bool
+bbl_session_traffic_gen_add(bbl_interface_s *interface, bbl_session_s *session, bbl_session_traffic_t type)
+{
+    bbl_session_traffic_gen_s *gen = &interface->session_traffic[type];
+    uint32_t *index = bbl_session_traffic_index(interface, session, type);
+    bbl_session_s **list;
+    uint32_t size;
+
+    if(*index) {
+        /* Already added. */
+        return true;
+    }
+    if(gen->count == gen->size) {
+        size = gen->size ? gen->size * 2 : 1024;
+        list = realloc(gen->session, size * sizeof(bbl_session_s*));
+        if(!list) {
+            return false;
         }
+        gen->session = list;
+        gen->size = size;
     }
-    if(g_traffic && session->session_traffic) {
-        session->send_requests |= BBL_SEND_SESSION_IPV4;
-        bbl_session_tx_qnode_insert(session);
-        session->network_send_requests |= BBL_SEND_SESSION_IPV4;
-        bbl_session_network_tx_qnode_insert(session);
+    gen->session[gen->count++] = session;
+    *index = gen->count;
+    return true;
+}
+
+/**
+ * bbl_session_traffic_gen_remove
+ *
+ * Remove session from the session traffic generator
+ * of the given interface and flow type by moving the
+ * last session into the free position.
+ *
+ * @param interface interface
+ * @param session session
+ * @param type flow type
+ */
+static void
+bbl_session_traffic_gen_remove(bbl_interface_s *interface, bbl_session_s *session, bbl_session_traffic_t type)
+{
+    bbl_session_traffic_gen_s *gen = &interface->session_traffic[type];
+    uint32_t *index = bbl_session_traffic_index(interface, session, type);
+    bbl_session_s *last;
+
+    if(!*index) {
+        return;
+    }
+    last = gen->session[--gen->count];
+    if(last != session) {
+        gen->session[*index-1] = last;
+        *bbl_session_traffic_index(interface, last, type) = *index;
+    }
+    *index = 0;
+    if(gen->pending > gen->count) {
+        gen->pending = gen->count;
     }
 }
 
+/**
+ * bbl_session_traffic_stop
+ *
+ * Stop session traffic of the given flow type.
+ *
+ * @param session session
+ * @param type flow type
+ */
 void
-bbl_session_traffic_ipv6(timer_s *timer)
+bbl_session_traffic_stop(bbl_session_s *session, bbl_session_traffic_t type)
 {
-    bbl_session_s *session = timer->data;
+    if(session->interface) {
+        bbl_session_traffic_gen_remove(session->interface, session, type);
+    }
+    if(session->network_interface) {
+        bbl_session_traffic_gen_remove(session->network_interface, session, type);
+    }
+}
 
-    if(session->access_type == ACCESS_TYPE_PPPOE) {
-        if(session->session_state != BBL_ESTABLISHED ||
-            session->ip6cp_state != BBL_PPP_OPENED) {
-            return;
-        }
-    } else {
-        if(session->session_state != BBL_ESTABLISHED) {
-            return;
-        }
+/**
+ * bbl_session_traffic_ready
+ *
+ * @param session session
+ * @param type flow type
+ * @return true if session traffic of the given
+ * flow type can be sent
+ */
+bool
+bbl_session_traffic_ready(bbl_session_s *session, bbl_session_traffic_t type)
+{
+    if(!session->session_traffic || session->session_state != BBL_ESTABLISHED) {
+        return false;
+    }
+    switch(type) {
+        case BBL_SESSION_TRAFFIC_IPV4:
+            if(session->access_type == ACCESS_TYPE_PPPOE) {
+                if(session->ipcp_state != BBL_PPP_OPENED) {
+                    return false;
+                }
+                if(session->l2tp && session->l2tp_session == NULL) {
+                    return false;
+                }
+            }
+            return true;
+        case BBL_SESSION_TRAFFIC_IPV6:
+            if(session->access_type == ACCESS_TYPE_PPPOE &&
+               session->ip6cp_state != BBL_PPP_OPENED) {
+                return false;
+            }
+            return session->ipv6_prefix.len;
+        case BBL_SESSION_TRAFFIC_IPV6PD:
+            if(session->access_type == ACCESS_TYPE_PPPOE &&
+               session->ip6cp_state != BBL_PPP_OPENED) {
+                return false;
+            }
+            return session->delegated_ipv6_prefix.len;
+        default:
+            return false;
     }
-    if(g_traffic && session->session_traffic) {
-        if(session->ipv6_prefix.len) {
-            session->send_requests |= BBL_SEND_SESSION_IPV6;
-            session->network_send_requests |= BBL_SEND_SESSION_IPV6;
+}
+
+/**
+ * bbl_session_traffic_round
+ *
+ * Start a new session traffic round for the given
+ * flow type on all interfaces. Packets not sent
+ * in the previous round are not carried over but
+ * counted as dropped.
+ *
+ * @param ctx global context
+ * @param type flow type
+ */
+static void
+bbl_session_traffic_round(bbl_ctx_s *ctx, bbl_session_traffic_t type)
+{
+    bbl_interface_s *interface;
+    bbl_session_traffic_gen_s *gen;
+
+    CIRCLEQ_FOREACH(interface, &ctx->interface_qhead, interface_qnode) {
+        gen = &interface->session_traffic[type];
+        if(g_traffic) {
+            interface->stats.session_traffic_dropped += gen->pending;
+            gen->pending = gen->count;
+        } else {
+            gen->pending = 0;
         }
-        bbl_session_tx_qnode_insert(session);
-        bbl_session_network_tx_qnode_insert(session);
     }
 }
 
-void
-bbl_session_traffic_ipv6pd(timer_s *timer)
+static void
+bbl_session_traffic_ipv4_job(timer_s *timer)
 {
-    bbl_session_s *session = timer->data;
+    bbl_session_traffic_round(timer->data, BBL_SESSION_TRAFFIC_IPV4);
+}
 
-    if(session->access_type == ACCESS_TYPE_PPPOE) {
-        if(session->session_state != BBL_ESTABLISHED ||
-            session->ip6cp_state != BBL_PPP_OPENED) {
-            return;
-        }
-    } else {
-        if(session->session_state != BBL_ESTABLISHED) {
-            return;
-        }
+static void
+bbl_session_traffic_ipv6_job(timer_s *timer)
+{
+    bbl_session_traffic_round(timer->data, BBL_SESSION_TRAFFIC_IPV6);
+}
+
+static void
+bbl_session_traffic_ipv6pd_job(timer_s *timer)
+{
+    bbl_session_traffic_round(timer->data, BBL_SESSION_TRAFFIC_IPV6PD);
+}
+
+static void
+bbl_session_traffic_job_add(bbl_ctx_s *ctx, bbl_session_traffic_t type, char *name,
+                            uint16_t pps, void (*callback)(timer_s *))
+{
+    uint64_t tx_interval;
+
+    if(!pps) {
+        return;
     }
-    if(g_traffic && session->session_traffic) {
-        if(session->delegated_ipv6_prefix.len) {
-            session->send_requests |= BBL_SEND_SESSION_IPV6PD;
-            session->network_send_requests |= BBL_SEND_SESSION_IPV6PD;
+    if(pps > 1) {
+        tx_interval = 1000000000 / pps;
+        if(tx_interval < ctx->config.tx_interval) {
+            /* It is not possible to send faster than TX interval. */
+            tx_interval = ctx->config.tx_interval;
         }
-        bbl_session_tx_qnode_insert(session);
-        bbl_session_network_tx_qnode_insert(session);
+        timer_add_periodic(&ctx->timer_root, &ctx->session_traffic_timer[type], name,
+                           0, tx_interval, ctx, callback);
+    } else {
+        timer_add_periodic(&ctx->timer_root, &ctx->session_traffic_timer[type], name,
+                           1, 0, ctx, callback);
     }
 }
 
+/**
+ * bbl_session_traffic_init
+ *
+ * Setup one job per flow type which starts a new
+ * round of the interface session traffic generators
+ * with the configured rate.
+ *
+ * @param ctx global context
+ */
+void
+bbl_session_traffic_init(bbl_ctx_s *ctx)
+{
+    bbl_session_traffic_job_add(ctx, BBL_SESSION_TRAFFIC_IPV4, "Session Traffic IPv4",
+                                ctx->config.session_traffic_ipv4_pps, &bbl_session_traffic_ipv4_job);
+    bbl_session_traffic_job_add(ctx, BBL_SESSION_TRAFFIC_IPV6, "Session Traffic IPv6",
+                                ctx->config.session_traffic_ipv6_pps, &bbl_session_traffic_ipv6_job);
+    bbl_session_traffic_job_add(ctx, BBL_SESSION_TRAFFIC_IPV6PD, "Session Traffic IPv6 PD",
+                                ctx->config.session_traffic_ipv6pd_pps, &bbl_session_traffic_ipv6pd_job);
+}
+
 static bool
 bbl_session_traffic_add_ipv4_l2tp(bbl_ctx_s *ctx, bbl_session_s *session,
                                   struct bbl_interface_ *network_if)
@@ -105,10 +258,10 @@ bbl_session_traffic_add_ipv4_l2tp(bbl_ctx_s *ctx, bbl_session_s *session,
     bbl_l2tp_session_t *l2tp_session = session->l2tp_session;
     bbl_l2tp_tunnel_t *l2tp_tunnel = l2tp_session->tunnel;
 
-    if(!session->network_ipv4_tx_packet_template) {
-        session->network_ipv4_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+    if(!session->network_ipv4_tx_template.buf) {
+        session->network_ipv4_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
     }
-    buf = session->network_ipv4_tx_packet_template;
+    buf = session->network_ipv4_tx_template.buf;
 
     eth.dst = network_if->gateway_mac;
     eth.src = network_if->mac;
@@ -159,7 +312,7 @@ bbl_session_traffic_add_ipv4_l2tp(bbl_ctx_s *ctx, bbl_session_s *session,
     if(encode_ethernet(buf, &len, &eth) != PROTOCOL_SUCCESS) {
         return false;
     }
-    session->network_ipv4_tx_packet_len = len;
+    bbl_template_init(&session->network_ipv4_tx_template, buf, len, &bbl);
     return true;
 }
 
@@ -177,10 +330,10 @@ bbl_session_traffic_add_ipv4_a10nsp(bbl_ctx_s *ctx, bbl_session_s *session,
 
     bbl_a10nsp_session_t *a10nsp_session = session->a10nsp_session;
 
-    if(!session->network_ipv4_tx_packet_template) {
-        session->network_ipv4_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+    if(!session->network_ipv4_tx_template.buf) {
+        session->network_ipv4_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
     }
-    buf = session->network_ipv4_tx_packet_template;
+    buf = session->network_ipv4_tx_template.buf;
 
     eth.dst = session->client_mac;
     eth.src = a10nsp_if->mac;
@@ -224,7 +377,7 @@ bbl_session_traffic_add_ipv4_a10nsp(bbl_ctx_s *ctx, bbl_session_s *session,
     if(encode_ethernet(buf, &len, &eth) != PROTOCOL_SUCCESS) {
         return false;
     }
-    session->network_ipv4_tx_packet_len = len;
+    bbl_template_init(&session->network_ipv4_tx_template, buf, len, &bbl);
     return true;
 }
 
@@ -259,10 +412,10 @@ bbl_session_traffic_add_ipv4(bbl_ctx_s *ctx, bbl_session_s *session)
     bbl.inner_vlan_id = session->vlan_key.inner_vlan_id;
 
     /* Prepare Access (Session) to Network Packet */
-    if(!session->access_ipv4_tx_packet_template) {
-        session->access_ipv4_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+    if(!session->access_ipv4_tx_template.buf) {
+        session->access_ipv4_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
     }
-    buf = session->access_ipv4_tx_packet_template;
+    buf = session->access_ipv4_tx_template.buf;
 
     eth.dst = session->server_mac;
     eth.src = session->client_mac;
@@ -309,7 +462,7 @@ bbl_session_traffic_add_ipv4(bbl_ctx_s *ctx, bbl_session_s *session)
     if(encode_ethernet(buf, &len, &eth) != PROTOCOL_SUCCESS) {
         return false;
     }
-    session->access_ipv4_tx_packet_len = len;
+    bbl_template_init(&session->access_ipv4_tx_template, buf, len, &bbl);
 
     if(session->l2tp_session) {
         return bbl_session_traffic_add_ipv4_l2tp(ctx, session, network_if);
@@ -319,10 +472,10 @@ bbl_session_traffic_add_ipv4(bbl_ctx_s *ctx, bbl_session_s *session)
 
     /* Prepare Network to Access (Session) Packet */
     len = 0;
-    if(!session->network_ipv4_tx_packet_template) {
-        session->network_ipv4_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+    if(!session->network_ipv4_tx_template.buf) {
+        session->network_ipv4_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
     }
-    buf = session->network_ipv4_tx_packet_template;
+    buf = session->network_ipv4_tx_template.buf;
 
     eth.dst = network_if->gateway_mac;
     eth.src = network_if->mac;
@@ -345,7 +498,7 @@ bbl_session_traffic_add_ipv4(bbl_ctx_s *ctx, bbl_session_s *session)
     if(encode_ethernet(buf, &len, &eth) != PROTOCOL_SUCCESS) {
         return false;
     }
-    session->network_ipv4_tx_packet_len = len;
+    bbl_template_init(&session->network_ipv4_tx_template, buf, len, &bbl);
     return true;
 }
 
@@ -375,10 +528,10 @@ bbl_session_traffic_add_ipv6(bbl_ctx_s *ctx, bbl_session_s *session, bool ipv6_p
     /* Prepare Access (Session) to Network Packet */
     if(ipv6_pd) {
         bbl.sub_type = BBL_SUB_TYPE_IPV6PD;
-        if(!session->access_ipv6pd_tx_packet_template) {
-            session->access_ipv6pd_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+        if(!session->access_ipv6pd_tx_template.buf) {
+            session->access_ipv6pd_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
         }
-        buf = session->access_ipv6pd_tx_packet_template;
+        buf = session->access_ipv6pd_tx_template.buf;
         ip.src = session->delegated_ipv6_address;
         session->access_ipv6pd_tx_seq = 1;
         if(!session->access_ipv6pd_tx_flow_id) {
@@ -389,10 +542,10 @@ bbl_session_traffic_add_ipv6(bbl_ctx_s *ctx, bbl_session_s *session, bool ipv6_p
         bbl.flow_id = session->access_ipv6pd_tx_flow_id;
     } else {
         bbl.sub_type = BBL_SUB_TYPE_IPV6;
-        if(!session->access_ipv6_tx_packet_template) {
-            session->access_ipv6_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+        if(!session->access_ipv6_tx_template.buf) {
+            session->access_ipv6_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
         }
-        buf = session->access_ipv6_tx_packet_template;
+        buf = session->access_ipv6_tx_template.buf;
         ip.src = session->ipv6_address;
         session->access_ipv6_tx_seq = 1;
         if(!session->access_ipv6_tx_flow_id) {
@@ -434,18 +587,18 @@ bbl_session_traffic_add_ipv6(bbl_ctx_s *ctx, bbl_session_s *session, bool ipv6_p
         return false;
     }
     if(ipv6_pd) {
-        session->access_ipv6pd_tx_packet_len = len;
+        bbl_template_init(&session->access_ipv6pd_tx_template, buf, len, &bbl);
     } else {
-        session->access_ipv6_tx_packet_len = len;
+        bbl_template_init(&session->access_ipv6_tx_template, buf, len, &bbl);
     }
 
     /* Prepare Network to Access (Session) Packet */
     len = 0;
     if(ipv6_pd) {
-        if(!session->network_ipv6pd_tx_packet_template) {
-            session->network_ipv6pd_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+        if(!session->network_ipv6pd_tx_template.buf) {
+            session->network_ipv6pd_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
         }
-        buf = session->network_ipv6pd_tx_packet_template;
+        buf = session->network_ipv6pd_tx_template.buf;
         ip.dst = session->delegated_ipv6_address;
         session->network_ipv6pd_tx_seq = 1;
         if(!session->network_ipv6pd_tx_flow_id) {
@@ -455,10 +608,10 @@ bbl_session_traffic_add_ipv6(bbl_ctx_s *ctx, bbl_session_s *session, bool ipv6_p
         session->network_ipv6pd_tx_flow_id = ctx->flow_id++;
         bbl.flow_id = session->network_ipv6pd_tx_flow_id;
     } else {
-        if(!session->network_ipv6_tx_packet_template) {
-            session->network_ipv6_tx_packet_template = malloc(DATA_TRAFFIC_MAX_LEN);
+        if(!session->network_ipv6_tx_template.buf) {
+            session->network_ipv6_tx_template.buf = malloc(DATA_TRAFFIC_MAX_LEN);
         }
-        buf = session->network_ipv6_tx_packet_template;
+        buf = session->network_ipv6_tx_template.buf;
         ip.dst = session->ipv6_address;
         session->network_ipv6_tx_seq = 1;
         if(!session->network_ipv6_tx_flow_id) {
@@ -483,9 +636,24 @@ bbl_session_traffic_add_ipv6(bbl_ctx_s *ctx, bbl_session_s *session, bool ipv6_p
         return false;
     }
     if(ipv6_pd) {
-        session->network_ipv6pd_tx_packet_len = len;
+        bbl_template_init(&session->network_ipv6pd_tx_template, buf, len, &bbl);
     } else {
-        session->network_ipv6_tx_packet_len = len;
+        bbl_template_init(&session->network_ipv6_tx_template, buf, len, &bbl);
+    }
+    return true;
+}
+
+static bool
+bbl_session_traffic_start(bbl_session_s *session, bbl_session_traffic_t type)
+{
+    if(!bbl_session_traffic_gen_add(session->interface, session, type)) {
+        return false;
+    }
+    if(session->network_interface) {
+        if(!bbl_session_traffic_gen_add(session->network_interface, session, type)) {
+            bbl_session_traffic_stop(session, type);
+            return false;
+        }
     }
     return true;
 }
@@ -493,24 +661,11 @@ bbl_session_traffic_add_ipv6(bbl_ctx_s *ctx, bbl_session_s *session, bool ipv6_p
 bool
 bbl_session_traffic_start_ipv4(bbl_ctx_s *ctx, bbl_session_s *session) {
 
-    uint64_t tx_interval;
-
     if(ctx->config.session_traffic_ipv4_pps && session->ip_address &&
        (ctx->interfaces.network_if_count || session->a10nsp_session)) {
         /* Start IPv4 Session Traffic */
-        if(bbl_session_traffic_add_ipv4(ctx, session)) {
-            if(ctx->config.session_traffic_ipv4_pps > 1) {
-                tx_interval = 1000000000 / ctx->config.session_traffic_ipv4_pps;
-                if(tx_interval < ctx->config.tx_interval) {
-                    /* It is not possible to send faster than TX interval. */
-                    tx_interval = ctx->config.tx_interval;
-                }
-                timer_add_periodic(&ctx->timer_root, &session->timer_session_traffic_ipv4, "Session Traffic IPv4",
-                                   0, tx_interval, session, &bbl_session_traffic_ipv4);
-            } else {
-                timer_add_periodic(&ctx->timer_root, &session->timer_session_traffic_ipv4, "Session Traffic IPv4",
-                                   1, 0, session, &bbl_session_traffic_ipv4);
-            }
+        if(bbl_session_traffic_add_ipv4(ctx, session) &&
+           bbl_session_traffic_start(session, BBL_SESSION_TRAFFIC_IPV4)) {
             return true;
         } else {
             LOG(ERROR, "Traffic (ID: %u) failed to create IPv4 session traffic\n", session->session_id);
@@ -522,23 +677,10 @@ bbl_session_traffic_start_ipv4(bbl_ctx_s *ctx, bbl_session_s *session) {
 bool
 bbl_session_traffic_start_ipv6(bbl_ctx_s *ctx, bbl_session_s *session) {
 
-    uint64_t tx_interval;
-
     if(ctx->config.session_traffic_ipv6_pps && *(uint64_t*)session->ipv6_address && ctx->interfaces.network_if_count) {
         /* Start IPv6 Session Traffic */
-        if(bbl_session_traffic_add_ipv6(ctx, session, false)) {
-            if(ctx->config.session_traffic_ipv6_pps > 1) {
-                tx_interval = 1000000000 / ctx->config.session_traffic_ipv6_pps;
-                if(tx_interval < ctx->config.tx_interval) {
-                    /* It is not possible to send faster than TX interval. */
-                    tx_interval = ctx->config.tx_interval;
-                }
-                timer_add_periodic(&ctx->timer_root, &session->timer_session_traffic_ipv6, "Session Traffic IPv6",
-                                   0, tx_interval, session, &bbl_session_traffic_ipv6);
-            } else {
-                timer_add_periodic(&ctx->timer_root, &session->timer_session_traffic_ipv6, "Session Traffic IPv6",
-                                   1, 0, session, &bbl_session_traffic_ipv6);
-            }
+        if(bbl_session_traffic_add_ipv6(ctx, session, false) &&
+           bbl_session_traffic_start(session, BBL_SESSION_TRAFFIC_IPV6)) {
             return true;
         } else {
             LOG(ERROR, "Traffic (ID: %u) failed to create IPv6 session traffic\n", session->session_id);
@@ -550,27 +692,14 @@ bbl_session_traffic_start_ipv6(bbl_ctx_s *ctx, bbl_session_s *session) {
 bool
 bbl_session_traffic_start_ipv6pd(bbl_ctx_s *ctx, bbl_session_s *session) {
 
-    uint64_t tx_interval;
-
     if(ctx->config.session_traffic_ipv6pd_pps && *(uint64_t*)session->delegated_ipv6_address && ctx->interfaces.network_if_count) {
         /* Start IPv6 PD Session Traffic */
-        if(bbl_session_traffic_add_ipv6(ctx, session, true)) {
-            if(ctx->config.session_traffic_ipv6pd_pps > 1) {
-                tx_interval = 1000000000 / ctx->config.session_traffic_ipv6pd_pps;
-                if(tx_interval < ctx->config.tx_interval) {
-                    /* It is not possible to send faster than TX interval. */
-                    tx_interval = ctx->config.tx_interval;
-                }
-                timer_add_periodic(&ctx->timer_root, &session->timer_session_traffic_ipv6pd, "Session Traffic IPv6 PD",
-                                   0, tx_interval, session, &bbl_session_traffic_ipv6pd);
-            } else {
-                timer_add_periodic(&ctx->timer_root, &session->timer_session_traffic_ipv6pd, "Session Traffic IPv6 PD",
-                                   1, 0, session, &bbl_session_traffic_ipv6pd);
-            }
+        if(bbl_session_traffic_add_ipv6(ctx, session, true) &&
+           bbl_session_traffic_start(session, BBL_SESSION_TRAFFIC_IPV6PD)) {
             return true;
         } else {
             LOG(ERROR, "Traffic (ID: %u) failed to create IPv6 PD session traffic\n", session->session_id);
         }
     }
     return false;
-}
\ No newline at end of file
+}
@@ -10,6 +10,15 @@
 #ifndef __BBL_SESSION_TRAFFIC_H__
 #define __BBL_SESSION_TRAFFIC_H__
 
+void
+bbl_session_traffic_init(bbl_ctx_s *ctx);
+
+bool
+bbl_session_traffic_ready(bbl_session_s *session, bbl_session_traffic_t type);
+
+void
+bbl_session_traffic_stop(bbl_session_s *session, bbl_session_traffic_t type);
+
 bool
 bbl_session_traffic_start_ipv4(bbl_ctx_s *ctx, bbl_session_s *session);
 
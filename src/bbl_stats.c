@@ -12,6 +12,7 @@
 #include "bbl_stats.h"
 #include "bbl_session.h"
 #include "bbl_stream.h"
+#include "bbl_throughput.h"
 
 extern const char banner[];
 
@@ -245,6 +246,16 @@ bbl_stats_generate (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                 stats->min_stream_loss = stream->loss;
             }
             if(stream->loss > stats->max_stream_loss) stats->max_stream_loss = stream->loss;
+            stats->stream_reordered += stream->rx_reordered;
+            stats->stream_duplicate += stream->rx_duplicate;
+            stats->stream_late += stream->rx_late;
+            stats->stream_payload_errors += stream->payload_errors;
+            stats->stream_tx_deficit += STREAM_COUNTER_GET(stream->tx_deficit);
+            stats->stream_tx_capped += STREAM_COUNTER_GET(stream->tx_capped);
+            if(STREAM_COUNTER_GET(stream->tx_lag_max_ns) > stats->max_stream_tx_lag_ns) {
+                stats->max_stream_tx_lag_ns = STREAM_COUNTER_GET(stream->tx_lag_max_ns);
+            }
+            if(stream->tx_lag_warning) stats->stream_tx_lagging++;
 
             if(stream->rx_first_seq) {
                 if(stats->min_stream_rx_first_seq) {
@@ -255,16 +266,36 @@ bbl_stats_generate (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                 if(stream->rx_first_seq > stats->max_stream_rx_first_seq) stats->max_stream_rx_first_seq = stream->rx_first_seq;
 
                 if(stats->min_stream_delay_ns) {
-                    if(stream->min_delay_ns < stats->min_stream_delay_ns) stats->min_stream_delay_ns = stream->min_delay_ns;
+                    if(stream->rx_delay.min_ns < stats->min_stream_delay_ns) stats->min_stream_delay_ns = stream->rx_delay.min_ns;
                 } else {
-                    stats->min_stream_delay_ns = stream->min_delay_ns;
+                    stats->min_stream_delay_ns = stream->rx_delay.min_ns;
                 }
-                if(stream->max_delay_ns > stats->max_stream_delay_ns) stats->max_stream_delay_ns = stream->max_delay_ns;
+                if(stream->rx_delay.max_ns > stats->max_stream_delay_ns) stats->max_stream_delay_ns = stream->rx_delay.max_ns;
+            }
+            if(stream->direction == STREAM_DIRECTION_UP) {
+                bbl_delay_stats_add(&stats->stream_delay_up, &stream->rx_delay);
+            } else {
+                bbl_delay_stats_add(&stats->stream_delay_down, &stream->rx_delay);
             }
         }
     }
 }
 
+static void
+bbl_stats_stdout_delay(const char *direction, bbl_delay_stats_s *delay) {
+    if(!delay->packets) {
+        return;
+    }
+    printf("  %-10s Delay (msec)         AVG: %8.3f P50: %8.3f P99: %8.3f P99.9: %8.3f\n", direction,
+           (double)(delay->sum_ns / delay->packets) / (double)MSEC,
+           (double)bbl_delay_stats_percentile(delay, 50.0) / (double)MSEC,
+           (double)bbl_delay_stats_percentile(delay, 99.0) / (double)MSEC,
+           (double)bbl_delay_stats_percentile(delay, 99.9) / (double)MSEC);
+    printf("  %-10s Jitter (msec)        AVG: %8.3f MAX: %8.3f\n", direction,
+           (double)(delay->jitter_sum_ns / delay->flows) / (double)MSEC,
+           (double)delay->jitter_max_ns / (double)MSEC);
+}
+
 void
 bbl_stats_stdout (bbl_ctx_s *ctx, bbl_stats_t * stats) {
     struct bbl_interface_ *interface;
@@ -318,6 +349,8 @@ bbl_stats_stdout (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                     interface->stats.session_ipv6_rx, interface->stats.session_ipv6_loss);
                 printf("  TX Session IPv6PD: %10lu packets\n",
                     interface->stats.session_ipv6pd_tx);
+                printf("  TX Session Drop:   %10lu packets\n",
+                    interface->stats.session_traffic_dropped);
                 printf("  RX Session IPv6PD: %10lu packets (%lu loss)\n",
                     interface->stats.session_ipv6pd_rx, interface->stats.session_ipv6pd_loss);
             }
@@ -349,6 +382,7 @@ bbl_stats_stdout (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                 printf("  RX Session IPv6:   %10lu packets (%lu loss, %lu wrong session)\n", interface->stats.session_ipv6_rx,
                     interface->stats.session_ipv6_loss, interface->stats.session_ipv6_wrong_session);
                 printf("  TX Session IPv6PD: %10lu packets\n", interface->stats.session_ipv6pd_tx);
+                printf("  TX Session Drop:   %10lu packets\n", interface->stats.session_traffic_dropped);
                 printf("  RX Session IPv6PD: %10lu packets (%lu loss, %lu wrong session)\n", interface->stats.session_ipv6pd_rx,
                     interface->stats.session_ipv6pd_loss, interface->stats.session_ipv6pd_wrong_session);
             }
@@ -409,6 +443,8 @@ bbl_stats_stdout (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                     interface->stats.session_ipv6_rx, interface->stats.session_ipv6_loss);
                 printf("  TX Session IPv6PD: %10lu packets\n",
                     interface->stats.session_ipv6pd_tx);
+                printf("  TX Session Drop:   %10lu packets\n",
+                    interface->stats.session_traffic_dropped);
                 printf("  RX Session IPv6PD: %10lu packets (%lu loss)\n",
                     interface->stats.session_ipv6pd_rx, interface->stats.session_ipv6pd_loss);
 
@@ -474,11 +510,27 @@ bbl_stats_stdout (bbl_ctx_s *ctx, bbl_stats_t * stats) {
         printf("  Flow Receive Packet Loss        MIN: %8lu MAX: %8lu\n",
             stats->min_stream_loss,
             stats->max_stream_loss);
+        printf("  Flow Receive Reordered: %lu Duplicate: %lu Late: %lu\n",
+            stats->stream_reordered,
+            stats->stream_duplicate,
+            stats->stream_late);
+        printf("  Flow Receive Payload Errors: %lu\n", stats->stream_payload_errors);
+        printf("  Flow Transmit Deficit: %lu Capped Windows: %lu Max Lag (msec): %.3f\n",
+               stats->stream_tx_deficit,
+               stats->stream_tx_capped,
+               (double)stats->max_stream_tx_lag_ns / (double)MSEC);
+        if(stats->stream_tx_lagging) {
+            printf("  Warning: %u flows behind schedule, the configured rate was not sent!\n", stats->stream_tx_lagging);
+        }
         printf("  Flow Receive Delay (msec)       MIN: %8.3f MAX: %8.3f\n",
                (double)stats->min_stream_delay_ns / (double)MSEC,
                (double)stats->max_stream_delay_ns / (double)MSEC);
+        bbl_stats_stdout_delay("Upstream", &stats->stream_delay_up);
+        bbl_stats_stdout_delay("Downstream", &stats->stream_delay_down);
     }
 
+    bbl_throughput_stdout(ctx);
+
     if(ctx->config.igmp_group_count > 1) {
         printf("\nIGMP Config:\n");
         printf("  Version: %d\n", ctx->config.igmp_version);
@@ -504,6 +556,71 @@ bbl_stats_stdout (bbl_ctx_s *ctx, bbl_stats_t * stats) {
     }
 }
 
+typedef struct bbl_stats_stream_group_ {
+    uint16_t stream_group_id;
+    bbl_stream_direction_t direction;
+    bbl_delay_stats_s delay;
+} bbl_stats_stream_group_s;
+
+/*
+ * Aggregate stream delay statistics per stream group and direction.
+ */
+static json_t *
+bbl_stats_stream_groups_json(bbl_ctx_s *ctx) {
+    bbl_stats_stream_group_s *groups = NULL;
+    bbl_stats_stream_group_s *group;
+    uint32_t count = 0;
+    uint32_t size = 0;
+    uint32_t i;
+
+    bbl_stream *stream;
+    struct dict_itor *itor;
+
+    json_t *jobj_array;
+    json_t *jobj_sub;
+
+    itor = dict_itor_new(ctx->stream_flow_dict);
+    dict_itor_first(itor);
+    for (; dict_itor_valid(itor); dict_itor_next(itor)) {
+        stream = (bbl_stream*)*dict_itor_datum(itor);
+        if(!stream) continue;
+        group = NULL;
+        for(i = 0; i < count; i++) {
+            if(groups[i].stream_group_id == stream->config->stream_group_id &&
+               groups[i].direction == stream->direction) {
+                group = &groups[i];
+                break;
+            }
+        }
+        if(!group) {
+            if(count == size) {
+                size = size ? size * 2 : 16;
+                group = realloc(groups, size * sizeof(bbl_stats_stream_group_s));
+                if(!group) break;
+                groups = group;
+            }
+            group = &groups[count++];
+            memset(group, 0x0, sizeof(bbl_stats_stream_group_s));
+            group->stream_group_id = stream->config->stream_group_id;
+            group->direction = stream->direction;
+        }
+        bbl_delay_stats_add(&group->delay, &stream->rx_delay);
+    }
+    dict_itor_free(itor);
+
+    jobj_array = json_array();
+    for(i = 0; i < count; i++) {
+        jobj_sub = bbl_delay_stats_json(&groups[i].delay);
+        if(jobj_sub) {
+            json_object_set(jobj_sub, "stream-group-id", json_integer(groups[i].stream_group_id));
+            json_object_set(jobj_sub, "direction", json_string(groups[i].direction == STREAM_DIRECTION_UP ? "upstream" : "downstream"));
+            json_array_append(jobj_array, jobj_sub);
+        }
+    }
+    if(groups) free(groups);
+    return jobj_array;
+}
+
 void
 bbl_stats_json (bbl_ctx_s *ctx, bbl_stats_t * stats) {
     struct bbl_interface_ *interface;
@@ -583,6 +700,7 @@ bbl_stats_json (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                 json_object_set(jobj_sub, "rx-session-packets-ipv6pd-loss", json_integer(interface->stats.session_ipv6pd_loss));
                 json_object_set(jobj_sub, "tx-session-packets-avg-pps-max-ipv6pd", json_integer(interface->stats.rate_session_ipv6pd_tx.avg_max));
                 json_object_set(jobj_sub, "rx-session-packets-avg-pps-max-ipv6pd", json_integer(interface->stats.rate_session_ipv6pd_rx.avg_max));
+                json_object_set(jobj_sub, "tx-session-packets-dropped", json_integer(interface->stats.session_traffic_dropped));
             }
             json_object_set(jobj_sub, "tx-multicast-packets", json_integer(interface->stats.mc_tx));
             json_array_append(jobj_array, jobj_sub);
@@ -617,6 +735,7 @@ bbl_stats_json (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                 json_object_set(jobj_sub, "rx-session-packets-ipv6pd-wrong-session", json_integer(interface->stats.session_ipv6pd_wrong_session));
                 json_object_set(jobj_sub, "tx-session-packets-avg-pps-max-ipv6pd", json_integer(interface->stats.rate_session_ipv6pd_tx.avg_max));
                 json_object_set(jobj_sub, "rx-session-packets-avg-pps-max-ipv6pd", json_integer(interface->stats.rate_session_ipv6pd_rx.avg_max));
+                json_object_set(jobj_sub, "tx-session-packets-dropped", json_integer(interface->stats.session_traffic_dropped));
             }
             json_object_set(jobj_sub, "rx-multicast-packets", json_integer(interface->stats.mc_rx));
             json_object_set(jobj_sub, "rx-multicast-packets-loss", json_integer(interface->stats.mc_loss));
@@ -689,6 +808,7 @@ bbl_stats_json (bbl_ctx_s *ctx, bbl_stats_t * stats) {
                 json_object_set(jobj_sub, "rx-session-packets-ipv6pd-loss", json_integer(interface->stats.session_ipv6pd_loss));
                 json_object_set(jobj_sub, "tx-session-packets-avg-pps-max-ipv6pd", json_integer(interface->stats.rate_session_ipv6pd_tx.avg_max));
                 json_object_set(jobj_sub, "rx-session-packets-avg-pps-max-ipv6pd", json_integer(interface->stats.rate_session_ipv6pd_rx.avg_max));
+                json_object_set(jobj_sub, "tx-session-packets-dropped", json_integer(interface->stats.session_traffic_dropped));
             }
             json_array_append(jobj_array, jobj_sub);
         }
@@ -755,8 +875,22 @@ bbl_stats_json (bbl_ctx_s *ctx, bbl_stats_t * stats) {
         json_object_set(jobj_sub, "first-seq-rx-max", json_integer(stats->max_stream_rx_first_seq));
         json_object_set(jobj_sub, "flow-rx-packet-loss-min", json_integer(stats->min_stream_loss));
         json_object_set(jobj_sub, "flow-rx-packet-loss-max", json_integer(stats->max_stream_loss));
+        json_object_set(jobj_sub, "flow-rx-reordered", json_integer(stats->stream_reordered));
+        json_object_set(jobj_sub, "flow-rx-duplicate", json_integer(stats->stream_duplicate));
+        json_object_set(jobj_sub, "flow-rx-late", json_integer(stats->stream_late));
+        json_object_set(jobj_sub, "flow-rx-payload-errors", json_integer(stats->stream_payload_errors));
+        json_object_set(jobj_sub, "flow-tx-deficit", json_integer(stats->stream_tx_deficit));
+        json_object_set(jobj_sub, "flow-tx-capped", json_integer(stats->stream_tx_capped));
+        json_object_set(jobj_sub, "flow-tx-lag-nsec-max", json_integer(stats->max_stream_tx_lag_ns));
+        json_object_set(jobj_sub, "flow-tx-lagging", json_integer(stats->stream_tx_lagging));
         json_object_set(jobj_sub, "flow-rx-delay-min", json_integer(stats->min_stream_delay_ns));
         json_object_set(jobj_sub, "flow-rx-delay-max", json_integer(stats->max_stream_delay_ns));
+        json_object_set(jobj_sub, "upstream", bbl_delay_stats_json(&stats->stream_delay_up));
+        json_object_set(jobj_sub, "downstream", bbl_delay_stats_json(&stats->stream_delay_down));
+        json_object_set(jobj_sub, "stream-groups", bbl_stats_stream_groups_json(ctx));
+        if(ctx->stream_thread) {
+            json_object_set(jobj_sub, "threads", bbl_stream_thread_json(ctx));
+        }
         json_object_set(jobj, "traffic-streams", jobj_sub);
     }
 
@@ -813,6 +947,9 @@ bbl_stats_json (bbl_ctx_s *ctx, bbl_stats_t * stats) {
         json_object_set(jobj, "streams", jobj_array);
     }
 
+    if(ctx->throughput) {
+        json_object_set(jobj, "throughput-search", bbl_throughput_json(ctx));
+    }
 
     json_object_set(root, "report", jobj);
     if(json_dump_file(root, ctx->config.json_report_filename, JSON_REAL_PRECISION(4)) != 0) {
@@ -843,10 +980,12 @@ bbl_compute_avg_rate (bbl_rate_s *rate, uint64_t current_value)
             div++;
         }
     }
+    /* The average rate of threaded streams is
+     * read by the main thread with atomic loads. */
     if (div) {
-	    rate->avg = sum / div;
+	    __atomic_store_n(&rate->avg, sum / div, __ATOMIC_RELAXED);
     } else {
-	    rate->avg = 0;
+	    __atomic_store_n(&rate->avg, 0, __ATOMIC_RELAXED);
     }
     if(rate->avg > rate->avg_max) {
         rate->avg_max = rate->avg;
@@ -883,4 +1022,230 @@ bbl_compute_interface_rate_job (timer_s *timer)
         bbl_compute_avg_rate(&interface->stats.rate_l2tp_data_tx, interface->stats.l2tp_data_tx);
         bbl_compute_avg_rate(&interface->stats.rate_li_rx, interface->stats.li_rx);
     }
-}
\ No newline at end of file
+}
+
+/**
+ * bbl_rate_sweep_add
+ *
+ * Add rate/counter pair to rate sweep.
+ *
+ * @param sweep rate sweep
+ * @param rate rate to be computed
+ * @param value counter
+ * @return false if memory allocation failed
+ */
+bool
+bbl_rate_sweep_add(bbl_rate_sweep_s *sweep, bbl_rate_s *rate, uint64_t *value)
+{
+    bbl_rate_sweep_entry_s *entry;
+    uint32_t size;
+
+    if(sweep->count == sweep->size) {
+        size = sweep->size ? sweep->size * 2 : 1024;
+        entry = realloc(sweep->entry, size * sizeof(bbl_rate_sweep_entry_s));
+        if(!entry) {
+            return false;
+        }
+        sweep->entry = entry;
+        sweep->size = size;
+    }
+    entry = &sweep->entry[sweep->count++];
+    entry->rate = rate;
+    entry->value = value;
+    return true;
+}
+
+static void
+bbl_rate_sweep_job(timer_s *timer)
+{
+    bbl_rate_sweep_s *sweep = timer->data;
+    bbl_rate_sweep_entry_s *entry;
+    uint32_t start;
+    uint32_t end;
+
+    start = ((uint64_t)sweep->count * sweep->slice) / sweep->slices;
+    end = ((uint64_t)sweep->count * (sweep->slice + 1)) / sweep->slices;
+    for(entry = &sweep->entry[start]; entry < &sweep->entry[end]; entry++) {
+        bbl_compute_avg_rate(entry->rate, *entry->value);
+    }
+    sweep->slice = (sweep->slice + 1) % sweep->slices;
+}
+
+/**
+ * bbl_rate_sweep_start
+ *
+ * Start periodic rate sweep job.
+ *
+ * @param timer_root timer root
+ * @param sweep rate sweep
+ * @param slices number of slices per second
+ */
+void
+bbl_rate_sweep_start(timer_root_s *timer_root, bbl_rate_sweep_s *sweep, uint16_t slices)
+{
+    if(sweep->timer) {
+        return;
+    }
+    if(slices > 1) {
+        sweep->slices = slices;
+        timer_add_periodic(timer_root, &sweep->timer, "Rate Computation", 0,
+                           SEC / slices, sweep, &bbl_rate_sweep_job);
+    } else {
+        sweep->slices = 1;
+        timer_add_periodic(timer_root, &sweep->timer, "Rate Computation", 1, 0,
+                           sweep, &bbl_rate_sweep_job);
+    }
+}
+
+/**
+ * bbl_delay_add
+ *
+ * Account delay of a received packet. This is called
+ * for every received stream packet and therefore limited
+ * to a few instructions.
+ *
+ * @param delay delay statistics of flow
+ * @param delay_ns packet delay in nanoseconds
+ */
+void
+bbl_delay_add(bbl_delay_s *delay, uint64_t delay_ns)
+{
+    uint64_t value = delay_ns >> BBL_DELAY_SHIFT;
+    uint64_t diff;
+    uint32_t shift;
+    uint32_t idx;
+
+    if(delay->packets) {
+        if(delay_ns < delay->min_ns) delay->min_ns = delay_ns;
+        if(delay_ns > delay->max_ns) delay->max_ns = delay_ns;
+        /* RFC 3550 interarrival jitter J += (|D| - J) / 16 */
+        diff = delay_ns > delay->last_ns ? delay_ns - delay->last_ns : delay->last_ns - delay_ns;
+        delay->jitter += diff - ((delay->jitter + 8) >> 4);
+    } else {
+        delay->min_ns = delay_ns;
+        delay->max_ns = delay_ns;
+    }
+    delay->packets++;
+    delay->sum_ns += delay_ns;
+    delay->last_ns = delay_ns;
+
+    if(value < BBL_DELAY_SUB_BUCKETS) {
+        idx = value;
+    } else {
+        if(value >= (1ULL << BBL_DELAY_MAX_BITS)) {
+            value = (1ULL << BBL_DELAY_MAX_BITS) - 1;
+        }
+        shift = 63 - __builtin_clzll(value) - BBL_DELAY_SUB_BITS;
+        idx = ((shift + 1) << BBL_DELAY_SUB_BITS) | ((value >> shift) & (BBL_DELAY_SUB_BUCKETS - 1));
+    }
+    /* Buckets are kept compact as there is one histogram
+     * per flow and saturate instead of wrapping around. */
+    if(delay->hist[idx] < UINT32_MAX) {
+        delay->hist[idx]++;
+    }
+}
+
+/*
+ * Return the largest delay in nanoseconds covered by histogram bucket.
+ */
+static uint64_t
+bbl_delay_bucket_max(uint32_t idx)
+{
+    uint32_t shift;
+    uint64_t lower;
+
+    if(idx < BBL_DELAY_SUB_BUCKETS) {
+        return ((uint64_t)(idx + 1) << BBL_DELAY_SHIFT) - 1;
+    }
+    shift = (idx >> BBL_DELAY_SUB_BITS) - 1;
+    lower = (uint64_t)(BBL_DELAY_SUB_BUCKETS | (idx & (BBL_DELAY_SUB_BUCKETS - 1))) << shift;
+    return ((lower + (1ULL << shift)) << BBL_DELAY_SHIFT) - 1;
+}
+
+/**
+ * bbl_delay_stats_add
+ *
+ * Add delay statistics of a flow to aggregated statistics.
+ *
+ * @param stats aggregated delay statistics
+ * @param delay delay statistics of flow
+ */
+void
+bbl_delay_stats_add(bbl_delay_stats_s *stats, bbl_delay_s *delay)
+{
+    uint64_t jitter_ns;
+    int i;
+
+    if(!delay->packets) {
+        return;
+    }
+    if(stats->packets) {
+        if(delay->min_ns < stats->min_ns) stats->min_ns = delay->min_ns;
+        if(delay->max_ns > stats->max_ns) stats->max_ns = delay->max_ns;
+    } else {
+        stats->min_ns = delay->min_ns;
+        stats->max_ns = delay->max_ns;
+    }
+    jitter_ns = delay->jitter >> 4;
+    if(jitter_ns > stats->jitter_max_ns) stats->jitter_max_ns = jitter_ns;
+    stats->jitter_sum_ns += jitter_ns;
+    stats->flows++;
+    stats->packets += delay->packets;
+    stats->sum_ns += delay->sum_ns;
+    for(i = 0; i < BBL_DELAY_BUCKETS; i++) {
+        stats->hist[i] += delay->hist[i];
+    }
+}
+
+/**
+ * bbl_delay_stats_percentile
+ *
+ * @param stats aggregated delay statistics
+ * @param percentile percentile (0 - 100)
+ * @return upper bound of delay percentile in nanoseconds
+ */
+uint64_t
+bbl_delay_stats_percentile(bbl_delay_stats_s *stats, double percentile)
+{
+    double target;
+    uint64_t packets = 0;
+    uint64_t value;
+    int i;
+
+    if(!stats->packets) {
+        return 0;
+    }
+    /* The sum of all buckets is used as reference, which
+     * is less than packets if a flow bucket saturated. */
+    for(i = 0; i < BBL_DELAY_BUCKETS; i++) {
+        packets += stats->hist[i];
+    }
+    target = packets * percentile / 100.0;
+    packets = 0;
+    for(i = 0; i < BBL_DELAY_BUCKETS; i++) {
+        packets += stats->hist[i];
+        if(packets && packets >= target) {
+            value = bbl_delay_bucket_max(i);
+            if(value > stats->max_ns) value = stats->max_ns;
+            if(value < stats->min_ns) value = stats->min_ns;
+            return value;
+        }
+    }
+    return stats->max_ns;
+}
+
+json_t *
+bbl_delay_stats_json(bbl_delay_stats_s *stats)
+{
+    return json_pack("{si si si si si si si si si si}",
+        "flows", stats->flows,
+        "packets", stats->packets,
+        "delay-nsec-min", stats->min_ns,
+        "delay-nsec-avg", stats->packets ? stats->sum_ns / stats->packets : 0,
+        "delay-nsec-max", stats->max_ns,
+        "delay-nsec-p50", bbl_delay_stats_percentile(stats, 50.0),
+        "delay-nsec-p99", bbl_delay_stats_percentile(stats, 99.0),
+        "delay-nsec-p999", bbl_delay_stats_percentile(stats, 99.9),
+        "jitter-nsec-avg", stats->flows ? stats->jitter_sum_ns / stats->flows : 0,
+        "jitter-nsec-max", stats->jitter_max_ns);
+}
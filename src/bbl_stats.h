@@ -20,6 +20,68 @@ typedef struct bbl_rate_
     uint64_t avg_max;
 } bbl_rate_s;
 
+/*
+ * Rate sweep
+ *
+ * Dense array of rate/counter pairs computed by one
+ * periodic job per timer root. The array can be split
+ * into slices which are computed one after another,
+ * such that all entries are computed once per second.
+ */
+typedef struct bbl_rate_sweep_entry_
+{
+    bbl_rate_s *rate;
+    uint64_t *value;
+} bbl_rate_sweep_entry_s;
+
+typedef struct bbl_rate_sweep_
+{
+    bbl_rate_sweep_entry_s *entry;
+    uint32_t count;
+    uint32_t size;
+    uint16_t slices;
+    uint16_t slice; /* next slice to be computed */
+    struct timer_ *timer;
+} bbl_rate_sweep_s;
+
+/*
+ * Delay histogram
+ *
+ * Log-linear histogram with BBL_DELAY_SUB_BUCKETS linear
+ * buckets per power of two, giving a relative error below
+ * 12.5% with a resolution of 1024 nsec for delays up
+ * to ~68 seconds (larger delays are clamped).
+ */
+#define BBL_DELAY_SHIFT         10
+#define BBL_DELAY_SUB_BITS      3
+#define BBL_DELAY_SUB_BUCKETS   (1 << BBL_DELAY_SUB_BITS)
+#define BBL_DELAY_MAX_BITS      26
+#define BBL_DELAY_BUCKETS       ((BBL_DELAY_MAX_BITS - BBL_DELAY_SUB_BITS + 1) << BBL_DELAY_SUB_BITS)
+
+typedef struct bbl_delay_
+{
+    uint64_t packets;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t sum_ns;
+    uint64_t last_ns;
+    uint64_t jitter; /* RFC 3550 interarrival jitter in nsec scaled by 16 */
+    uint32_t hist[BBL_DELAY_BUCKETS]; /* saturating at UINT32_MAX */
+} bbl_delay_s;
+
+/* Delay statistics aggregated over multiple flows. */
+typedef struct bbl_delay_stats_
+{
+    uint32_t flows;
+    uint64_t packets;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t sum_ns;
+    uint64_t jitter_sum_ns;
+    uint64_t jitter_max_ns;
+    uint64_t hist[BBL_DELAY_BUCKETS];
+} bbl_delay_stats_s;
+
 typedef struct bbl_stats_ {
     uint32_t min_join_delay; /* IGMP join delay */
     uint32_t avg_join_delay; /* IGMP join delay */
@@ -89,10 +151,20 @@ typedef struct bbl_stats_ {
 
     uint64_t min_stream_loss;
     uint64_t max_stream_loss;
+    uint64_t stream_reordered;
+    uint64_t stream_duplicate;
+    uint64_t stream_late;
+    uint64_t stream_payload_errors;
+    uint64_t stream_tx_deficit; /* packets behind schedule at end of test */
+    uint64_t stream_tx_capped;
+    uint64_t max_stream_tx_lag_ns;
+    uint32_t stream_tx_lagging; /* streams with lag warning */
     uint64_t min_stream_rx_first_seq;
     uint64_t max_stream_rx_first_seq;
     uint64_t min_stream_delay_ns;
     uint64_t max_stream_delay_ns;
+    bbl_delay_stats_s stream_delay_up;
+    bbl_delay_stats_s stream_delay_down;
 } bbl_stats_t;
 
 void bbl_compute_avg_rate (bbl_rate_s *rate, uint64_t current_value);
@@ -101,5 +173,11 @@ void bbl_stats_generate(bbl_ctx_s *ctx, bbl_stats_t *stats);
 void bbl_stats_stdout(bbl_ctx_s *ctx, bbl_stats_t *stats);
 void bbl_stats_json(bbl_ctx_s *ctx, bbl_stats_t *stats);
 void bbl_compute_interface_rate_job(timer_s *timer);
+bool bbl_rate_sweep_add(bbl_rate_sweep_s *sweep, bbl_rate_s *rate, uint64_t *value);
+void bbl_rate_sweep_start(timer_root_s *timer_root, bbl_rate_sweep_s *sweep, uint16_t slices);
+void bbl_delay_add(bbl_delay_s *delay, uint64_t delay_ns);
+void bbl_delay_stats_add(bbl_delay_stats_s *stats, bbl_delay_s *delay);
+uint64_t bbl_delay_stats_percentile(bbl_delay_stats_s *stats, double percentile);
+json_t *bbl_delay_stats_json(bbl_delay_stats_s *stats);
 
 #endif
@@ -7,6 +7,8 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#define _GNU_SOURCE /* sendmmsg */
+
 #include "bbl.h"
 #include "bbl_session.h"
 #include "bbl_stream.h"
@@ -17,6 +19,43 @@ extern volatile bool g_teardown;
 extern bool g_init_phase;
 extern bool g_traffic;
 
+static void
+bbl_stream_free_packet(bbl_stream *stream) {
+    uint8_t i;
+
+    if(stream->imix_template) {
+        for(i = 0; i < stream->config->imix_count; i++) {
+            if(stream->imix_template[i].buf) {
+                free(stream->imix_template[i].buf);
+            }
+        }
+        free(stream->imix_template);
+        stream->imix_template = NULL;
+    } else if(stream->buf) {
+        free(stream->buf);
+    }
+    stream->buf = NULL;
+    stream->tx_len = 0;
+}
+
+/**
+ * bbl_stream_tx_interval
+ *
+ * Return the stream timer interval in nsec, which is the
+ * interval between packets or between bursts of packets.
+ *
+ * @param config stream config
+ * @param pps stream rate
+ * @return interval in nsec
+ */
+static uint64_t
+bbl_stream_tx_interval(bbl_stream_config *config, double pps) {
+    if(config->burst_size) {
+        return (double)SEC * config->burst_size / pps;
+    }
+    return SEC / pps;
+}
+
 static bool
 bbl_stream_can_send(bbl_stream *stream) {
     bbl_session_s *session = stream->session;
@@ -85,12 +124,12 @@ bbl_stream_can_send(bbl_stream *stream) {
     }
 FREE:
     /* Free of packet if not ready to send */
-    if(stream->buf) {
-        free(stream->buf);
-        stream->buf = NULL;
-        stream->tx_len = 0;
+    bbl_stream_free_packet(stream);
+    if(!stream->thread.thread) {
+        /* The send window of threaded streams
+         * is reset by the stream thread. */
+        stream->send_window_packets = 0;
     }
-    stream->send_window_packets = 0;
     return false;
 }
 
@@ -148,6 +187,8 @@ bbl_stream_build_access_pppoe_packet(bbl_stream *stream) {
     bbl.outer_vlan_id = session->vlan_key.outer_vlan_id;
     bbl.inner_vlan_id = session->vlan_key.inner_vlan_id;
     bbl.flow_id = stream->flow_id;
+    bbl.padding_pattern = config->payload_pattern;
+    bbl.padding_seed = stream->flow_id;
     bbl.tos = config->priority;
     bbl.direction = BBL_DIRECTION_UP;
 
@@ -176,8 +217,8 @@ bbl_stream_build_access_pppoe_packet(bbl_stream *stream) {
             ipv4.protocol = PROTOCOL_IPV4_UDP;
             ipv4.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV4;
-            if (config->length > 76) {
-                bbl.padding = config->length - 76;
+            if (stream->length > 76) {
+                bbl.padding = stream->length - 76;
             }
             break;
         case STREAM_IPV6:
@@ -209,15 +250,15 @@ bbl_stream_build_access_pppoe_packet(bbl_stream *stream) {
             ipv6.protocol = IPV6_NEXT_HEADER_UDP;
             ipv6.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV6;
-            if (config->length > 96) {
-                bbl.padding = config->length - 96;
+            if (stream->length > 96) {
+                bbl.padding = stream->length - 96;
             }
             break;
         default:
             return false;
     }
 
-    buf_len = config->length + 64;
+    buf_len = stream->length + 64;
     if(buf_len < 256) buf_len = 256;
     stream->buf = malloc(buf_len);
     if(encode_ethernet(stream->buf, &stream->tx_len, &eth) != PROTOCOL_SUCCESS) {
@@ -226,6 +267,9 @@ bbl_stream_build_access_pppoe_packet(bbl_stream *stream) {
         stream->tx_len = 0;
         return false;
     }
+    bbl_template_init(&stream->tx_template, stream->buf, stream->tx_len, &bbl);
+    stream->payload_offset = bbl.padding_data - stream->buf;
+    stream->payload_len = bbl.padding;
     return true;
 }
 
@@ -281,6 +325,8 @@ bbl_stream_build_a10nsp_pppoe_packet(bbl_stream *stream) {
     bbl.outer_vlan_id = session->vlan_key.outer_vlan_id;
     bbl.inner_vlan_id = session->vlan_key.inner_vlan_id;
     bbl.flow_id = stream->flow_id;
+    bbl.padding_pattern = config->payload_pattern;
+    bbl.padding_seed = stream->flow_id;
     bbl.tos = config->priority;
     switch (stream->config->type) {
         case STREAM_IPV4:
@@ -303,8 +349,8 @@ bbl_stream_build_a10nsp_pppoe_packet(bbl_stream *stream) {
             ipv4.protocol = PROTOCOL_IPV4_UDP;
             ipv4.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV4;
-            if (config->length > 76) {
-                bbl.padding = config->length - 76;
+            if (stream->length > 76) {
+                bbl.padding = stream->length - 76;
             }
             break;
         case STREAM_IPV6:
@@ -333,15 +379,15 @@ bbl_stream_build_a10nsp_pppoe_packet(bbl_stream *stream) {
             ipv6.protocol = IPV6_NEXT_HEADER_UDP;
             ipv6.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV6;
-            if (config->length > 96) {
-                bbl.padding = config->length - 96;
+            if (stream->length > 96) {
+                bbl.padding = stream->length - 96;
             }
             break;
         default:
             return false;
     }
 
-    buf_len = config->length + 64;
+    buf_len = stream->length + 64;
     if(buf_len < 256) buf_len = 256;
     stream->buf = malloc(buf_len);
     if(encode_ethernet(stream->buf, &stream->tx_len, &eth) != PROTOCOL_SUCCESS) {
@@ -350,6 +396,9 @@ bbl_stream_build_a10nsp_pppoe_packet(bbl_stream *stream) {
         stream->tx_len = 0;
         return false;
     }
+    bbl_template_init(&stream->tx_template, stream->buf, stream->tx_len, &bbl);
+    stream->payload_offset = bbl.padding_data - stream->buf;
+    stream->payload_len = bbl.padding;
     return true;
 }
 
@@ -404,6 +453,8 @@ bbl_stream_build_access_ipoe_packet(bbl_stream *stream) {
     bbl.outer_vlan_id = session->vlan_key.outer_vlan_id;
     bbl.inner_vlan_id = session->vlan_key.inner_vlan_id;
     bbl.flow_id = stream->flow_id;
+    bbl.padding_pattern = config->payload_pattern;
+    bbl.padding_seed = stream->flow_id;
     bbl.tos = config->priority;
     bbl.direction = BBL_DIRECTION_UP;
 
@@ -432,8 +483,8 @@ bbl_stream_build_access_ipoe_packet(bbl_stream *stream) {
             ipv4.protocol = PROTOCOL_IPV4_UDP;
             ipv4.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV4;
-            if (config->length > 76) {
-                bbl.padding = config->length - 76;
+            if (stream->length > 76) {
+                bbl.padding = stream->length - 76;
             }
             break;
         case STREAM_IPV6:
@@ -465,15 +516,15 @@ bbl_stream_build_access_ipoe_packet(bbl_stream *stream) {
             ipv6.protocol = IPV6_NEXT_HEADER_UDP;
             ipv6.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV6;
-            if (config->length > 96) {
-                bbl.padding = config->length - 96;
+            if (stream->length > 96) {
+                bbl.padding = stream->length - 96;
             }
             break;
         default:
             return false;
     }
 
-    buf_len = config->length + 64;
+    buf_len = stream->length + 64;
     if(buf_len < 256) buf_len = 256;
     stream->buf = malloc(buf_len);
     if(encode_ethernet(stream->buf, &stream->tx_len, &eth) != PROTOCOL_SUCCESS) {
@@ -482,6 +533,9 @@ bbl_stream_build_access_ipoe_packet(bbl_stream *stream) {
         stream->tx_len = 0;
         return false;
     }
+    bbl_template_init(&stream->tx_template, stream->buf, stream->tx_len, &bbl);
+    stream->payload_offset = bbl.padding_data - stream->buf;
+    stream->payload_len = bbl.padding;
     return true;
 }
 
@@ -537,6 +591,8 @@ bbl_stream_build_network_packet(bbl_stream *stream) {
         bbl.inner_vlan_id = session->vlan_key.inner_vlan_id;
     }
     bbl.flow_id = stream->flow_id;
+    bbl.padding_pattern = config->payload_pattern;
+    bbl.padding_seed = stream->flow_id;
     bbl.tos = config->priority;
     bbl.direction = BBL_DIRECTION_DOWN;
     switch (stream->config->type) {
@@ -573,8 +629,8 @@ bbl_stream_build_network_packet(bbl_stream *stream) {
             ipv4.protocol = PROTOCOL_IPV4_UDP;
             ipv4.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV4;
-            if (config->length > 76) {
-                bbl.padding = config->length - 76;
+            if (stream->length > 76) {
+                bbl.padding = stream->length - 76;
             }
             break;
         case STREAM_IPV6:
@@ -606,15 +662,15 @@ bbl_stream_build_network_packet(bbl_stream *stream) {
             ipv6.protocol = IPV6_NEXT_HEADER_UDP;
             ipv6.next = &udp;
             bbl.sub_type = BBL_SUB_TYPE_IPV6;
-            if (config->length > 96) {
-                bbl.padding = config->length - 96;
+            if (stream->length > 96) {
+                bbl.padding = stream->length - 96;
             }
             break;
         default:
             return false;
     }
 
-    buf_len = config->length + 64;
+    buf_len = stream->length + 64;
     if(buf_len < 256) buf_len = 256;
     stream->buf = malloc(buf_len);
     if(encode_ethernet(stream->buf, &stream->tx_len, &eth) != PROTOCOL_SUCCESS) {
@@ -623,6 +679,9 @@ bbl_stream_build_network_packet(bbl_stream *stream) {
         stream->tx_len = 0;
         return false;
     }
+    bbl_template_init(&stream->tx_template, stream->buf, stream->tx_len, &bbl);
+    stream->payload_offset = bbl.padding_data - stream->buf;
+    stream->payload_len = bbl.padding;
     return true;
 }
 
@@ -686,14 +745,16 @@ bbl_stream_build_l2tp_packet(bbl_stream *stream) {
     bbl.outer_vlan_id = session->vlan_key.outer_vlan_id;
     bbl.inner_vlan_id = session->vlan_key.inner_vlan_id;
     bbl.flow_id = stream->flow_id;
+    bbl.padding_pattern = config->payload_pattern;
+    bbl.padding_seed = stream->flow_id;
     bbl.tos = config->priority;
     bbl.direction = BBL_DIRECTION_DOWN;
     bbl.sub_type = BBL_SUB_TYPE_IPV4;
-    if (config->length > 76) {
-        bbl.padding = config->length - 76;
+    if (stream->length > 76) {
+        bbl.padding = stream->length - 76;
     }
 
-    buf_len = config->length + 128;
+    buf_len = stream->length + 128;
     if(buf_len < 256) buf_len = 256;
     stream->buf = malloc(buf_len);
     if(encode_ethernet(stream->buf, &stream->tx_len, &eth) != PROTOCOL_SUCCESS) {
@@ -702,11 +763,14 @@ bbl_stream_build_l2tp_packet(bbl_stream *stream) {
         stream->tx_len = 0;
         return false;
     }
+    bbl_template_init(&stream->tx_template, stream->buf, stream->tx_len, &bbl);
+    stream->payload_offset = bbl.padding_data - stream->buf;
+    stream->payload_len = bbl.padding;
     return true;
 }
 
-bool
-bbl_stream_build_packet(bbl_stream *stream) {
+static bool
+bbl_stream_build_template(bbl_stream *stream) {
     if(stream->config->stream_group_id == 0) {
         /* RAW stream */
         return bbl_stream_build_network_packet(stream);
@@ -750,34 +814,321 @@ bbl_stream_build_packet(bbl_stream *stream) {
     return false;
 }
 
+/**
+ * bbl_stream_build_packet
+ *
+ * Build stream packet or one packet per length for IMIX
+ * streams. The largest IMIX packet is used as stream packet
+ * (buf and tx_template), which allows to verify the payload
+ * of all lengths as the payload pattern is the same for all.
+ *
+ * @param stream traffic stream
+ * @return true if success and false if failed
+ */
+bool
+bbl_stream_build_packet(bbl_stream *stream) {
+    bbl_stream_config *config = stream->config;
+    bbl_template_t *imix;
+    uint16_t payload_offset = 0;
+    uint16_t payload_len = 0;
+    uint8_t max = 0;
+    uint8_t i;
+
+    if(!config->imix_count) {
+        stream->length = stream->length_override ? stream->length_override : config->length;
+        return bbl_stream_build_template(stream);
+    }
+
+    imix = calloc(config->imix_count, sizeof(bbl_template_t));
+    for(i = 0; i < config->imix_count; i++) {
+        stream->length = config->imix_length[i];
+        if(!bbl_stream_build_template(stream)) {
+            stream->imix_template = imix;
+            bbl_stream_free_packet(stream);
+            return false;
+        }
+        imix[i] = stream->tx_template;
+        if(stream->payload_len >= payload_len) {
+            max = i;
+            payload_offset = stream->payload_offset;
+            payload_len = stream->payload_len;
+        }
+        stream->buf = NULL;
+    }
+    stream->imix_template = imix;
+    if(!stream->thread.thread) {
+        /* The IMIX cursor of threaded streams is owned by
+         * the stream thread and reset with STREAM_MSG_START. */
+        stream->imix_cursor = 0;
+    }
+    stream->tx_template = imix[max];
+    stream->buf = imix[max].buf;
+    stream->tx_len = imix[max].len;
+    stream->payload_offset = payload_offset;
+    stream->payload_len = payload_len;
+    return true;
+}
+
+/**
+ * bbl_stream_thread_send
+ *
+ * Send control message from main thread to stream thread.
+ *
+ * @param thread stream thread
+ * @param msg message to be copied into the queue
+ * @return false if queue is full
+ */
+static bool
+bbl_stream_thread_send(bbl_stream_thread *thread, bbl_stream_msg *msg) {
+    uint32_t head = thread->queue.head;
+
+    if(head - __atomic_load_n(&thread->queue.tail, __ATOMIC_ACQUIRE) >= STREAM_THREAD_QUEUE_SIZE) {
+        return false;
+    }
+    thread->queue.msg[head & (STREAM_THREAD_QUEUE_SIZE-1)] = *msg;
+    __atomic_store_n(&thread->queue.head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Free the stream thread copy of the stream packets.
+ */
+static void
+bbl_stream_thread_free_packet(bbl_stream *stream) {
+    uint8_t i;
+
+    if(stream->thread.imix_template) {
+        for(i = 0; i < stream->config->imix_count; i++) {
+            free(stream->thread.imix_template[i].buf);
+        }
+        free(stream->thread.imix_template);
+        stream->thread.imix_template = NULL;
+    }
+    if(stream->thread.tx_template.buf) {
+        free(stream->thread.tx_template.buf);
+        stream->thread.tx_template.buf = NULL;
+    }
+    if(stream->thread.burst_buf) {
+        free(stream->thread.burst_buf);
+        free(stream->thread.burst_iov);
+        free(stream->thread.burst_msg);
+        stream->thread.burst_buf = NULL;
+        stream->thread.burst_iov = NULL;
+        stream->thread.burst_msg = NULL;
+    }
+}
+
+/**
+ * bbl_stream_thread_burst_init
+ *
+ * Allocate the buffers used to send one burst with a single
+ * sendmmsg call. Each packet of the burst gets its own slot
+ * as the BBL header is patched per packet. The stream packet
+ * is the largest packet of IMIX streams. If the buffers
+ * can't be allocated, the packets are sent one by one.
+ *
+ * @param stream traffic stream
+ * @param thread stream thread
+ * @return false if allocation failed
+ */
+static bool
+bbl_stream_thread_burst_init(bbl_stream *stream, bbl_stream_thread *thread) {
+    uint16_t burst = stream->config->burst_size;
+    uint16_t len = stream->thread.tx_template.len;
+    uint16_t i;
+
+    stream->thread.burst_buf = malloc(burst * len);
+    stream->thread.burst_iov = calloc(burst, sizeof(struct iovec));
+    stream->thread.burst_msg = calloc(burst, sizeof(struct mmsghdr));
+    if(!(stream->thread.burst_buf && stream->thread.burst_iov && stream->thread.burst_msg)) {
+        LOG(ERROR, "Failed to allocate burst buffers of stream %s\n", stream->config->name);
+        free(stream->thread.burst_buf);
+        free(stream->thread.burst_iov);
+        free(stream->thread.burst_msg);
+        stream->thread.burst_buf = NULL;
+        stream->thread.burst_iov = NULL;
+        stream->thread.burst_msg = NULL;
+        return false;
+    }
+    for(i = 0; i < burst; i++) {
+        stream->thread.burst_iov[i].iov_base = stream->thread.burst_buf + (i * len);
+        stream->thread.burst_msg[i].msg_hdr.msg_iov = &stream->thread.burst_iov[i];
+        stream->thread.burst_msg[i].msg_hdr.msg_iovlen = 1;
+        stream->thread.burst_msg[i].msg_hdr.msg_name = &thread->socket.addr;
+        stream->thread.burst_msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+    }
+    return true;
+}
+
+/**
+ * bbl_stream_thread_receive
+ *
+ * Process all pending control messages in stream thread.
+ *
+ * @param thread stream thread
+ */
+static void
+bbl_stream_thread_receive(bbl_stream_thread *thread) {
+    uint32_t tail = thread->queue.tail;
+    uint32_t head = __atomic_load_n(&thread->queue.head, __ATOMIC_ACQUIRE);
+    bbl_stream_msg *msg;
+    bbl_stream *stream;
+    uint64_t timer_nsec;
+
+    while(tail != head) {
+        msg = &thread->queue.msg[tail & (STREAM_THREAD_QUEUE_SIZE-1)];
+        stream = msg->stream;
+        switch(msg->type) {
+            case STREAM_MSG_START:
+                bbl_stream_thread_free_packet(stream);
+                stream->thread.tx_template = msg->tx_template;
+                stream->thread.imix_template = msg->imix_template;
+                stream->imix_cursor = 0;
+                if(stream->config->burst_size) {
+                    /* Without burst buffers packets are sent one by one. */
+                    bbl_stream_thread_burst_init(stream, thread);
+                }
+                break;
+            case STREAM_MSG_STOP:
+                bbl_stream_thread_free_packet(stream);
+                stream->send_window_packets = 0;
+                break;
+            case STREAM_MSG_RATE:
+                /* Rebase the send window to the new rate. */
+                stream->thread.pps = msg->pps;
+                stream->send_window_packets = 0;
+                timer_nsec = bbl_stream_tx_interval(stream->config, msg->pps);
+                timer_add_periodic(&thread->timer_root, &stream->timer, stream->config->name,
+                                   timer_nsec / 1000000000, timer_nsec % 1000000000,
+                                   stream, &bbl_stream_tx_job_threaded);
+                break;
+        }
+        tail++;
+    }
+    __atomic_store_n(&thread->queue.tail, tail, __ATOMIC_RELEASE);
+}
+
 void *
 bbl_stream_tx_thread (void *thread_data) {
 
     bbl_stream_thread *thread = thread_data;
 
-    pthread_mutex_lock(&thread->mutex);
     timer_smear_all_buckets(&thread->timer_root);
-    pthread_mutex_unlock(&thread->mutex);
 
-    /* Open new TX socket for thread. */
-    while(true) {
-        pthread_mutex_lock(&thread->mutex);
-        if(thread->active) {
-            pthread_mutex_unlock(&thread->mutex);
-            timer_walk(&thread->timer_root);
-        } else {
-            pthread_mutex_unlock(&thread->mutex);
-            break;
-        }
+    while(__atomic_load_n(&thread->active, __ATOMIC_ACQUIRE)) {
+        bbl_stream_thread_receive(thread);
+        timer_walk(&thread->timer_root);
     }
     return NULL;
 }
 
+static void
+bbl_stream_tx_thread_msg_free(bbl_stream_msg *msg, uint8_t imix_count) {
+    uint8_t i;
+
+    free(msg->tx_template.buf);
+    if(msg->imix_template) {
+        for(i = 0; i < imix_count; i++) {
+            free(msg->imix_template[i].buf);
+        }
+        free(msg->imix_template);
+    }
+}
+
+/**
+ * bbl_stream_tx_thread_start_stream
+ *
+ * Pass a private copy of the stream packet to the
+ * stream thread, so that the main thread can free
+ * or rebuild its packet at any time. The stream is
+ * not started if the copy can't be allocated.
+ *
+ * @param thread stream thread
+ * @param stream traffic stream
+ * @return false if copy failed or queue is full
+ */
+static bool
+bbl_stream_tx_thread_start_stream(bbl_stream_thread *thread, bbl_stream *stream) {
+    bbl_stream_msg msg = {0};
+    uint8_t imix_count = 0;
+    uint8_t i;
+
+    msg.type = STREAM_MSG_START;
+    msg.stream = stream;
+    msg.tx_template = stream->tx_template;
+    msg.tx_template.buf = malloc(stream->tx_template.len);
+    if(!msg.tx_template.buf) {
+        goto FREE;
+    }
+    memcpy(msg.tx_template.buf, stream->tx_template.buf, stream->tx_template.len);
+    if(stream->imix_template) {
+        imix_count = stream->config->imix_count;
+        msg.imix_template = calloc(imix_count, sizeof(bbl_template_t));
+        if(!msg.imix_template) {
+            goto FREE;
+        }
+        for(i = 0; i < imix_count; i++) {
+            msg.imix_template[i] = stream->imix_template[i];
+            msg.imix_template[i].buf = malloc(stream->imix_template[i].len);
+            if(!msg.imix_template[i].buf) {
+                goto FREE;
+            }
+            memcpy(msg.imix_template[i].buf, stream->imix_template[i].buf, stream->imix_template[i].len);
+        }
+    }
+    if(!bbl_stream_thread_send(thread, &msg)) {
+        bbl_stream_tx_thread_msg_free(&msg, imix_count);
+        return false;
+    }
+    return true;
+
+FREE:
+    LOG(ERROR, "Failed to copy packet of stream %s\n", stream->config->name);
+    bbl_stream_tx_thread_msg_free(&msg, imix_count);
+    return false;
+}
+
+/**
+ * bbl_stream_tx_lag_check
+ *
+ * Log a warning once per stream if the stream remains
+ * behind its schedule, meaning that the BNG Blaster and
+ * not the device under test limits the rate. A stream
+ * catching up after a delayed send window is not logged,
+ * as its lag decreases between two checks. Called by
+ * main thread.
+ *
+ * @param stream traffic stream
+ */
+static void
+bbl_stream_tx_lag_check(bbl_stream *stream) {
+    uint64_t lag_ns;
+    uint64_t lag_last_ns;
+
+    if(stream->tx_lag_warning) {
+        return;
+    }
+    lag_ns = STREAM_COUNTER_GET(stream->tx_lag_ns);
+    lag_last_ns = stream->tx_lag_check_ns;
+    stream->tx_lag_check_ns = lag_ns;
+    if(lag_ns >= STREAM_LAG_WARNING && lag_last_ns >= STREAM_LAG_WARNING && lag_ns >= lag_last_ns) {
+        stream->tx_lag_warning = true;
+        LOG(INFO, "Warning: Traffic stream %s flow %lu is %.3f seconds behind schedule (%lu packets), "
+            "the configured rate can't be sent\n", stream->config->name, stream->flow_id,
+            (double)lag_ns / SEC, STREAM_COUNTER_GET(stream->tx_deficit));
+    }
+}
+
 /**
  * This function synchronizes the data
  * between TX stream threads and main
  * thread.
  *
+ * Counters are written by one thread only and read
+ * with atomic loads, start and stop of streams is
+ * passed to the stream thread via message queue,
+ * so no locks are required.
+ *
  * @param thread
  */
 void
@@ -785,17 +1136,18 @@ bbl_stream_tx_thread_sync(bbl_stream_thread *thread) {
     bbl_interface_s *interface = thread->interface;
     bbl_stream *stream = thread->stream;
     bbl_session_s *session = NULL;
+    bbl_stream_msg msg = {0};
 
     uint64_t packets_tx;
     uint64_t bytes_tx;
     uint64_t delta_packets;
     uint64_t delta_bytes;
 
-    pthread_mutex_lock(&stream->thread.mutex);
+    bool send;
 
-    packets_tx = thread->packets_tx;
+    packets_tx = STREAM_COUNTER_GET(thread->packets_tx);
     delta_packets = packets_tx - thread->packets_tx_last_sync;
-    bytes_tx = thread->bytes_tx;
+    bytes_tx = STREAM_COUNTER_GET(thread->bytes_tx);
     delta_bytes = bytes_tx - thread->bytes_tx_last_sync;
 
     interface->stats.packets_tx += delta_packets;
@@ -804,20 +1156,19 @@ bbl_stream_tx_thread_sync(bbl_stream_thread *thread) {
     thread->packets_tx_last_sync = packets_tx;
     thread->bytes_tx_last_sync = bytes_tx;
 
-    packets_tx = thread->sendto_failed;
+    packets_tx = STREAM_COUNTER_GET(thread->sendto_failed);
     delta_packets = packets_tx - thread->sendto_failed_last_sync;
     interface->stats.sendto_failed += delta_packets;
-
-    pthread_mutex_unlock(&stream->thread.mutex);
+    thread->sendto_failed_last_sync = packets_tx;
 
     while(stream) {
-        pthread_mutex_lock(&stream->thread.mutex);
-        if(stream->session) {
-            session = stream->session;
+        session = stream->session;
+        if(session) {
             /* Sync counters ... */
-            packets_tx = stream->packets_tx;
+            packets_tx = STREAM_COUNTER_GET(stream->packets_tx);
             delta_packets = packets_tx - stream->packets_tx_last_sync;
-            delta_bytes = delta_packets * stream->tx_len;
+            bytes_tx = STREAM_COUNTER_GET(stream->bytes_tx);
+            delta_bytes = bytes_tx - stream->bytes_tx_last_sync;
             if(stream->direction == STREAM_DIRECTION_UP) {
                 session->stats.packets_tx += delta_packets;
                 session->stats.bytes_tx += delta_bytes;
@@ -832,37 +1183,33 @@ bbl_stream_tx_thread_sync(bbl_stream_thread *thread) {
                 }
             }
             stream->packets_tx_last_sync = packets_tx;
+            stream->bytes_tx_last_sync = bytes_tx;
+        }
 
-            /* Sync session states ... */
-            if(bbl_stream_can_send(stream)) {
-                if(!stream->buf) {
-                    if(!bbl_stream_build_packet(stream)) {
-                        LOG(ERROR, "Failed to build packet for stream %s\n", stream->config->name);
-                    }
+        bbl_stream_tx_lag_check(stream);
+
+        /* Sync session states ... */
+        if(bbl_stream_can_send(stream)) {
+            if(!stream->buf) {
+                if(!bbl_stream_build_packet(stream)) {
+                    LOG(ERROR, "Failed to build packet for stream %s\n", stream->config->name);
                 }
             }
-            if(stream->buf && g_traffic && session->stream_traffic) {
-                stream->thread.can_send = true;
-            } else {
-                stream->thread.can_send = false;
-                stream->send_window_packets = 0;
-            }
-        } else {
-            if(bbl_stream_can_send(stream)) {
-                if(!stream->buf) {
-                    if(!bbl_stream_build_packet(stream)) {
-                        LOG(ERROR, "Failed to build packet for stream %s\n", stream->config->name);
-                    }
+        }
+        send = stream->buf && g_traffic && (!session || session->stream_traffic);
+        if(send != stream->thread.can_send) {
+            if(send) {
+                if(bbl_stream_tx_thread_start_stream(thread, stream)) {
+                    stream->thread.can_send = true;
                 }
-            }
-            if(stream->buf && g_traffic) {
-                stream->thread.can_send = true;
             } else {
-                stream->thread.can_send = false;
-                stream->send_window_packets = 0;
+                msg.type = STREAM_MSG_STOP;
+                msg.stream = stream;
+                if(bbl_stream_thread_send(thread, &msg)) {
+                    stream->thread.can_send = false;
+                }
             }
         }
-        pthread_mutex_unlock(&stream->thread.mutex);
         stream = stream->thread.next;
     }
 }
@@ -892,12 +1239,6 @@ bbl_stream_thread_create(uint8_t thread_group, bbl_stream *stream) {
     /* Init thread timer root */
     timer_init_root(&thread->timer_root);
 
-    /* Init thread mutex */
-    if (pthread_mutex_init(&thread->mutex, NULL) != 0) {
-        LOG(ERROR, "Failed to init stream TX thread mutex\n");
-        return NULL;
-    }
-
     /* Setup RAW socket */
     thread->socket.fd_tx = socket(PF_PACKET, SOCK_RAW | SOCK_NONBLOCK, 0);
     if (thread->socket.fd_tx == -1) {
@@ -968,6 +1309,17 @@ bbl_stream_add_to_thread(bbl_ctx_s *ctx, uint8_t thread_group, bbl_stream *strea
         ctx->stream_thread = thread;
     }
 
+    /* The TX rate is computed by the stream thread owning the TX
+     * counter and the RX rate by the main thread owning the RX
+     * counter. */
+    if(!(bbl_rate_sweep_add(&thread->rate_sweep, &stream->rate_packets_tx, &stream->packets_tx) &&
+         bbl_rate_sweep_add(&thread->rate_sweep, &stream->rate_bytes_tx, &stream->bytes_tx) &&
+         bbl_rate_sweep_add(&ctx->rate_sweep, &stream->rate_packets_rx, &stream->packets_rx) &&
+         bbl_rate_sweep_add(&ctx->rate_sweep, &stream->rate_bytes_rx, &stream->bytes_rx))) {
+        return NULL;
+    }
+    bbl_rate_sweep_start(&thread->timer_root, &thread->rate_sweep, ctx->config.rate_slices);
+
     /* Append stream to thread */
     if(thread->stream) {
         thread->stream_tail->thread.next = stream;
@@ -978,12 +1330,6 @@ bbl_stream_add_to_thread(bbl_ctx_s *ctx, uint8_t thread_group, bbl_stream *strea
     thread->stream_tail = stream;
     thread->stream_count++;
 
-    /* Init stream mutex */
-    if (pthread_mutex_init(&stream->thread.mutex, NULL) != 0) {
-        LOG(ERROR, "Failed to init stream mutex\n");
-        return NULL;
-    }
-
     stream->thread.thread = thread;
     return thread;
 }
@@ -1005,8 +1351,8 @@ bbl_stream_start_threads(bbl_ctx_s *ctx) {
         } else {
             LOG(INFO, "Start stream TX thread for stream %s\n", thread->stream->config->name);
         }
-        thread->active = true;
-        timer_add_periodic(&ctx->timer_root, &thread->sync_timer, "Stream TX Thread Sync", 1, 0, thread, &bbl_stream_tx_thread_sync_timer);
+        __atomic_store_n(&thread->active, true, __ATOMIC_RELEASE);
+        timer_add_periodic(&ctx->timer_root, &thread->sync_timer, "Stream TX Thread Sync", STREAM_THREAD_SYNC_INTERVAL, 0, thread, &bbl_stream_tx_thread_sync_timer);
         pthread_create(&thread->thread_id, NULL, bbl_stream_tx_thread, (void *)thread);
         thread = thread->next;
     }
@@ -1030,9 +1376,7 @@ bbl_stream_stop_threads(bbl_ctx_s *ctx) {
                 LOG(INFO, "Stop stream TX thread for stream %s\n", thread->stream->config->name);
             }
             /* Mark thread as inactive and stop counter sync job */
-            pthread_mutex_lock(&thread->mutex);
-            thread->active = false;
-            pthread_mutex_unlock(&thread->mutex);
+            __atomic_store_n(&thread->active, false, __ATOMIC_RELEASE);
             /* Wait for thread to be stopped */
             pthread_join(thread->thread_id, NULL);
             /* Do final sync */
@@ -1042,12 +1386,150 @@ bbl_stream_stop_threads(bbl_ctx_s *ctx) {
     }
 }
 
+/**
+ * bbl_stream_sync_threads
+ *
+ * Synchronize all running stream threads immediately,
+ * so that start and stop of traffic is passed to the
+ * stream threads without waiting for the periodic sync.
+ *
+ * @param ctx global context
+ */
+void
+bbl_stream_sync_threads(bbl_ctx_s *ctx) {
+
+    bbl_stream_thread *thread = ctx->stream_thread;
+    while(thread) {
+        if(thread->active) {
+            bbl_stream_tx_thread_sync(thread);
+        }
+        thread = thread->next;
+    }
+}
+
+/**
+ * bbl_stream_rate_profile_point
+ *
+ * Search the last rate profile point with time offset
+ * less than or equal to the given time offset.
+ *
+ * @param config stream config with rate profile
+ * @param offset time offset in seconds, which is reduced
+ *        to the offset in the current period for repeated
+ *        rate profiles
+ * @param periods number of completed periods
+ * @return index of rate profile point
+ */
+static uint16_t
+bbl_stream_rate_profile_point(bbl_stream_config *config, double *offset, double *periods) {
+    uint16_t last = config->rate_profile_count - 1;
+    uint16_t low = 0;
+    uint16_t high = last;
+    uint16_t mid;
+    double period = config->rate_profile_time[last];
+
+    *periods = 0;
+    if(config->rate_profile_repeat && period > 0 && *offset >= period) {
+        *periods = floor(*offset / period);
+        *offset -= *periods * period;
+    }
+    while(low < high) {
+        mid = (low + high + 1) / 2;
+        if(config->rate_profile_time[mid] <= *offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+static double
+bbl_stream_rate_profile_pps(bbl_stream_config *config, uint16_t point, double offset) {
+    double *time = config->rate_profile_time;
+    double *pps = config->rate_profile_pps;
+
+    if(config->rate_profile_linear && point < config->rate_profile_count - 1) {
+        return pps[point] + (pps[point+1] - pps[point]) *
+               (offset - time[point]) / (time[point+1] - time[point]);
+    }
+    return pps[point];
+}
+
+/**
+ * bbl_stream_rate_profile_packets
+ *
+ * Return the number of packets to be sent from
+ * start of the rate profile until the given time
+ * offset, which is the integral of the rate profile.
+ *
+ * @param config stream config with rate profile
+ * @param offset time offset in seconds
+ * @return number of packets
+ */
+static double
+bbl_stream_rate_profile_packets(bbl_stream_config *config, double offset) {
+    double periods;
+    double packets;
+    uint16_t point;
+
+    point = bbl_stream_rate_profile_point(config, &offset, &periods);
+    packets = periods * config->rate_profile_packets[config->rate_profile_count-1];
+    packets += config->rate_profile_packets[point];
+    packets += (offset - config->rate_profile_time[point]) *
+               (config->rate_profile_pps[point] + bbl_stream_rate_profile_pps(config, point, offset)) / 2.0;
+    return packets;
+}
+
+static double
+bbl_stream_timespec_to_double(struct timespec *ts) {
+    return (double)ts->tv_sec + ((double)ts->tv_nsec / 1000000000.0);
+}
+
+/**
+ * bbl_stream_tx_schedule
+ *
+ * Account deficit and lag of the stream against its ideal
+ * schedule, which are written by the owner of the stream
+ * TX attributes and read by the main thread.
+ *
+ * @param stream traffic stream
+ * @param deficit packets behind schedule after this send window
+ * @param lag_ns time behind schedule after this send window
+ */
+static void
+bbl_stream_tx_schedule(bbl_stream *stream, uint64_t deficit, uint64_t lag_ns) {
+    bbl_stream_thread *thread = stream->thread.thread;
+
+    __atomic_store_n(&stream->tx_deficit, deficit, __ATOMIC_RELAXED);
+    __atomic_store_n(&stream->tx_lag_ns, lag_ns, __ATOMIC_RELAXED);
+    if(deficit > stream->tx_deficit_max) {
+        __atomic_store_n(&stream->tx_deficit_max, deficit, __ATOMIC_RELAXED);
+    }
+    if(lag_ns > stream->tx_lag_max_ns) {
+        __atomic_store_n(&stream->tx_lag_max_ns, lag_ns, __ATOMIC_RELAXED);
+        if(thread && lag_ns > thread->tx_lag_max_ns) {
+            __atomic_store_n(&thread->tx_lag_max_ns, lag_ns, __ATOMIC_RELAXED);
+        }
+    }
+}
+
 uint64_t
 bbl_stream_send_window(bbl_stream *stream, struct timespec *now) {
 
     bbl_ctx_s *ctx = stream->interface->ctx;
+    bbl_stream_config *config = stream->config;
     uint64_t packets = 1;
     uint64_t packets_expected;
+    double pps = stream->thread.thread ? stream->thread.pps : stream->pps;
+    double scale = 1;
+    double offset_now = 0;
+    double offset;
+    double periods;
+    double rate = pps;
+    uint16_t point;
+    uint64_t deficit = 0;
+    uint64_t lag_ns = 0;
 
     struct timespec time_elapsed = {0};
 
@@ -1069,48 +1551,196 @@ bbl_stream_send_window(bbl_stream *stream, struct timespec *now) {
         }   
     }
 
+    if(config->rate_profile_count) {
+        /* The rate profile starts with the first send window and
+         * the stream pps scales the max pps of the rate profile. */
+        if(!(stream->rate_profile_start.tv_sec || stream->rate_profile_start.tv_nsec)) {
+            stream->rate_profile_start.tv_sec = now->tv_sec;
+            stream->rate_profile_start.tv_nsec = now->tv_nsec;
+        }
+        scale = pps / config->pps;
+        timespec_sub(&time_elapsed, now, &stream->rate_profile_start);
+        offset_now = bbl_stream_timespec_to_double(&time_elapsed);
+    }
+
     if(stream->send_window_packets == 0) {
         /* Open new send window */
         stream->send_window_start.tv_sec = now->tv_sec;
         stream->send_window_start.tv_nsec = now->tv_nsec;
+        if(config->burst_size) {
+            packets = config->burst_size;
+        } else if(config->rate_profile_count) {
+            /* Do not send while the rate profile is at zero. */
+            offset = offset_now;
+            point = bbl_stream_rate_profile_point(config, &offset, &periods);
+            if(bbl_stream_rate_profile_pps(config, point, offset) <= 0) {
+                packets = 0;
+            }
+        }
     } else {
-        timespec_sub(&time_elapsed, now, &stream->send_window_start);
-        packets_expected = time_elapsed.tv_sec * stream->config->pps;
-        packets_expected += stream->config->pps * ((double)time_elapsed.tv_nsec / 1000000000.0);
+        if(config->rate_profile_count) {
+            /* Packets expected in the send window follow the
+             * integral of the rate profile, which changes the
+             * rate without burst or gap between points. */
+            timespec_sub(&time_elapsed, &stream->send_window_start, &stream->rate_profile_start);
+            offset = bbl_stream_timespec_to_double(&time_elapsed);
+            packets_expected = scale * (bbl_stream_rate_profile_packets(config, offset_now) -
+                                        bbl_stream_rate_profile_packets(config, offset));
+            packets = 0;
+            /* Current rate of the profile used for the lag. */
+            offset = offset_now;
+            point = bbl_stream_rate_profile_point(config, &offset, &periods);
+            rate = scale * bbl_stream_rate_profile_pps(config, point, offset);
+        } else {
+            timespec_sub(&time_elapsed, now, &stream->send_window_start);
+            packets_expected = time_elapsed.tv_sec * pps;
+            packets_expected += pps * ((double)time_elapsed.tv_nsec / 1000000000.0);
+        }
 
-        if(packets_expected > stream->send_window_packets) {
-            packets = packets_expected - stream->send_window_packets;
+        if(config->burst_size) {
+            /* Send the next burst if due within half of the
+             * burst interval to tolerate timer jitter. */
+            packets = 0;
+            if(bbl_stream_timespec_to_double(&time_elapsed) * pps + (config->burst_size / 2.0) >= stream->send_window_packets) {
+                packets = config->burst_size;
+            }
+        } else {
+            if(packets_expected > stream->send_window_packets) {
+                packets = packets_expected - stream->send_window_packets;
+            }
+            if(packets > ctx->config.io_stream_max_ppi) {
+                packets = ctx->config.io_stream_max_ppi;
+                STREAM_COUNTER_ADD(stream->tx_capped, 1);
+                if(stream->thread.thread) {
+                    STREAM_COUNTER_ADD(stream->thread.thread->tx_capped, 1);
+                }
+            }
         }
-        if(packets > ctx->config.io_stream_max_ppi) {
-            packets = ctx->config.io_stream_max_ppi;
+        if(packets_expected > stream->send_window_packets + packets) {
+            deficit = packets_expected - stream->send_window_packets - packets;
+            /* The lag is the time the stream remains behind
+             * schedule after this send window caught up, so
+             * that a single delayed send window is no lag. */
+            if(rate > 0) {
+                lag_ns = deficit * (SEC / rate);
+            }
         }
     }
 
     /** Enforce optional stream packet limit ... */
     if(stream->config->max_packets &&
-       stream->packets_tx + packets > stream->config->max_packets) {
+       stream->packets_tx + packets >= stream->config->max_packets) {
        if(stream->packets_tx < stream->config->max_packets) {
            packets = stream->config->max_packets - stream->packets_tx;
        } else {
            packets = 0;
        }
+       /* Stream is not behind schedule if all packets are sent. */
+       deficit = 0;
+       lag_ns = 0;
     }
 
+    bbl_stream_tx_schedule(stream, deficit, lag_ns);
     return packets;
 }
 
+/**
+ * bbl_stream_tx_burst_done
+ *
+ * Account burst sent by the owner of the stream TX attributes.
+ *
+ * @param stream traffic stream
+ * @param packets packets sent in burst
+ */
+static void
+bbl_stream_tx_burst_done(bbl_stream *stream, uint64_t packets) {
+    STREAM_COUNTER_ADD(stream->tx_bursts, 1);
+    if(packets < stream->tx_burst_min || stream->tx_bursts == 1) {
+        __atomic_store_n(&stream->tx_burst_min, packets, __ATOMIC_RELAXED);
+    }
+    if(packets > stream->tx_burst_max) {
+        __atomic_store_n(&stream->tx_burst_max, packets, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * bbl_stream_tx_burst_threaded
+ *
+ * Send one burst of threaded stream with a single sendmmsg
+ * call, repeated only if the kernel accepts less packets.
+ *
+ * @param stream traffic stream
+ * @param packets packets to be sent (max burst-size)
+ * @param now current time
+ */
+static void
+bbl_stream_tx_burst_threaded(bbl_stream *stream, uint64_t packets, struct timespec *now) {
+    bbl_stream_thread *thread = stream->thread.thread;
+    bbl_template_t *tpl = &stream->thread.tx_template;
+    uint16_t imix_cursor = stream->imix_cursor;
+    uint64_t bytes = 0;
+    uint64_t sent = 0;
+    uint64_t i;
+    int result;
+
+    if(packets > stream->config->burst_size) {
+        packets = stream->config->burst_size;
+    }
+    for(i = 0; i < packets; i++) {
+        if(stream->thread.imix_template) {
+            tpl = &stream->thread.imix_template[stream->config->imix_sequence[imix_cursor]];
+            if(++imix_cursor >= stream->config->imix_sequence_len) {
+                imix_cursor = 0;
+            }
+        }
+        memcpy(stream->thread.burst_iov[i].iov_base, tpl->buf, tpl->len);
+        stream->thread.burst_iov[i].iov_len = tpl->len;
+        /* Update BBL header fields */
+        bbl_template_patch(tpl, stream->thread.burst_iov[i].iov_base, stream->flow_seq + i, now);
+    }
+    while(sent < packets) {
+        result = sendmmsg(thread->socket.fd_tx, &stream->thread.burst_msg[sent], packets - sent, 0);
+        if(result <= 0) {
+            LOG(IO, "Thread: Sendmmsg failed with errno: %i\n", errno);
+            STREAM_COUNTER_ADD(thread->sendto_failed, 1);
+            break;
+        }
+        sent += result;
+    }
+    if(!sent) {
+        return;
+    }
+    for(i = 0; i < sent; i++) {
+        bytes += stream->thread.burst_iov[i].iov_len;
+    }
+    if(stream->thread.imix_template) {
+        stream->imix_cursor = (stream->imix_cursor + sent) % stream->config->imix_sequence_len;
+    }
+    STREAM_COUNTER_ADD(stream->packets_tx, sent);
+    STREAM_COUNTER_ADD(stream->bytes_tx, bytes);
+    stream->send_window_packets += sent;
+    stream->flow_seq += sent;
+    STREAM_COUNTER_ADD(thread->packets_tx, sent);
+    STREAM_COUNTER_ADD(thread->bytes_tx, bytes);
+    bbl_stream_tx_burst_done(stream, sent);
+}
+
 void
 bbl_stream_tx_job (timer_s *timer) {
 
     bbl_stream *stream = timer->data;
     bbl_session_s *session = stream->session;
     bbl_interface_s *interface = stream->interface;
+    bbl_template_t *tpl = &stream->tx_template;
 
     struct timespec now;
 
     uint64_t packets = 1;
+    uint64_t burst;
 
     if(!bbl_stream_can_send(stream)) {
+        /* Close send window */
+        stream->send_window_packets = 0;
         return;
     }
     if(!stream->buf) {
@@ -1128,25 +1758,34 @@ bbl_stream_tx_job (timer_s *timer) {
 
     clock_gettime(CLOCK_MONOTONIC, &now);
     packets = bbl_stream_send_window(stream, &now);
-    /* Update BBL header fields */
-    *(uint32_t*)(stream->buf + (stream->tx_len - 8)) = now.tv_sec;
-    *(uint32_t*)(stream->buf + (stream->tx_len - 4)) = now.tv_nsec;
+    bbl_stream_tx_lag_check(stream);
+    burst = packets;
     while(packets) {
-        *(uint64_t*)(stream->buf + (stream->tx_len - 16)) = stream->flow_seq;
+        if(stream->imix_template) {
+            tpl = &stream->imix_template[stream->config->imix_sequence[stream->imix_cursor]];
+        }
+        /* Update BBL header fields */
+        bbl_template_patch(tpl, tpl->buf, stream->flow_seq, &now);
         /* Send packet ... */
-        if(!bbl_io_send(interface, stream->buf, stream->tx_len)) {
-            return;
+        if(!bbl_io_send(interface, tpl->buf, tpl->len)) {
+            break;
+        }
+        if(stream->imix_template) {
+            if(++stream->imix_cursor >= stream->config->imix_sequence_len) {
+                stream->imix_cursor = 0;
+            }
         }
         stream->send_window_packets++;
         stream->packets_tx++;
+        stream->bytes_tx += tpl->len;
         stream->flow_seq++;
         packets--;
         if(session) {
             if(stream->direction == STREAM_DIRECTION_UP) {
                 session->stats.packets_tx++;
-                session->stats.bytes_tx += stream->tx_len;
+                session->stats.bytes_tx += tpl->len;
                 session->stats.accounting_packets_tx++;
-                session->stats.accounting_bytes_tx += stream->tx_len;
+                session->stats.accounting_bytes_tx += tpl->len;
             } else {
                 if(session->l2tp_session) {
                     interface->stats.l2tp_data_tx++;
@@ -1157,65 +1796,231 @@ bbl_stream_tx_job (timer_s *timer) {
             }
         }
     }
+    if(stream->config->burst_size && burst > packets) {
+        /* With packet_mmap all packets of the burst are
+         * passed to the kernel with one TX ring kick. */
+        bbl_stream_tx_burst_done(stream, burst - packets);
+    }
 }
 
 void
 bbl_stream_tx_job_threaded (timer_s *timer) {
     bbl_stream *stream = timer->data;
     bbl_stream_thread *thread = stream->thread.thread;
+    bbl_template_t *tpl = &stream->thread.tx_template;
 
     struct timespec now;
 
     uint64_t packets;
 
-    pthread_mutex_lock(&stream->thread.mutex);
-    if(!stream->thread.can_send) {
-        pthread_mutex_unlock(&stream->thread.mutex);
+    if(!tpl->buf) {
         return;
     }
 
-    pthread_mutex_lock(&thread->mutex);
-
     clock_gettime(CLOCK_MONOTONIC, &now);
     packets = bbl_stream_send_window(stream, &now);
 
-    /* Update BBL header fields */
-    *(uint32_t*)(stream->buf + (stream->tx_len - 8)) = now.tv_sec;
-    *(uint32_t*)(stream->buf + (stream->tx_len - 4)) = now.tv_nsec;
+    if(stream->thread.burst_buf && packets) {
+        bbl_stream_tx_burst_threaded(stream, packets, &now);
+        return;
+    }
+
     while(packets) {
-        *(uint64_t*)(stream->buf + (stream->tx_len - 16)) = stream->flow_seq;
+        if(stream->thread.imix_template) {
+            tpl = &stream->thread.imix_template[stream->config->imix_sequence[stream->imix_cursor]];
+        }
+        /* Update BBL header fields */
+        bbl_template_patch(tpl, tpl->buf, stream->flow_seq, &now);
         /* Send packet ... */
-        if (sendto(thread->socket.fd_tx, stream->buf, stream->tx_len, 0, (struct sockaddr*)&thread->socket.addr, sizeof(struct sockaddr_ll)) <0 ) {
+        if (sendto(thread->socket.fd_tx, tpl->buf, tpl->len, 0, (struct sockaddr*)&thread->socket.addr, sizeof(struct sockaddr_ll)) <0 ) {
             LOG(IO, "Thread: Sendto failed with errno: %i\n", errno);
-            thread->sendto_failed++;
+            STREAM_COUNTER_ADD(thread->sendto_failed, 1);
             packets = 0;
         } else {
-            stream->packets_tx++;
+            if(stream->thread.imix_template) {
+                if(++stream->imix_cursor >= stream->config->imix_sequence_len) {
+                    stream->imix_cursor = 0;
+                }
+            }
+            STREAM_COUNTER_ADD(stream->packets_tx, 1);
+            STREAM_COUNTER_ADD(stream->bytes_tx, tpl->len);
             stream->send_window_packets++;
             stream->flow_seq++;
             packets--;
-            thread->packets_tx++;
-            thread->bytes_tx += stream->tx_len;
+            STREAM_COUNTER_ADD(thread->packets_tx, 1);
+            STREAM_COUNTER_ADD(thread->bytes_tx, tpl->len);
         }
     }
-    pthread_mutex_unlock(&thread->mutex);
-    pthread_mutex_unlock(&stream->thread.mutex);
 }
 
-void
-bbl_stream_rate_job (timer_s *timer) {
-    bbl_stream *stream = timer->data;
-    bbl_compute_avg_rate(&stream->rate_packets_tx, stream->packets_tx);
-    bbl_compute_avg_rate(&stream->rate_packets_rx, stream->packets_rx);
+/**
+ * bbl_stream_flow_add
+ *
+ * Add stream to flow table and flow hashtable. Flow
+ * identifiers are allocated from a dense counter shared
+ * with session and multicast traffic, so streams are
+ * stored in an array directly indexed by flow-id. The
+ * hashtable is used to iterate over all streams and to
+ * lookup flow identifiers outside of the table.
+ *
+ * @param ctx global context
+ * @param stream traffic stream
+ * @return true if success and false if failed
+ */
+static bool
+bbl_stream_flow_add(bbl_ctx_s *ctx, bbl_stream *stream) {
+    dict_insert_result result;
+    void **table;
+    uint64_t size;
+
+    /* Grow the table first, so that a failed allocation
+     * leaves table and hashtable unchanged. */
+    if(stream->flow_id >= ctx->stream_flow_table_size) {
+        size = ctx->stream_flow_table_size ? ctx->stream_flow_table_size : BBL_STREAM_FLOW_TABLE_SIZE;
+        while(stream->flow_id >= size) {
+            size *= 2;
+        }
+        table = realloc(ctx->stream_flow_table, size * sizeof(void*));
+        if(!table) {
+            return false;
+        }
+        memset(&table[ctx->stream_flow_table_size], 0x0,
+               (size - ctx->stream_flow_table_size) * sizeof(void*));
+        ctx->stream_flow_table = table;
+        ctx->stream_flow_table_size = size;
+    }
+
+    result = dict_insert(ctx->stream_flow_dict, &stream->flow_id);
+    if (!result.inserted) {
+        return false;
+    }
+    *result.datum_ptr = stream;
+    ctx->stream_flow_table[stream->flow_id] = stream;
+    return true;
 }
 
-void
-bbl_stream_rate_job_threaded (timer_s *timer) {
-    bbl_stream *stream = timer->data;
-    pthread_mutex_lock(&stream->thread.mutex);
-    bbl_compute_avg_rate(&stream->rate_packets_tx, stream->packets_tx);
-    bbl_compute_avg_rate(&stream->rate_packets_rx, stream->packets_rx);
-    pthread_mutex_unlock(&stream->thread.mutex);
+/**
+ * bbl_stream_get
+ *
+ * Get stream by flow-id.
+ *
+ * @param ctx global context
+ * @param flow_id flow identifier
+ * @return stream or NULL
+ */
+bbl_stream *
+bbl_stream_get(bbl_ctx_s *ctx, uint64_t flow_id) {
+    bbl_stream *stream;
+    void **search;
+
+    if(flow_id < ctx->stream_flow_table_size) {
+        stream = ctx->stream_flow_table[flow_id];
+        if(stream && stream->flow_id == flow_id) {
+            return stream;
+        }
+        return NULL;
+    }
+    search = dict_search(ctx->stream_flow_dict, &flow_id);
+    if(search) {
+        return *search;
+    }
+    return NULL;
+}
+
+/**
+ * bbl_stream_set_rate
+ *
+ * Change the rate of a running stream. The send
+ * window is rebased at the new rate, so that the
+ * stream continues without burst or gap. Threaded
+ * streams apply the new rate in the stream thread.
+ *
+ * @param stream traffic stream
+ * @param pps new rate in packets per second
+ * @return true if rate was changed
+ */
+bool
+bbl_stream_set_rate(bbl_stream *stream, double pps) {
+    bbl_ctx_s *ctx = stream->interface->ctx;
+    bbl_stream_msg msg = {0};
+    uint64_t timer_sec;
+    uint64_t timer_nsec;
+
+    if(pps <= 0) {
+        return false;
+    }
+    timer_nsec = bbl_stream_tx_interval(stream->config, pps);
+    timer_sec = timer_nsec / 1000000000;
+    timer_nsec = timer_nsec % 1000000000;
+
+    if(stream->thread.thread) {
+        msg.type = STREAM_MSG_RATE;
+        msg.stream = stream;
+        msg.pps = pps;
+        if(!bbl_stream_thread_send(stream->thread.thread, &msg)) {
+            return false;
+        }
+    } else {
+        stream->send_window_packets = 0;
+        timer_add_periodic(&ctx->timer_root, &stream->timer, stream->config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job);
+    }
+    stream->pps = pps;
+    stream->tx_interval = timer_sec * 1e9 + timer_nsec;
+    LOG(DEBUG, "Traffic stream %s flow %lu rate changed to %lf PPS\n", stream->config->name, stream->flow_id, pps);
+    return true;
+}
+
+/**
+ * bbl_stream_set_length
+ *
+ * Change the length of a stream. The stream packet is
+ * rebuilt with the new length before the next packet is
+ * sent. Threaded streams are stopped and started again
+ * with the new packet by the next thread sync.
+ *
+ * @param stream traffic stream
+ * @param length new layer 3 length or zero for config->length
+ * @return true if length was changed
+ */
+bool
+bbl_stream_set_length(bbl_stream *stream, uint16_t length) {
+    bbl_stream_msg msg = {0};
+
+    if(stream->config->imix_count) {
+        return false;
+    }
+    if(length == stream->length_override) {
+        return true;
+    }
+    if(stream->thread.thread && stream->thread.can_send) {
+        msg.type = STREAM_MSG_STOP;
+        msg.stream = stream;
+        if(!bbl_stream_thread_send(stream->thread.thread, &msg)) {
+            return false;
+        }
+        stream->thread.can_send = false;
+    }
+    stream->length_override = length;
+    bbl_stream_free_packet(stream);
+    return true;
+}
+
+/**
+ * bbl_stream_rate_sweep_add
+ *
+ * Add the rates of a stream sent by the
+ * main thread to the global rate sweep.
+ *
+ * @param ctx global context
+ * @param stream traffic stream
+ * @return false if memory allocation failed
+ */
+static bool
+bbl_stream_rate_sweep_add(bbl_ctx_s *ctx, bbl_stream *stream) {
+    return bbl_rate_sweep_add(&ctx->rate_sweep, &stream->rate_packets_tx, &stream->packets_tx) &&
+           bbl_rate_sweep_add(&ctx->rate_sweep, &stream->rate_packets_rx, &stream->packets_rx) &&
+           bbl_rate_sweep_add(&ctx->rate_sweep, &stream->rate_bytes_tx, &stream->bytes_tx) &&
+           bbl_rate_sweep_add(&ctx->rate_sweep, &stream->rate_bytes_rx, &stream->bytes_rx);
 }
 
 bool
@@ -1227,8 +2032,6 @@ bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s
     bbl_stream_thread *thread;
     bbl_interface_s *network_if;
 
-    dict_insert_result result;
-
     time_t timer_sec = 0;
     long timer_nsec  = 0;
 
@@ -1257,7 +2060,7 @@ bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s
                 return false;
             }
 
-            timer_nsec = SEC / config->pps;
+            timer_nsec = bbl_stream_tx_interval(config, config->pps);
             timer_sec = timer_nsec / 1000000000;
             timer_nsec = timer_nsec % 1000000000;
 
@@ -1269,14 +2072,14 @@ bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s
                 stream->direction = STREAM_DIRECTION_UP;
                 stream->interface = session->interface;
                 stream->session = session;
+                stream->pps = config->pps;
+                stream->thread.pps = config->pps;
                 stream->tx_interval = timer_sec * 1e9 + timer_nsec;
-                result = dict_insert(ctx->stream_flow_dict, &stream->flow_id);
-                if (!result.inserted) {
+                if(!bbl_stream_flow_add(ctx, stream)) {
                     LOG(ERROR, "Failed to insert stream %s\n", config->name);
                     free(stream);
                     return false;
                 }
-                *result.datum_ptr = stream;
                 if(session->stream) {
                     session_stream = session->stream;
                     while(session_stream->next) {
@@ -1294,10 +2097,12 @@ bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s
                         return false;
                     }
                     timer_add_periodic(&thread->timer_root, &stream->timer, config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job_threaded);
-                    timer_add_periodic(&thread->timer_root, &stream->timer_rate, "Threaded Rate Computation", 1, 0, stream, &bbl_stream_rate_job_threaded);
                 } else {
                     timer_add_periodic(&ctx->timer_root, &stream->timer, config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job);
-                    timer_add_periodic(&ctx->timer_root, &stream->timer_rate, "Rate Computation", 1, 0, stream, &bbl_stream_rate_job);
+                    if(!bbl_stream_rate_sweep_add(ctx, stream)) {
+                        LOG(ERROR, "Failed to add rates of stream %s\n", config->name);
+                        return false;
+                    }
                 }
                 ctx->stats.stream_traffic_flows++;
                 LOG(DEBUG, "Traffic stream %s added in upstream with %lf PPS (timer: %lu sec %lu nsec)\n", config->name, config->pps, timer_sec, timer_nsec);
@@ -1310,14 +2115,14 @@ bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s
                 stream->direction = STREAM_DIRECTION_DOWN;
                 stream->interface = network_if;
                 stream->session = session;
+                stream->pps = config->pps;
+                stream->thread.pps = config->pps;
                 stream->tx_interval = timer_sec * 1e9 + timer_nsec;
-                result = dict_insert(ctx->stream_flow_dict, &stream->flow_id);
-                if (!result.inserted) {
+                if(!bbl_stream_flow_add(ctx, stream)) {
                     LOG(ERROR, "Failed to insert stream %s\n", config->name);
                     free(stream);
                     return false;
                 }
-                *result.datum_ptr = stream;
                 if(session->stream) {
                     session_stream = session->stream;
                     while(session_stream->next) {
@@ -1335,10 +2140,12 @@ bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s
                         return false;
                     }
                     timer_add_periodic(&thread->timer_root, &stream->timer, config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job_threaded);
-                    timer_add_periodic(&thread->timer_root, &stream->timer_rate, "Threaded Rate Computation", 1, 0, stream, &bbl_stream_rate_job_threaded);
                 } else {
                     timer_add_periodic(&ctx->timer_root, &stream->timer, config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job);
-                    timer_add_periodic(&ctx->timer_root, &stream->timer_rate, "Rate Computation", 1, 0, stream, &bbl_stream_rate_job);
+                    if(!bbl_stream_rate_sweep_add(ctx, stream)) {
+                        LOG(ERROR, "Failed to add rates of stream %s\n", config->name);
+                        return false;
+                    }
                 }
                 ctx->stats.stream_traffic_flows++;
                 LOG(DEBUG, "Traffic stream %s added in downstream with %lf PPS (timer %lu sec %lu nsec)\n", config->name, config->pps, timer_sec, timer_nsec);
@@ -1358,8 +2165,6 @@ bbl_stream_raw_add(bbl_ctx_s *ctx) {
     bbl_stream_thread *thread;
     bbl_interface_s *network_if;
 
-    dict_insert_result result;
-
     time_t timer_sec = 0;
     long timer_nsec  = 0;
 
@@ -1372,7 +2177,7 @@ bbl_stream_raw_add(bbl_ctx_s *ctx) {
                 return false;
             }
 
-            timer_nsec = SEC / config->pps;
+            timer_nsec = bbl_stream_tx_interval(config, config->pps);
             timer_sec = timer_nsec / 1000000000;
             timer_nsec = timer_nsec % 1000000000;
 
@@ -1383,14 +2188,14 @@ bbl_stream_raw_add(bbl_ctx_s *ctx) {
                 stream->config = config;
                 stream->direction = STREAM_DIRECTION_DOWN;
                 stream->interface = network_if;
+                stream->pps = config->pps;
+                stream->thread.pps = config->pps;
                 stream->tx_interval = timer_sec * 1e9 + timer_nsec;
-                result = dict_insert(ctx->stream_flow_dict, &stream->flow_id);
-                if (!result.inserted) {
+                if(!bbl_stream_flow_add(ctx, stream)) {
                     LOG(ERROR, "Failed to insert stream %s\n", config->name);
                     free(stream);
                     return false;
                 }
-                *result.datum_ptr = stream;
                 if(config->threaded) {
                     thread = bbl_stream_add_to_thread(ctx, config->thread_group, stream);
                     if(!thread) {
@@ -1399,10 +2204,12 @@ bbl_stream_raw_add(bbl_ctx_s *ctx) {
                         return false;
                     }
                     timer_add_periodic(&thread->timer_root, &stream->timer, config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job_threaded);
-                    timer_add_periodic(&thread->timer_root, &stream->timer_rate, "Threaded Rate Computation", 1, 0, stream, &bbl_stream_rate_job_threaded);
                 } else {
                     timer_add_periodic(&ctx->timer_root, &stream->timer, config->name, timer_sec, timer_nsec, stream, &bbl_stream_tx_job);
-                    timer_add_periodic(&ctx->timer_root, &stream->timer_rate, "Rate Computation", 1, 0, stream, &bbl_stream_rate_job);
+                    if(!bbl_stream_rate_sweep_add(ctx, stream)) {
+                        LOG(ERROR, "Failed to add rates of stream %s\n", config->name);
+                        return false;
+                    }
                 }
                 ctx->stats.stream_traffic_flows++;
                 LOG(DEBUG, "RAW traffic stream %s added in downstream with %lf PPS (timer %lu sec %lu nsec)\n", config->name, config->pps, timer_sec, timer_nsec);
@@ -1418,12 +2225,29 @@ json_t *
 bbl_stream_json(bbl_stream *stream)
 {
     json_t *root = NULL;
+    bbl_delay_stats_s delay = {0};
+    uint64_t tx_bps_l2;
+    uint64_t rx_bps_l2;
+    uint64_t rx_bps_l3;
+    uint64_t bursts;
 
     if(!stream) {
         return NULL;
     }
 
-    root = json_pack("{ss* ss si si si si si si si si si si si si si si si si si si sf sf sf}",
+    /* The layer 3 rate is derived from the layer 2 rate and the
+     * constant encapsulation overhead of the received packets. */
+    tx_bps_l2 = STREAM_COUNTER_GET(stream->rate_bytes_tx.avg) * 8;
+    rx_bps_l2 = stream->rate_bytes_rx.avg * 8;
+    rx_bps_l3 = rx_bps_l2;
+    if(stream->rx_len > stream->rx_l3_len) {
+        rx_bps_l3 -= stream->rate_packets_rx.avg * (stream->rx_len - stream->rx_l3_len) * 8;
+        if(rx_bps_l3 > rx_bps_l2) rx_bps_l3 = 0;
+    }
+
+    bbl_delay_stats_add(&delay, &stream->rx_delay);
+
+    root = json_pack("{ss* ss si si si si si si si si si si si si si si si si si si si si si si si si si si si si sf sf sf sf}",
         "name", stream->config->name,
         "direction", stream->direction == STREAM_DIRECTION_UP ? "upstream" : "downstream",
         "flow-id", stream->flow_id,
@@ -1435,18 +2259,29 @@ bbl_stream_json(bbl_stream *stream)
         "rx-len", stream->rx_len,
         "tx-len", stream->tx_len,
         "rx-packets", stream->packets_rx,
-        "tx-packets", stream->packets_tx,
+        "tx-packets", STREAM_COUNTER_GET(stream->packets_tx),
         "rx-loss", stream->loss,
-        "rx-delay-nsec-min", stream->min_delay_ns,
-        "rx-delay-nsec-max", stream->max_delay_ns,
+        "rx-reordered", stream->rx_reordered,
+        "rx-duplicate", stream->rx_duplicate,
+        "rx-late", stream->rx_late,
+        "rx-payload-verified", stream->payload_verified,
+        "rx-payload-errors", stream->payload_errors,
+        "rx-delay-nsec-min", delay.min_ns,
+        "rx-delay-nsec-avg", delay.packets ? delay.sum_ns / delay.packets : 0,
+        "rx-delay-nsec-max", delay.max_ns,
+        "rx-delay-nsec-p50", bbl_delay_stats_percentile(&delay, 50.0),
+        "rx-delay-nsec-p99", bbl_delay_stats_percentile(&delay, 99.0),
+        "rx-delay-nsec-p999", bbl_delay_stats_percentile(&delay, 99.9),
+        "rx-jitter-nsec", delay.jitter_sum_ns,
         "rx-pps", stream->rate_packets_rx.avg,
-        "tx-pps", stream->rate_packets_tx.avg,
-        "tx-bps-l2", stream->rate_packets_tx.avg * stream->tx_len * 8,
-        "rx-bps-l2", stream->rate_packets_rx.avg * stream->rx_len * 8,
-        "rx-bps-l3", stream->rate_packets_rx.avg * stream->config->length * 8,
-        "tx-mbps-l2", (double)(stream->rate_packets_tx.avg * stream->tx_len * 8) / 1000000.0,
-        "rx-mbps-l2", (double)(stream->rate_packets_rx.avg * stream->rx_len * 8) / 1000000.0,
-        "rx-mbps-l3", (double)(stream->rate_packets_rx.avg * stream->config->length * 8) / 1000000.0);
+        "tx-pps", STREAM_COUNTER_GET(stream->rate_packets_tx.avg),
+        "tx-bps-l2", tx_bps_l2,
+        "rx-bps-l2", rx_bps_l2,
+        "rx-bps-l3", rx_bps_l3,
+        "tx-mbps-l2", (double)tx_bps_l2 / 1000000.0,
+        "rx-mbps-l2", (double)rx_bps_l2 / 1000000.0,
+        "rx-mbps-l3", (double)rx_bps_l3 / 1000000.0,
+        "pps", stream->pps);
 
     if(stream->config->rx_mpls1) { 
         json_object_set(root, "rx-mpls1-expected", json_integer(stream->config->rx_mpls1_label));
@@ -1465,5 +2300,52 @@ bbl_stream_json(bbl_stream *stream)
         json_object_set(root, "rx-mpls2-exp", json_integer(stream->rx_mpls2_exp));
         json_object_set(root, "rx-mpls2-ttl", json_integer(stream->rx_mpls2_ttl));
     }
+    json_object_set(root, "tx-deficit", json_integer(STREAM_COUNTER_GET(stream->tx_deficit)));
+    json_object_set(root, "tx-deficit-max", json_integer(STREAM_COUNTER_GET(stream->tx_deficit_max)));
+    json_object_set(root, "tx-lag-nsec-max", json_integer(STREAM_COUNTER_GET(stream->tx_lag_max_ns)));
+    json_object_set(root, "tx-capped", json_integer(STREAM_COUNTER_GET(stream->tx_capped)));
+    if(stream->config->burst_size) {
+        bursts = STREAM_COUNTER_GET(stream->tx_bursts);
+        json_object_set(root, "tx-bursts", json_integer(bursts));
+        json_object_set(root, "tx-burst-size", json_integer(stream->config->burst_size));
+        json_object_set(root, "tx-burst-size-min", json_integer(STREAM_COUNTER_GET(stream->tx_burst_min)));
+        json_object_set(root, "tx-burst-size-avg", json_integer(bursts ? STREAM_COUNTER_GET(stream->packets_tx) / bursts : 0));
+        json_object_set(root, "tx-burst-size-max", json_integer(STREAM_COUNTER_GET(stream->tx_burst_max)));
+    }
     return root;
-}
\ No newline at end of file
+}
+
+/**
+ * bbl_stream_thread_json
+ *
+ * Return TX counters of all stream threads.
+ *
+ * @param ctx global context
+ * @return JSON array or NULL without stream threads
+ */
+json_t *
+bbl_stream_thread_json(bbl_ctx_s *ctx) {
+    bbl_stream_thread *thread = ctx->stream_thread;
+    json_t *jobj_array;
+    json_t *jobj_sub;
+
+    if(!thread) {
+        return NULL;
+    }
+    jobj_array = json_array();
+    while(thread) {
+        jobj_sub = json_pack("{si si sI sI sI sI sI}",
+            "thread-group", thread->thread_group,
+            "streams", thread->stream_count,
+            "tx-packets", STREAM_COUNTER_GET(thread->packets_tx),
+            "tx-bytes", STREAM_COUNTER_GET(thread->bytes_tx),
+            "tx-sendto-failed", STREAM_COUNTER_GET(thread->sendto_failed),
+            "tx-capped", STREAM_COUNTER_GET(thread->tx_capped),
+            "tx-lag-nsec-max", STREAM_COUNTER_GET(thread->tx_lag_max_ns));
+        if(jobj_sub) {
+            json_array_append(jobj_array, jobj_sub);
+        }
+        thread = thread->next;
+    }
+    return jobj_array;
+}
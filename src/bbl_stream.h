@@ -15,6 +15,38 @@ typedef enum {
     STREAM_IPV6PD,  /* From/to delegated IPv6 address */
 } __attribute__ ((__packed__)) bbl_stream_type_t;
 
+/* Counters of threaded streams have a single writer and
+ * are published to other threads with relaxed atomics. */
+#define STREAM_COUNTER_ADD(_counter, _value) \
+    __atomic_store_n(&(_counter), (_counter) + (_value), __ATOMIC_RELAXED)
+#define STREAM_COUNTER_GET(_counter) \
+    __atomic_load_n(&(_counter), __ATOMIC_RELAXED)
+
+#define STREAM_THREAD_QUEUE_SIZE 4096 /* must be a power of two */
+#define STREAM_THREAD_SYNC_INTERVAL 1 /* sec */
+
+/* Sliding window of received sequence numbers used to
+ * detect reordered and duplicate packets (RFC 4737). */
+#define STREAM_SEQ_WINDOW 1024 /* must be a multiple of 64 and power of two */
+
+#define STREAM_IMIX_MAX 64 /* max number of lengths per stream */
+#define STREAM_IMIX_SEQUENCE_MAX 4096 /* max sum of IMIX weights */
+
+#define STREAM_RATE_PROFILE_MAX 1024 /* max number of rate profile points */
+
+#define STREAM_BURST_MAX 1024 /* max number of packets per burst */
+
+/* Warn if a stream remains more than one second
+ * behind its schedule, which means that the BNG
+ * Blaster can't send the configured rate. */
+#define STREAM_LAG_WARNING 1000000000 /* nsec */
+
+typedef enum {
+    STREAM_MSG_START = 1,   /* Start sending with packet template */
+    STREAM_MSG_STOP,        /* Stop sending and free packet template */
+    STREAM_MSG_RATE,        /* Change stream rate */
+} __attribute__ ((__packed__)) bbl_stream_msg_type_t;
+
 typedef enum {
     STREAM_DIRECTION_UP     = 1,
     STREAM_DIRECTION_DOWN   = 2,
@@ -33,7 +65,7 @@ typedef struct bbl_stream_config_
     uint32_t max_packets;
     uint32_t start_delay;
 
-    uint16_t length;
+    uint16_t length; /* average length of IMIX streams */
     uint8_t  priority; /* IPv4 TOS or IPv6 TC */
     uint8_t  vlan_priority;
 
@@ -65,6 +97,33 @@ typedef struct bbl_stream_config_
     bool threaded;
     uint8_t thread_group;
 
+    uint8_t payload_pattern; /* BBL_PADDING_* */
+    uint32_t payload_verify; /* verify payload of every Nth packet */
+
+    /* IMIX streams send packets with different lengths
+     * in the order defined by the IMIX sequence of length
+     * indexes, which interleaves lengths by weight. */
+    uint8_t  imix_count;
+    uint16_t imix_length[STREAM_IMIX_MAX];
+    uint16_t imix_weight[STREAM_IMIX_MAX];
+    uint8_t *imix_sequence;
+    uint16_t imix_sequence_len;
+
+    /* The rate of streams with rate profile follows the
+     * (time offset, pps) points of the profile, starting
+     * with the first packet sent. The pps of the stream
+     * is the max pps of all points. */
+    uint16_t rate_profile_count;
+    double *rate_profile_time; /* time offset in seconds */
+    double *rate_profile_pps;
+    double *rate_profile_packets; /* packets to be sent until point */
+    bool rate_profile_linear; /* linear interpolation between points */
+    bool rate_profile_repeat; /* repeat profile after last point */
+
+    /* Burst streams send burst-size packets back to back
+     * every burst-size/pps seconds (same average rate). */
+    uint16_t burst_size;
+
     bbl_stream_config *next; /* Next stream config */
 } bbl_stream_config;
 
@@ -74,7 +133,6 @@ typedef struct bbl_stream_
     uint64_t flow_seq;
 
     struct timer_ *timer;
-    struct timer_ *timer_rate;
 
     bbl_stream_config *config;
     bbl_stream_direction_t direction;
@@ -83,14 +141,35 @@ typedef struct bbl_stream_
     bbl_session_s *session;
 
     uint8_t *buf;
+    uint16_t length; /* layer 3 length of packet to be built */
+    uint16_t length_override; /* runtime length replacing config->length */
     uint16_t tx_len;
+    bbl_template_t tx_template;
+    bbl_template_t *imix_template; /* one template per IMIX length */
+    uint16_t imix_cursor; /* position in IMIX sequence */
     uint16_t rx_len;
+    uint16_t rx_l3_len;
     uint64_t rx_first_seq;
-    uint64_t rx_last_seq;
+    uint64_t rx_last_seq; /* highest sequence number received */
 
+    double pps; /* current rate, initialised from config */
     uint64_t tx_interval; /* TX interval in nsec */
     uint64_t send_window_packets;
     struct timespec send_window_start;
+    struct timespec rate_profile_start;
+
+    uint64_t tx_bursts; /* bursts sent */
+    uint64_t tx_burst_min; /* min packets sent in one burst */
+    uint64_t tx_burst_max; /* max packets sent in one burst */
+
+    /* TX schedule counters */
+    uint64_t tx_deficit; /* packets behind ideal schedule */
+    uint64_t tx_deficit_max;
+    uint64_t tx_lag_ns; /* time behind ideal schedule after last send window */
+    uint64_t tx_lag_max_ns; /* max time behind ideal schedule */
+    uint64_t tx_capped; /* send windows capped by io-stream-max-ppi */
+    uint64_t tx_lag_check_ns; /* lag at last lag check (main thread) */
+    bool tx_lag_warning; /* lag warning logged (main thread) */
 
     struct timespec wait_start;
     bool wait;
@@ -103,11 +182,20 @@ typedef struct bbl_stream_
     uint64_t packets_rx;
     uint64_t packets_tx_last_sync;
     uint64_t packets_rx_last_sync;
+    uint64_t bytes_tx; /* layer 2 */
+    uint64_t bytes_rx; /* layer 2 */
+    uint64_t bytes_tx_last_sync;
 
     uint64_t loss;
+    uint64_t rx_reordered; /* received after a higher sequence number */
+    uint64_t rx_duplicate; /* sequence number already received */
+    uint64_t rx_late; /* sequence number older than window */
 
-    uint64_t min_delay_ns;
-    uint64_t max_delay_ns;
+    uint16_t payload_offset; /* offset of padding in buf */
+    uint16_t payload_len;
+    uint32_t payload_verify_countdown;
+    uint64_t payload_verified;
+    uint64_t payload_errors;
 
     bool     rx_mpls1;
     uint32_t rx_mpls1_label;
@@ -121,18 +209,42 @@ typedef struct bbl_stream_
 
     bbl_rate_s rate_packets_tx;
     bbl_rate_s rate_packets_rx;
+    bbl_rate_s rate_bytes_tx;
+    bbl_rate_s rate_bytes_rx;
 
     bbl_stream *next; /* Next stream of same session */
 
-    /* Attributes used for threaded streams only! */
+    /* Attributes used for threaded streams only! The stream
+     * thread owns all TX attributes of the stream (flow_seq,
+     * packets_tx, bytes_tx, send window, rate profile start,
+     * burst counters, IMIX cursor and TX rates), the main
+     * thread owns all other attributes. */
     struct {
         bbl_stream_thread *thread;
         bbl_stream *next; /* Next stream in same thread */
-        pthread_mutex_t mutex;
-        bool can_send;
+        bool can_send; /* Main thread: start message sent */
+        bbl_template_t tx_template; /* Stream thread: copy of packet */
+        bbl_template_t *imix_template; /* Stream thread: copy of IMIX packets */
+        double pps; /* Stream thread: current rate */
+        uint8_t *burst_buf; /* Stream thread: packets of one burst */
+        struct iovec *burst_iov; /* Stream thread: one iovec per burst packet */
+        struct mmsghdr *burst_msg; /* Stream thread: one message per burst packet */
     } thread;
+
+    bbl_delay_s rx_delay; /* RX delay, jitter and delay histogram */
+    uint64_t rx_window[STREAM_SEQ_WINDOW/64]; /* RX sequence number bitmap */
 } bbl_stream;
 
+/* Control message from main thread to stream thread. */
+typedef struct bbl_stream_msg_
+{
+    bbl_stream_msg_type_t type;
+    bbl_stream *stream;
+    bbl_template_t tx_template; /* STREAM_MSG_START */
+    bbl_template_t *imix_template; /* STREAM_MSG_START */
+    double pps; /* STREAM_MSG_RATE */
+} bbl_stream_msg;
+
 /* Structure for traffic stream threads
  * with one or more streams. */
 typedef struct bbl_stream_thread_
@@ -143,11 +255,18 @@ typedef struct bbl_stream_thread_
      * one thread per stream. */
     uint8_t thread_group;
     pthread_t thread_id;
-    pthread_mutex_t mutex;
 
     /* True if thread is active! */
     bool active;
 
+    /* Single producer (main thread) single consumer
+     * (stream thread) queue for control messages. */
+    struct {
+        bbl_stream_msg msg[STREAM_THREAD_QUEUE_SIZE];
+        uint32_t head; /* written by main thread */
+        uint32_t tail; /* written by stream thread */
+    } queue;
+
     /* Root for thread local timers */
     struct timer_root_ timer_root;
 
@@ -155,6 +274,9 @@ typedef struct bbl_stream_thread_
      * counters with main counters. */
     struct timer_ *sync_timer;
 
+    /* Rate computation of all streams in group. */
+    bbl_rate_sweep_s rate_sweep;
+
     /* TX interface */
     bbl_interface_s *interface;
 
@@ -168,7 +290,8 @@ typedef struct bbl_stream_thread_
     bbl_stream *stream; /* First stream in group */
     bbl_stream *stream_tail; /* Last stream in group */
 
-    /* Thread counters ... */
+    /* Thread counters written by stream thread,
+     * the last sync values are owned by main thread. */
 
     uint64_t packets_tx;
     uint64_t packets_tx_last_sync;
@@ -178,9 +301,27 @@ typedef struct bbl_stream_thread_
     uint64_t sendto_failed;
     uint64_t sendto_failed_last_sync;
 
+    uint64_t tx_capped; /* send windows capped by io-stream-max-ppi */
+    uint64_t tx_lag_max_ns; /* max lag of all streams in group */
+
     void *next; /* Next stream thread */
 } bbl_stream_thread;
 
+bbl_stream *
+bbl_stream_get(bbl_ctx_s *ctx, uint64_t flow_id);
+
+bool
+bbl_stream_set_rate(bbl_stream *stream, double pps);
+
+bool
+bbl_stream_set_length(bbl_stream *stream, uint16_t length);
+
+void
+bbl_stream_rx_seq(bbl_ctx_s *ctx, bbl_stream *stream, uint64_t seq);
+
+void
+bbl_stream_rx_payload(bbl_stream *stream, bbl_bbl_t *bbl);
+
 bool
 bbl_stream_add(bbl_ctx_s *ctx, bbl_access_config_s *access_config, bbl_session_s *session);
 
@@ -193,10 +334,19 @@ bbl_stream_start_threads(bbl_ctx_s *ctx);
 void
 bbl_stream_stop_threads(bbl_ctx_s *ctx);
 
+void
+bbl_stream_sync_threads(bbl_ctx_s *ctx);
+
 void
 bbl_stream_tx_job(timer_s *timer);
 
+void
+bbl_stream_tx_job_threaded(timer_s *timer);
+
 json_t *
 bbl_stream_json(bbl_stream *stream);
 
+json_t *
+bbl_stream_thread_json(bbl_ctx_s *ctx);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,141 @@
+/*
+ * BNG Blaster (BBL) - Stream RX Accounting
+ *
+ * Copyright (C) 2020-2021, RtBrick, Inc.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "bbl.h"
+#include "bbl_stream.h"
+
+#define STREAM_SEQ_INDEX(_seq) ((_seq) & (STREAM_SEQ_WINDOW-1))
+#define STREAM_SEQ_BIT(_seq) (1ULL << ((_seq) & 63))
+#define STREAM_SEQ_WORD(_stream, _seq) (_stream)->rx_window[STREAM_SEQ_INDEX(_seq) >> 6]
+
+/**
+ * bbl_stream_rx_window_clear
+ *
+ * Clear count sequence numbers starting with seq
+ * in the RX sequence number bitmap. Whole words
+ * are cleared at once and only the first and last
+ * word are masked.
+ *
+ * @param stream traffic stream
+ * @param seq first sequence number to be cleared
+ * @param count number of sequence numbers (less than STREAM_SEQ_WINDOW)
+ */
+static void
+bbl_stream_rx_window_clear(bbl_stream *stream, uint64_t seq, uint64_t count) {
+    uint64_t idx = STREAM_SEQ_INDEX(seq);
+    uint64_t bits;
+    uint64_t mask;
+
+    while(count) {
+        bits = 64 - (idx & 63);
+        if(bits > count) {
+            bits = count;
+        }
+        if(bits == 64) {
+            mask = UINT64_MAX;
+        } else {
+            mask = ((1ULL << bits) - 1) << (idx & 63);
+        }
+        stream->rx_window[idx >> 6] &= ~mask;
+        idx = (idx + bits) & (STREAM_SEQ_WINDOW-1);
+        count -= bits;
+    }
+}
+
+/**
+ * bbl_stream_rx_seq
+ *
+ * Account sequence number of received stream packet.
+ *
+ * The highest sequence number received is stored as rx_last_seq
+ * and all sequence numbers in a window of STREAM_SEQ_WINDOW below
+ * are tracked in a bitmap. A gap is accounted as loss until the
+ * missing packet arrives within the window, which is then counted
+ * as reordered. Packets received before the first packet are
+ * counted as reordered without changing the loss, as they were
+ * never accounted as loss. Packets already received are counted
+ * as duplicate and packets older than the window as late (those
+ * remain loss).
+ *
+ * @param ctx global context
+ * @param stream traffic stream
+ * @param seq received sequence number
+ */
+void
+bbl_stream_rx_seq(bbl_ctx_s *ctx, bbl_stream *stream, uint64_t seq) {
+    uint64_t last = stream->rx_last_seq;
+    uint64_t gap;
+
+    if(!stream->rx_first_seq) {
+        stream->rx_first_seq = seq;
+        stream->rx_last_seq = seq;
+        STREAM_SEQ_WORD(stream, seq) |= STREAM_SEQ_BIT(seq);
+        ctx->stats.stream_traffic_flows_verified++;
+        return;
+    }
+    if(seq > last) {
+        gap = seq - last - 1;
+        if(gap) {
+            stream->loss += gap;
+            if(gap >= STREAM_SEQ_WINDOW) {
+                memset(stream->rx_window, 0x0, sizeof(stream->rx_window));
+            } else {
+                bbl_stream_rx_window_clear(stream, last + 1, gap);
+            }
+        }
+        STREAM_SEQ_WORD(stream, seq) |= STREAM_SEQ_BIT(seq);
+        stream->rx_last_seq = seq;
+    } else if(last - seq < STREAM_SEQ_WINDOW) {
+        if(STREAM_SEQ_WORD(stream, seq) & STREAM_SEQ_BIT(seq)) {
+            stream->rx_duplicate++;
+        } else {
+            STREAM_SEQ_WORD(stream, seq) |= STREAM_SEQ_BIT(seq);
+            stream->rx_reordered++;
+            if(seq > stream->rx_first_seq && stream->loss) {
+                stream->loss--;
+            }
+        }
+    } else {
+        stream->rx_late++;
+    }
+}
+
+/**
+ * bbl_stream_rx_payload
+ *
+ * Verify payload (BBL padding) of every Nth received stream
+ * packet against the padding of the stream packet template,
+ * which is filled with the configured payload pattern.
+ *
+ * @param stream traffic stream
+ * @param bbl received BBL header
+ */
+void
+bbl_stream_rx_payload(bbl_stream *stream, bbl_bbl_t *bbl) {
+    if(stream->payload_verify_countdown) {
+        stream->payload_verify_countdown--;
+        return;
+    }
+    stream->payload_verify_countdown = stream->config->payload_verify - 1;
+    if(!stream->buf) {
+        return;
+    }
+    stream->payload_verified++;
+    if(stream->config->imix_count) {
+        /* The stream packet is the largest IMIX packet. */
+        if(bbl->padding > stream->payload_len) {
+            stream->payload_errors++;
+            return;
+        }
+    } else if(bbl->padding != stream->payload_len) {
+        stream->payload_errors++;
+        return;
+    }
+    if(memcmp(bbl->padding_data, stream->buf + stream->payload_offset, bbl->padding) != 0) {
+        stream->payload_errors++;
+    }
+}
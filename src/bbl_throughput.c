@@ -0,0 +1,384 @@
+/*
+ * BNG Blaster (BBL) - Throughput Search (RFC 2544)
+ *
+ * The throughput search runs timed trials with all traffic
+ * streams and searches per length the highest rate without
+ * loss (or with loss below the configured tolerance) using
+ * binary search. The rate is given in percent of the configured
+ * stream bandwidth (pps and length), so that the stream pps is
+ * scaled up for lengths smaller than the configured length.
+ *
+ * Copyright (C) 2020-2021, RtBrick, Inc.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "bbl.h"
+#include "bbl_stream.h"
+#include "bbl_throughput.h"
+
+extern volatile bool g_teardown;
+extern volatile bool g_teardown_request;
+extern bool g_init_phase;
+
+static void
+bbl_throughput_counters(bbl_ctx_s *ctx, uint64_t *packets_tx, uint64_t *packets_rx, uint64_t *bytes_tx) {
+    struct dict_itor *itor;
+    bbl_stream *stream;
+
+    *packets_tx = 0;
+    *packets_rx = 0;
+    *bytes_tx = 0;
+
+    itor = dict_itor_new(ctx->stream_flow_dict);
+    dict_itor_first(itor);
+    for (; dict_itor_valid(itor); dict_itor_next(itor)) {
+        stream = (bbl_stream*)*dict_itor_datum(itor);
+        *packets_tx += STREAM_COUNTER_GET(stream->packets_tx);
+        *packets_rx += stream->packets_rx;
+        *bytes_tx += STREAM_COUNTER_GET(stream->bytes_tx);
+    }
+    dict_itor_free(itor);
+}
+
+/**
+ * bbl_throughput_apply
+ *
+ * Apply length and rate of the current trial to all
+ * streams or restore the configured length and rate.
+ *
+ * @param ctx global context
+ * @param search throughput search
+ * @param restore restore configured length and rate
+ */
+static void
+bbl_throughput_apply(bbl_ctx_s *ctx, bbl_throughput_s *search, bool restore) {
+    struct dict_itor *itor;
+    bbl_stream *stream;
+    bbl_stream_config *config;
+    uint16_t length = 0;
+    double pps;
+
+    if(!restore) {
+        length = search->length[search->cursor];
+    }
+
+    itor = dict_itor_new(ctx->stream_flow_dict);
+    dict_itor_first(itor);
+    for (; dict_itor_valid(itor); dict_itor_next(itor)) {
+        stream = (bbl_stream*)*dict_itor_datum(itor);
+        config = stream->config;
+        pps = config->pps;
+        if(!restore) {
+            pps *= search->rate / 100.0;
+            if(bbl_stream_set_length(stream, length) && length) {
+                /* Keep the bandwidth of the configured length. */
+                pps *= (double)config->length / (double)length;
+            }
+        } else {
+            bbl_stream_set_length(stream, 0);
+        }
+        if(!bbl_stream_set_rate(stream, pps)) {
+            LOG(ERROR, "Failed to change rate of stream %s\n", config->name);
+        }
+    }
+    dict_itor_free(itor);
+}
+
+static void
+bbl_throughput_length_init(bbl_throughput_s *search) {
+    search->rate = search->rate_max;
+    search->rate_low = search->rate_min;
+    search->rate_high = search->rate_max;
+    search->result[search->cursor].length = search->length[search->cursor];
+}
+
+/**
+ * bbl_throughput_evaluate
+ *
+ * Evaluate the last trial and compute the rate of the next trial.
+ *
+ * @param ctx global context
+ * @param search throughput search
+ * @return true if search for current length is finished
+ */
+static bool
+bbl_throughput_evaluate(bbl_ctx_s *ctx, bbl_throughput_s *search) {
+    bbl_throughput_result_s *result = &search->result[search->cursor];
+    struct timespec time_diff;
+    uint64_t packets_tx;
+    uint64_t packets_rx;
+    uint64_t bytes_tx;
+    double loss = 100.0;
+    double time;
+    bool pass;
+
+    bbl_throughput_counters(ctx, &packets_tx, &packets_rx, &bytes_tx);
+    packets_tx -= search->packets_tx_start;
+    packets_rx -= search->packets_rx_start;
+    bytes_tx -= search->bytes_tx_start;
+
+    /* Traffic start and stop is passed to stream threads
+     * with a short delay, therefore the measured trial time
+     * is used to compute the rate. */
+    timespec_sub(&time_diff, &search->trial_stop, &search->trial_start);
+    time = time_diff.tv_sec + (double)time_diff.tv_nsec / 1e9;
+    if(time <= 0) {
+        time = search->trial_time;
+    }
+
+    if(packets_tx) {
+        loss = 0;
+        if(packets_tx > packets_rx) {
+            loss = (double)(packets_tx - packets_rx) * 100.0 / (double)packets_tx;
+        }
+    }
+    pass = packets_tx && loss <= search->loss_tolerance;
+    result->trials++;
+
+    LOG(INFO, "Throughput trial %u length %u rate %.2f%% %s (tx: %lu rx: %lu loss: %.4f%%)\n",
+        result->trials, result->length, search->rate, pass ? "passed" : "failed",
+        packets_tx, packets_rx, loss);
+
+    if(pass) {
+        if(!result->found || search->rate > result->rate) {
+            result->found = true;
+            result->rate = search->rate;
+            result->time = time;
+            result->packets_tx = packets_tx;
+            result->packets_rx = packets_rx;
+            result->bytes_tx = bytes_tx;
+            result->loss = loss;
+        }
+        search->rate_low = search->rate;
+        if(search->rate >= search->rate_max) {
+            return true;
+        }
+    } else {
+        search->rate_high = search->rate;
+    }
+    if(search->rate_high - search->rate_low <= search->rate_resolution) {
+        return true;
+    }
+    search->rate = (search->rate_low + search->rate_high) / 2.0;
+    return false;
+}
+
+static void
+bbl_throughput_teardown(bbl_throughput_s *search) {
+    if(search->teardown) {
+        g_teardown = true;
+        g_teardown_request = true;
+        LOG(INFO, "Teardown request\n");
+    }
+}
+
+static void
+bbl_throughput_abort(bbl_ctx_s *ctx, bbl_throughput_s *search) {
+    search->state = THROUGHPUT_ABORTED;
+    timer_del(search->timer);
+    LOG(ERROR, "Throughput search aborted, only %u of %u flows verified within %us\n",
+        ctx->stats.stream_traffic_flows_verified, ctx->stats.stream_traffic_flows,
+        search->verify_timeout);
+    bbl_throughput_teardown(search);
+}
+
+static void
+bbl_throughput_finish(bbl_ctx_s *ctx, bbl_throughput_s *search) {
+    search->state = THROUGHPUT_DONE;
+    timer_del(search->timer);
+    bbl_throughput_apply(ctx, search, true);
+    LOG(INFO, "Throughput search finished\n");
+    if(search->teardown) {
+        bbl_throughput_teardown(search);
+    } else {
+        enable_disable_traffic(ctx, true);
+    }
+}
+
+/**
+ * bbl_throughput_job
+ *
+ * Throughput search state machine executed every second.
+ * Traffic is stopped between trials for the drain time,
+ * so that packets in flight at the end of a trial are
+ * received before the loss is evaluated. The search is
+ * aborted if no further stream flow is verified within
+ * the verify timeout.
+ */
+static void
+bbl_throughput_job(timer_s *timer) {
+    bbl_ctx_s *ctx = timer->data;
+    bbl_throughput_s *search = ctx->throughput;
+
+    if(g_teardown) {
+        search->state = THROUGHPUT_DONE;
+        timer_del(search->timer);
+        return;
+    }
+
+    switch(search->state) {
+        case THROUGHPUT_WAIT:
+            if(g_init_phase) {
+                return;
+            }
+            if(!ctx->stats.stream_traffic_flows ||
+               ctx->stats.stream_traffic_flows_verified < ctx->stats.stream_traffic_flows) {
+                if(ctx->stats.stream_traffic_flows_verified != search->verified_last) {
+                    search->verified_last = ctx->stats.stream_traffic_flows_verified;
+                    search->verify_wait = 0;
+                } else if(++search->verify_wait >= search->verify_timeout) {
+                    bbl_throughput_abort(ctx, search);
+                }
+                return;
+            }
+            LOG(INFO, "Throughput search started with %u verified flows\n", ctx->stats.stream_traffic_flows_verified);
+            enable_disable_traffic(ctx, false);
+            search->cursor = 0;
+            bbl_throughput_length_init(search);
+            search->state = THROUGHPUT_DRAIN;
+            search->countdown = search->drain_time;
+            break;
+        case THROUGHPUT_DRAIN:
+            if(--search->countdown) {
+                return;
+            }
+            if(search->trial_done) {
+                search->trial_done = false;
+                if(bbl_throughput_evaluate(ctx, search)) {
+                    search->cursor++;
+                    if(search->cursor >= search->length_count) {
+                        bbl_throughput_finish(ctx, search);
+                        return;
+                    }
+                    bbl_throughput_length_init(search);
+                }
+            }
+            bbl_throughput_apply(ctx, search, false);
+            bbl_throughput_counters(ctx, &search->packets_tx_start, &search->packets_rx_start, &search->bytes_tx_start);
+            enable_disable_traffic(ctx, true);
+            clock_gettime(CLOCK_MONOTONIC, &search->trial_start);
+            search->state = THROUGHPUT_TRIAL;
+            search->countdown = search->trial_time;
+            break;
+        case THROUGHPUT_TRIAL:
+            if(--search->countdown) {
+                return;
+            }
+            enable_disable_traffic(ctx, false);
+            clock_gettime(CLOCK_MONOTONIC, &search->trial_stop);
+            search->trial_done = true;
+            search->state = THROUGHPUT_DRAIN;
+            search->countdown = search->drain_time;
+            break;
+        default:
+            break;
+    }
+}
+
+void
+bbl_throughput_start(bbl_ctx_s *ctx) {
+    bbl_throughput_s *search = ctx->throughput;
+
+    if(search) {
+        timer_add_periodic(&ctx->timer_root, &search->timer, "Throughput Search", 1, 0, ctx, &bbl_throughput_job);
+    }
+}
+
+static const char *
+bbl_throughput_state_string(bbl_throughput_state_t state) {
+    switch(state) {
+        case THROUGHPUT_WAIT: return "wait";
+        case THROUGHPUT_DRAIN: return "drain";
+        case THROUGHPUT_TRIAL: return "trial";
+        case THROUGHPUT_DONE: return "done";
+        case THROUGHPUT_ABORTED: return "aborted";
+        default: return "unknown";
+    }
+}
+
+json_t *
+bbl_throughput_json(bbl_ctx_s *ctx) {
+    bbl_throughput_s *search = ctx->throughput;
+    bbl_throughput_result_s *result;
+    json_t *root;
+    json_t *jobj_array;
+    json_t *jobj_sub;
+    uint8_t i;
+
+    if(!search) {
+        return NULL;
+    }
+
+    jobj_array = json_array();
+    for(i = 0; i < search->length_count; i++) {
+        result = &search->result[i];
+        if(!result->trials) {
+            continue;
+        }
+        jobj_sub = json_object();
+        json_object_set(jobj_sub, "length", json_integer(result->length));
+        json_object_set(jobj_sub, "passed", json_boolean(result->found));
+        json_object_set(jobj_sub, "rate", json_real(result->rate));
+        json_object_set(jobj_sub, "trials", json_integer(result->trials));
+        json_object_set(jobj_sub, "tx-packets", json_integer(result->packets_tx));
+        json_object_set(jobj_sub, "rx-packets", json_integer(result->packets_rx));
+        json_object_set(jobj_sub, "loss", json_real(result->loss));
+        json_object_set(jobj_sub, "time", json_real(result->time));
+        if(result->found) {
+            json_object_set(jobj_sub, "tx-pps", json_integer(result->packets_tx / result->time));
+            json_object_set(jobj_sub, "tx-bps-l2", json_integer(result->bytes_tx * 8 / result->time));
+        }
+        json_array_append(jobj_array, jobj_sub);
+    }
+
+    root = json_object();
+    json_object_set(root, "state", json_string(bbl_throughput_state_string(search->state)));
+    json_object_set(root, "trial-time", json_integer(search->trial_time));
+    json_object_set(root, "drain-time", json_integer(search->drain_time));
+    json_object_set(root, "verify-timeout", json_integer(search->verify_timeout));
+    json_object_set(root, "loss-tolerance", json_real(search->loss_tolerance));
+    json_object_set(root, "rate-min", json_real(search->rate_min));
+    json_object_set(root, "rate-max", json_real(search->rate_max));
+    json_object_set(root, "rate-resolution", json_real(search->rate_resolution));
+    json_object_set(root, "results", jobj_array);
+    return root;
+}
+
+void
+bbl_throughput_stdout(bbl_ctx_s *ctx) {
+    bbl_throughput_s *search = ctx->throughput;
+    bbl_throughput_result_s *result;
+    uint8_t i;
+
+    if(!search) {
+        return;
+    }
+
+    printf("\nThroughput Search (RFC 2544):\n");
+    printf("  Trial Time: %us Drain Time: %us Loss Tolerance: %.4f%%\n",
+        search->trial_time, search->drain_time, search->loss_tolerance);
+    if(search->state == THROUGHPUT_ABORTED) {
+        printf("  Aborted: %u of %u flows verified within %us\n",
+            ctx->stats.stream_traffic_flows_verified, ctx->stats.stream_traffic_flows,
+            search->verify_timeout);
+    }
+    for(i = 0; i < search->length_count; i++) {
+        result = &search->result[i];
+        if(!result->trials) {
+            continue;
+        }
+        if(result->length) {
+            printf("  Length %5u ", result->length);
+        } else {
+            printf("  Length  conf ");
+        }
+        if(result->found) {
+            printf("Rate: %6.2f%% TX: %10lu PPS %10.2f Mbps Loss: %.4f%% Trials: %u\n",
+                result->rate, (uint64_t)(result->packets_tx / result->time),
+                (double)result->bytes_tx * 8 / result->time / 1000000.0,
+                result->loss, result->trials);
+        } else {
+            printf("Rate: failed Trials: %u\n", result->trials);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * BNG Blaster (BBL) - Throughput Search (RFC 2544)
+ *
+ * Copyright (C) 2020-2021, RtBrick, Inc.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __BBL_THROUGHPUT_H__
+#define __BBL_THROUGHPUT_H__
+
+#define BBL_THROUGHPUT_LENGTHS_MAX 16
+
+typedef enum {
+    THROUGHPUT_WAIT = 0,    /* Wait for all stream flows verified */
+    THROUGHPUT_DRAIN,       /* Traffic stopped, wait for packets in flight */
+    THROUGHPUT_TRIAL,       /* Traffic running at trial rate */
+    THROUGHPUT_DONE,
+    THROUGHPUT_ABORTED,     /* Stream flows not verified */
+} __attribute__ ((__packed__)) bbl_throughput_state_t;
+
+typedef struct bbl_throughput_result_
+{
+    uint16_t length; /* stream length or zero for configured lengths */
+    bool found; /* true if at least one trial passed */
+    double rate; /* highest passed rate in percent */
+    double time; /* measured duration of trial in sec */
+    uint32_t trials;
+
+    /* Counters of the highest passed trial */
+    uint64_t packets_tx;
+    uint64_t packets_rx;
+    uint64_t bytes_tx;
+    double loss; /* loss in percent */
+} bbl_throughput_result_s;
+
+typedef struct bbl_throughput_
+{
+    /* Config */
+    uint16_t trial_time; /* sec */
+    uint16_t drain_time; /* sec */
+    uint16_t verify_timeout; /* sec */
+    double loss_tolerance; /* percent */
+    double rate_min; /* percent */
+    double rate_max; /* percent */
+    double rate_resolution; /* percent */
+    bool teardown; /* teardown after search */
+
+    uint8_t length_count;
+    uint16_t length[BBL_THROUGHPUT_LENGTHS_MAX];
+
+    /* State */
+    bbl_throughput_state_t state;
+    struct timer_ *timer;
+    uint16_t countdown; /* sec */
+    uint16_t verify_wait; /* sec since last verified flow */
+    uint32_t verified_last; /* verified flows of last check */
+    struct timespec trial_start;
+    struct timespec trial_stop;
+    bool trial_done; /* trial waiting for evaluation */
+    uint8_t cursor; /* current length */
+    double rate; /* current trial rate in percent */
+    double rate_low;
+    double rate_high;
+
+    uint64_t packets_tx_start;
+    uint64_t packets_rx_start;
+    uint64_t bytes_tx_start;
+
+    bbl_throughput_result_s result[BBL_THROUGHPUT_LENGTHS_MAX];
+} bbl_throughput_s;
+
+void
+bbl_throughput_start(bbl_ctx_s *ctx);
+
+json_t *
+bbl_throughput_json(bbl_ctx_s *ctx);
+
+void
+bbl_throughput_stdout(bbl_ctx_s *ctx);
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "bbl.h"
 #include "bbl_session.h"
+#include "bbl_session_traffic.h"
 #include "bbl_dhcp.h"
 #include "bbl_dhcpv6.h"
 
@@ -33,12 +34,8 @@ bbl_encode_packet_session_ipv4 (bbl_session_s *session)
     session->stats.access_ipv4_tx++;
     interface->stats.session_ipv4_tx++;
 
-    memcpy(session->write_buf, session->access_ipv4_tx_packet_template, session->access_ipv4_tx_packet_len);
-    session->write_idx = session->access_ipv4_tx_packet_len;
-
-    *(uint64_t*)(session->write_buf + (session->access_ipv4_tx_packet_len - 16)) = session->access_ipv4_tx_seq++;
-    *(uint32_t*)(session->write_buf + (session->access_ipv4_tx_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-    *(uint32_t*)(session->write_buf + (session->access_ipv4_tx_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
+    session->write_idx = bbl_template_write(&session->access_ipv4_tx_template, session->write_buf,
+                                            session->access_ipv4_tx_seq++, &interface->tx_timestamp);
     return PROTOCOL_SUCCESS;
 }
 
@@ -62,12 +59,8 @@ bbl_encode_packet_session_ipv6 (bbl_session_s *session)
     session->stats.access_ipv6_tx++;
     interface->stats.session_ipv6_tx++;
 
-    memcpy(session->write_buf, session->access_ipv6_tx_packet_template, session->access_ipv6_tx_packet_len);
-    session->write_idx = session->access_ipv6_tx_packet_len;
-
-    *(uint64_t*)(session->write_buf + (session->access_ipv6_tx_packet_len - 16)) = session->access_ipv6_tx_seq++;
-    *(uint32_t*)(session->write_buf + (session->access_ipv6_tx_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-    *(uint32_t*)(session->write_buf + (session->access_ipv6_tx_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
+    session->write_idx = bbl_template_write(&session->access_ipv6_tx_template, session->write_buf,
+                                            session->access_ipv6_tx_seq++, &interface->tx_timestamp);
     return PROTOCOL_SUCCESS;
 }
 
@@ -91,12 +84,8 @@ bbl_encode_packet_session_ipv6pd (bbl_session_s *session)
     session->stats.access_ipv6pd_tx++;
     interface->stats.session_ipv6pd_tx++;
 
-    memcpy(session->write_buf, session->access_ipv6pd_tx_packet_template, session->access_ipv6pd_tx_packet_len);
-    session->write_idx = session->access_ipv6pd_tx_packet_len;
-
-    *(uint64_t*)(session->write_buf + (session->access_ipv6pd_tx_packet_len - 16)) = session->access_ipv6pd_tx_seq++;
-    *(uint32_t*)(session->write_buf + (session->access_ipv6pd_tx_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-    *(uint32_t*)(session->write_buf + (session->access_ipv6pd_tx_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
+    session->write_idx = bbl_template_write(&session->access_ipv6pd_tx_template, session->write_buf,
+                                            session->access_ipv6pd_tx_seq++, &interface->tx_timestamp);
     return PROTOCOL_SUCCESS;
 }
 
@@ -123,12 +112,8 @@ bbl_encode_packet_network_session_ipv4 (bbl_interface_s *interface, bbl_session_
         session->l2tp_session->stats.data_ipv4_tx++;
     }
 
-    memcpy(session->write_buf, session->network_ipv4_tx_packet_template, session->network_ipv4_tx_packet_len);
-    session->write_idx = session->network_ipv4_tx_packet_len;
-
-    *(uint64_t*)(session->write_buf + (session->network_ipv4_tx_packet_len - 16)) = session->network_ipv4_tx_seq++;
-    *(uint32_t*)(session->write_buf + (session->network_ipv4_tx_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-    *(uint32_t*)(session->write_buf + (session->network_ipv4_tx_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
+    session->write_idx = bbl_template_write(&session->network_ipv4_tx_template, session->write_buf,
+                                            session->network_ipv4_tx_seq++, &interface->tx_timestamp);
     return PROTOCOL_SUCCESS;
 }
 
@@ -149,12 +134,8 @@ bbl_encode_packet_network_session_ipv6 (bbl_interface_s *interface, bbl_session_
     session->stats.network_ipv6_tx++;
     interface->stats.session_ipv6_tx++;
 
-    memcpy(session->write_buf, session->network_ipv6_tx_packet_template, session->network_ipv6_tx_packet_len);
-    session->write_idx = session->network_ipv6_tx_packet_len;
-
-    *(uint64_t*)(session->write_buf + (session->network_ipv6_tx_packet_len - 16)) = session->network_ipv6_tx_seq++;
-    *(uint32_t*)(session->write_buf + (session->network_ipv6_tx_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-    *(uint32_t*)(session->write_buf + (session->network_ipv6_tx_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
+    session->write_idx = bbl_template_write(&session->network_ipv6_tx_template, session->write_buf,
+                                            session->network_ipv6_tx_seq++, &interface->tx_timestamp);
     return PROTOCOL_SUCCESS;
 }
 
@@ -175,12 +156,8 @@ bbl_encode_packet_network_session_ipv6pd (bbl_interface_s *interface, bbl_sessio
     session->stats.network_ipv6pd_tx++;
     interface->stats.session_ipv6pd_tx++;
 
-    memcpy(session->write_buf, session->network_ipv6pd_tx_packet_template, session->network_ipv6pd_tx_packet_len);
-    session->write_idx = session->network_ipv6pd_tx_packet_len;
-
-    *(uint64_t*)(session->write_buf + (session->network_ipv6pd_tx_packet_len - 16)) = session->network_ipv6pd_tx_seq++;
-    *(uint32_t*)(session->write_buf + (session->network_ipv6pd_tx_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-    *(uint32_t*)(session->write_buf + (session->network_ipv6pd_tx_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
+    session->write_idx = bbl_template_write(&session->network_ipv6pd_tx_template, session->write_buf,
+                                            session->network_ipv6pd_tx_seq++, &interface->tx_timestamp);
     return PROTOCOL_SUCCESS;
 }
 
@@ -203,7 +180,7 @@ bbl_igmp_timeout(timer_s *timer)
         }
     }
 
-    for(i=0; i < IGMP_MAX_GROUPS; i++) {
+    for(i=0; i < session->igmp_group_count; i++) {
         group = &session->igmp_groups[i];
         if(group->state == IGMP_GROUP_JOINING) {
             if(group->robustness_count) {
@@ -288,8 +265,12 @@ bbl_encode_packet_igmp (bbl_session_s *session)
     ipv4.protocol = PROTOCOL_IPV4_IGMP;
     ipv4.router_alert_option = true;
     ipv4.next = &igmp;
-    for(i=0; i < IGMP_MAX_GROUPS; i++) {
+    for(i=0; i < session->igmp_group_count; i++) {
         if(session->igmp_groups[i].send && session->igmp_groups[i].state) {
+            if(igmp.group_records == IGMP_MAX_GROUPS) {
+                /* Remaining groups are sent with the next report. */
+                break;
+            }
             group = &session->igmp_groups[i];
             if(group->state == IGMP_GROUP_LEAVING) {
                 if(is_join) {
@@ -437,6 +418,8 @@ bbl_encode_packet_pap_request (bbl_session_s *session) {
     bbl_pppoe_session_t pppoe = {0};
     bbl_pap_t pap = {0};
 
+    session->auth_retries++;
+
     interface = session->interface;
     ctx = interface->ctx;
     interface->stats.pap_tx++;
@@ -488,6 +471,8 @@ bbl_encode_packet_chap_response (bbl_session_s *session) {
     bbl_pppoe_session_t pppoe = {0};
     bbl_chap_t chap = {0};
 
+    session->auth_retries++;
+
     interface = session->interface;
     ctx = interface->ctx;
     interface->stats.chap_tx++;
@@ -762,6 +747,8 @@ bbl_encode_packet_ip6cp_request (bbl_session_s *session) {
     bbl_pppoe_session_t pppoe = {0};
     bbl_ip6cp_t ip6cp = {0};
 
+    session->ip6cp_retries++;
+
     if(session->ip6cp_state == BBL_PPP_CLOSED || session->ip6cp_state == BBL_PPP_OPENED) {
         return WRONG_PROTOCOL_STATE;
     }
@@ -867,6 +854,8 @@ bbl_encode_packet_ipcp_request (bbl_session_s *session) {
     bbl_pppoe_session_t pppoe = {0};
     bbl_ipcp_t ipcp = {0};
 
+    session->ipcp_retries++;
+
     if(session->ipcp_state == BBL_PPP_CLOSED || session->ipcp_state == BBL_PPP_OPENED) {
         return WRONG_PROTOCOL_STATE;
     }
@@ -988,6 +977,8 @@ bbl_encode_packet_lcp_request (bbl_session_s *session) {
     bbl_lcp_t lcp = {0};
     uint16_t timeout = 1; /* default timeout 1 second */
 
+    session->lcp_retries++;
+
     interface = session->interface;
     ctx = interface->ctx;
     interface->stats.lcp_tx++;
@@ -1505,111 +1496,159 @@ bbl_encode_packet_cfm_cc (bbl_session_s *session)
     return encode_ethernet(session->write_buf, &session->write_idx, &eth);
 }
 
+typedef protocol_error_t (*bbl_encode_packet_fn)(bbl_session_s *session);
+
+/*
+ * Session send request handler table indexed by
+ * the bit position of the corresponding send request.
+ */
+static const struct {
+    bbl_encode_packet_fn encode;
+    bool keep; /* request is reset by handler */
+} bbl_encode_packet_handler[32] = {
+    [__builtin_ctz(BBL_SEND_DISCOVERY)]         = { bbl_encode_packet_discovery, false },
+    [__builtin_ctz(BBL_SEND_LCP_REQUEST)]       = { bbl_encode_packet_lcp_request, false },
+    [__builtin_ctz(BBL_SEND_LCP_RESPONSE)]      = { bbl_encode_packet_lcp_response, false },
+    [__builtin_ctz(BBL_SEND_PAP_REQUEST)]       = { bbl_encode_packet_pap_request, false },
+    [__builtin_ctz(BBL_SEND_CHAP_RESPONSE)]     = { bbl_encode_packet_chap_response, false },
+    [__builtin_ctz(BBL_SEND_IPCP_REQUEST)]      = { bbl_encode_packet_ipcp_request, false },
+    [__builtin_ctz(BBL_SEND_IPCP_RESPONSE)]     = { bbl_encode_packet_ipcp_response, false },
+    [__builtin_ctz(BBL_SEND_IP6CP_REQUEST)]     = { bbl_encode_packet_ip6cp_request, false },
+    [__builtin_ctz(BBL_SEND_IP6CP_RESPONSE)]    = { bbl_encode_packet_ip6cp_response, false },
+    [__builtin_ctz(BBL_SEND_ICMPV6_RS)]         = { bbl_encode_packet_icmpv6_rs, false },
+    [__builtin_ctz(BBL_SEND_DHCPV6_REQUEST)]    = { bbl_encode_packet_dhcpv6_request, false },
+    [__builtin_ctz(BBL_SEND_IGMP)]              = { bbl_encode_packet_igmp, true },
+    [__builtin_ctz(BBL_SEND_ARP_REQUEST)]       = { bbl_encode_packet_arp_request, false },
+    [__builtin_ctz(BBL_SEND_ARP_REPLY)]         = { bbl_encode_packet_arp_reply, false },
+    [__builtin_ctz(BBL_SEND_DHCP_REQUEST)]      = { bbl_encode_packet_dhcp, false },
+    [__builtin_ctz(BBL_SEND_CFM_CC)]            = { bbl_encode_packet_cfm_cc, false },
+};
+
+/**
+ * bbl_encode_packet
+ *
+ * Encode the first pending send request of the given
+ * send class. Requests without handler are silently
+ * discarded.
+ *
+ * @param session session
+ * @param class send class
+ * @param buf send buffer
+ * @param len send buffer length (out)
+ * @return protocol error code
+ */
 protocol_error_t
-bbl_encode_packet (bbl_session_s *session, uint8_t *buf, uint16_t *len, bool *accounting)
+bbl_encode_packet (bbl_session_s *session, bbl_tx_class_t class, uint8_t *buf, uint16_t *len)
 {
     protocol_error_t result = UNKNOWN_PROTOCOL;
+    uint32_t requests;
+    uint32_t request;
+    int index;
 
     /* Reset write buffer. */
     session->write_buf = buf;
     session->write_idx = 0;
 
-    if(session->send_requests & BBL_SEND_DISCOVERY) {
-        result = bbl_encode_packet_discovery(session);
-        session->send_requests &= ~BBL_SEND_DISCOVERY;
-    } else if (session->send_requests & BBL_SEND_LCP_REQUEST) {
-        result = bbl_encode_packet_lcp_request(session);
-        session->send_requests &= ~BBL_SEND_LCP_REQUEST;
-        session->lcp_retries++;
-    } else if (session->send_requests & BBL_SEND_LCP_RESPONSE) {
-        result = bbl_encode_packet_lcp_response(session);
-        session->send_requests &= ~BBL_SEND_LCP_RESPONSE;
-    } else if (session->send_requests & BBL_SEND_PAP_REQUEST) {
-        result = bbl_encode_packet_pap_request(session);
-        session->send_requests &= ~BBL_SEND_PAP_REQUEST;
-        session->auth_retries++;
-    } else if (session->send_requests & BBL_SEND_CHAP_RESPONSE) {
-        result = bbl_encode_packet_chap_response(session);
-        session->send_requests &= ~BBL_SEND_CHAP_RESPONSE;
-        session->auth_retries++;
-    } else if (session->send_requests & BBL_SEND_IPCP_REQUEST) {
-        result = bbl_encode_packet_ipcp_request(session);
-        session->send_requests &= ~BBL_SEND_IPCP_REQUEST;
-        session->ipcp_retries++;
-    } else if (session->send_requests & BBL_SEND_IPCP_RESPONSE) {
-        result = bbl_encode_packet_ipcp_response(session);
-        session->send_requests &= ~BBL_SEND_IPCP_RESPONSE;
-    } else if (session->send_requests & BBL_SEND_IP6CP_REQUEST) {
-        result = bbl_encode_packet_ip6cp_request(session);
-        session->send_requests &= ~BBL_SEND_IP6CP_REQUEST;
-        session->ip6cp_retries++;
-    } else if (session->send_requests & BBL_SEND_IP6CP_RESPONSE) {
-        result = bbl_encode_packet_ip6cp_response(session);
-        session->send_requests &= ~BBL_SEND_IP6CP_RESPONSE;
-    } else if (session->send_requests & BBL_SEND_ICMPV6_RS) {
-        result = bbl_encode_packet_icmpv6_rs(session);
-        session->send_requests &= ~BBL_SEND_ICMPV6_RS;
-    } else if (session->send_requests & BBL_SEND_DHCPV6_REQUEST) {
-        result = bbl_encode_packet_dhcpv6_request(session);
-        session->send_requests &= ~BBL_SEND_DHCPV6_REQUEST;
-    } else if (session->send_requests & BBL_SEND_IGMP) {
-        result = bbl_encode_packet_igmp(session);
-    }  else if (session->send_requests & BBL_SEND_SESSION_IPV4) {
-        result = bbl_encode_packet_session_ipv4(session);
-        session->send_requests &= ~BBL_SEND_SESSION_IPV4;
-        *accounting = true;
-    } else if (session->send_requests & BBL_SEND_SESSION_IPV6) {
-        result = bbl_encode_packet_session_ipv6(session);
-        session->send_requests &= ~BBL_SEND_SESSION_IPV6;
-        *accounting = true;
-    } else if (session->send_requests & BBL_SEND_SESSION_IPV6PD) {
-        result = bbl_encode_packet_session_ipv6pd(session);
-        session->send_requests &= ~BBL_SEND_SESSION_IPV6PD;
-        *accounting = true;
-    } else if (session->send_requests & BBL_SEND_ARP_REQUEST) {
-        result = bbl_encode_packet_arp_request(session);
-        session->send_requests &= ~BBL_SEND_ARP_REQUEST;
-    } else if (session->send_requests & BBL_SEND_ARP_REPLY) {
-        result = bbl_encode_packet_arp_reply(session);
-        session->send_requests &= ~BBL_SEND_ARP_REPLY;
-    } else if (session->send_requests & BBL_SEND_DHCP_REQUEST) {
-        result = bbl_encode_packet_dhcp(session);
-        session->send_requests &= ~BBL_SEND_DHCP_REQUEST;
-    } else if (session->send_requests & BBL_SEND_CFM_CC) {
-        result = bbl_encode_packet_cfm_cc(session);
-        session->send_requests &= ~BBL_SEND_CFM_CC;
-    } else {
-        session->send_requests = 0;
+    requests = session->send_requests & bbl_session_tx_class_mask[class];
+    while(requests) {
+        index = __builtin_ctz(requests);
+        request = 1U << index;
+        if(bbl_encode_packet_handler[index].encode) {
+            result = bbl_encode_packet_handler[index].encode(session);
+            if(!bbl_encode_packet_handler[index].keep) {
+                session->send_requests &= ~request;
+            }
+            break;
+        }
+        session->send_requests &= ~request;
+        requests &= ~request;
     }
 
     *len = session->write_idx;
     return result;
 }
 
-protocol_error_t
-bbl_encode_network_packet (bbl_interface_s *interface, bbl_session_s *session, uint8_t *buf, uint16_t *len)
-{
-    protocol_error_t result = UNKNOWN_PROTOCOL;
+static protocol_error_t (*bbl_encode_packet_session_traffic[BBL_SESSION_TRAFFIC_MAX])(bbl_session_s *session) = {
+    [BBL_SESSION_TRAFFIC_IPV4]      = bbl_encode_packet_session_ipv4,
+    [BBL_SESSION_TRAFFIC_IPV6]      = bbl_encode_packet_session_ipv6,
+    [BBL_SESSION_TRAFFIC_IPV6PD]    = bbl_encode_packet_session_ipv6pd,
+};
 
-    /* Reset write buffer. */
-    session->write_buf = buf;
-    session->write_idx = 0;
+static protocol_error_t (*bbl_encode_network_packet_session_traffic[BBL_SESSION_TRAFFIC_MAX])(bbl_interface_s *interface, bbl_session_s *session) = {
+    [BBL_SESSION_TRAFFIC_IPV4]      = bbl_encode_packet_network_session_ipv4,
+    [BBL_SESSION_TRAFFIC_IPV6]      = bbl_encode_packet_network_session_ipv6,
+    [BBL_SESSION_TRAFFIC_IPV6PD]    = bbl_encode_packet_network_session_ipv6pd,
+};
 
-    if (session->network_send_requests & BBL_SEND_SESSION_IPV4) {
-        result = bbl_encode_packet_network_session_ipv4(interface, session);
-        session->network_send_requests &= ~BBL_SEND_SESSION_IPV4;
-    } else if (session->network_send_requests & BBL_SEND_SESSION_IPV6) {
-        result = bbl_encode_packet_network_session_ipv6(interface, session);
-        session->network_send_requests &= ~BBL_SEND_SESSION_IPV6;
-    } else if (session->network_send_requests & BBL_SEND_SESSION_IPV6PD) {
-        result = bbl_encode_packet_network_session_ipv6pd(interface, session);
-        session->network_send_requests &= ~BBL_SEND_SESSION_IPV6PD;
-    } else {
-        session->network_send_requests = 0;
+static bool
+bbl_tx_session_traffic_pending(bbl_interface_s *interface)
+{
+    int type;
+    for(type = 0; type < BBL_SESSION_TRAFFIC_MAX; type++) {
+        if(interface->session_traffic[type].pending) {
+            return true;
+        }
     }
+    return false;
+}
 
-    *len = session->write_idx;
-    return result;
+/**
+ * bbl_tx_session_traffic
+ *
+ * Write the next packet of the interface session traffic
+ * generator directly into the send buffer. The prebuilt
+ * session traffic templates are copied and only sequence
+ * number and timestamp are updated.
+ *
+ * @param interface interface
+ * @param buf send buffer
+ * @param len send buffer length (out)
+ * @return EMPTY if no packet is pending in the current round
+ */
+static protocol_error_t
+bbl_tx_session_traffic(bbl_interface_s *interface, uint8_t *buf, uint16_t *len)
+{
+    protocol_error_t result;
+    bbl_session_traffic_gen_s *gen;
+    bbl_session_s *session;
+    int type;
+
+    for(type = 0; type < BBL_SESSION_TRAFFIC_MAX; type++) {
+        gen = &interface->session_traffic[type];
+        while(gen->pending) {
+            gen->pending--;
+            if(gen->cursor >= gen->count) {
+                gen->cursor = 0;
+            }
+            session = gen->session[gen->cursor++];
+            if(!bbl_session_traffic_ready(session, type)) {
+                continue;
+            }
+            session->write_buf = buf;
+            session->write_idx = 0;
+            if(interface->type == INTERFACE_TYPE_ACCESS) {
+                result = bbl_encode_packet_session_traffic[type](session);
+                if(result != PROTOCOL_SUCCESS) {
+                    continue;
+                }
+                session->stats.packets_tx++;
+                session->stats.bytes_tx += session->write_idx;
+                session->stats.accounting_packets_tx++;
+                session->stats.accounting_bytes_tx += session->write_idx;
+            } else {
+                result = bbl_encode_network_packet_session_traffic[type](interface, session);
+                if(result != PROTOCOL_SUCCESS) {
+                    continue;
+                }
+                if(session->a10nsp_session) {
+                    session->a10nsp_session->stats.packets_tx++;
+                }
+            }
+            *len = session->write_idx;
+            return PROTOCOL_SUCCESS;
+        }
+    }
+    return EMPTY;
 }
 
 void
@@ -1681,6 +1720,52 @@ bbl_encode_interface_packet (bbl_interface_s *interface, uint8_t *buf, uint16_t
     return result;
 }
 
+/**
+ * bbl_tx_class_select
+ *
+ * Select the next send class to be served on an access interface.
+ * The send classes are served in order of priority but each
+ * class is allowed to send only as many packets as configured
+ * by its weight in one round. A new round starts if all classes
+ * with pending packets have consumed their credits. The traffic
+ * class is served by the session traffic generator.
+ *
+ * @param ctx global context
+ * @param interface access interface
+ * @param class selected class (out)
+ * @return false if nothing to send
+ */
+static bool
+bbl_tx_class_select(bbl_ctx_s *ctx, bbl_interface_s *interface, bbl_tx_class_t *class)
+{
+    int round;
+    int c;
+    bool pending;
+
+    for(round = 0; round < 2; round++) {
+        for(c = 0; c < BBL_TX_CLASS_MAX; c++) {
+            if(!interface->session_tx_class_credit[c]) {
+                continue;
+            }
+            if(c == BBL_TX_CLASS_TRAFFIC) {
+                pending = bbl_tx_session_traffic_pending(interface);
+            } else {
+                pending = !CIRCLEQ_EMPTY(&interface->session_tx_class_qhead[c]);
+            }
+            if(pending) {
+                interface->session_tx_class_credit[c]--;
+                *class = c;
+                return true;
+            }
+        }
+        /* Start new round. */
+        for(c = 0; c < BBL_TX_CLASS_MAX; c++) {
+            interface->session_tx_class_credit[c] = ctx->config.tx_class_weight[c];
+        }
+    }
+    return false;
+}
+
 /**
  * bbl_tx
  *
@@ -1698,8 +1783,7 @@ bbl_tx(bbl_ctx_s *ctx, bbl_interface_s *interface, uint8_t *buf, uint16_t *len)
     protocol_error_t result = EMPTY; /* EMPTY means that everthing was send */
     bbl_session_s *session;
     bbl_l2tp_queue_t *l2tpq;
-
-    bool accounting;
+    bbl_tx_class_t class;
 
     /* Write per interface frames like ARP, ICMPv6 NS or LLDP. */
     if(interface->send_requests) {
@@ -1719,51 +1803,33 @@ bbl_tx(bbl_ctx_s *ctx, bbl_interface_s *interface, uint8_t *buf, uint16_t *len)
     switch(interface->type) {
         case INTERFACE_TYPE_ACCESS:
             /* Write per session frames. */
-            if (!CIRCLEQ_EMPTY(&interface->session_tx_qhead)) {
-                session = CIRCLEQ_FIRST(&interface->session_tx_qhead);
-
-                if(session->send_requests != 0) {
-                    accounting = false;
-                    result = bbl_encode_packet(session, buf, len, &accounting);
-                    if(result == PROTOCOL_SUCCESS) {
-                        session->stats.packets_tx++;
-                        session->stats.bytes_tx += *len;
-                        if(accounting) {
-                            session->stats.accounting_packets_tx++;
-                            session->stats.accounting_bytes_tx += *len;
-                        }
-                    }
-                    /* Remove only from TX queue if all requests are processed! */
-                    if(session->send_requests == 0) {
-                        bbl_session_tx_qnode_remove(session);
-                    } else {
-                        /* Move to the end. */
-                        bbl_session_tx_qnode_remove(session);
-                        bbl_session_tx_qnode_insert(session);
+            while(bbl_tx_class_select(ctx, interface, &class)) {
+                if(class == BBL_TX_CLASS_TRAFFIC) {
+                    result = bbl_tx_session_traffic(interface, buf, len);
+                    if(result == EMPTY) {
+                        continue;
                     }
-                } else {
-                    bbl_session_tx_qnode_remove(session);
+                    return result;
                 }
+                session = CIRCLEQ_FIRST(&interface->session_tx_class_qhead[class]);
+                result = bbl_encode_packet(session, class, buf, len);
+                if(result == PROTOCOL_SUCCESS) {
+                    session->stats.packets_tx++;
+                    session->stats.bytes_tx += *len;
+                }
+                /* Remove from class TX queue and add again (to the end)
+                 * if there are further requests pending. This also adds
+                 * the session to the queues of other classes with
+                 * requests added during encode. */
+                bbl_session_tx_qnode_remove(session, class);
+                bbl_session_tx_qnode_insert(session);
                 return result;
             }
             break;
         case INTERFACE_TYPE_NETWORK:
-            /* Write per session frames. */
-            if (!CIRCLEQ_EMPTY(&interface->session_tx_qhead)) {
-                session = CIRCLEQ_FIRST(&interface->session_tx_qhead);
-                if(session->network_send_requests != 0) {
-                    result = bbl_encode_network_packet(interface, session, buf, len);
-                    /* Remove only from TX queue if all requests are processed! */
-                    if(session->network_send_requests == 0) {
-                        bbl_session_network_tx_qnode_remove(session);
-                    } else {
-                        /* Move to the end. */
-                        bbl_session_network_tx_qnode_remove(session);
-                        bbl_session_network_tx_qnode_insert(session);
-                    }
-                } else {
-                    bbl_session_network_tx_qnode_remove(session);
-                }
+            /* Write session traffic. */
+            result = bbl_tx_session_traffic(interface, buf, len);
+            if(result != EMPTY) {
                 return result;
             }
             /* Write L2TP frames. */
@@ -1784,11 +1850,8 @@ bbl_tx(bbl_ctx_s *ctx, bbl_interface_s *interface, uint8_t *buf, uint16_t *len)
             /* Write Multicast frames. */
             if(ctx->config.send_multicast_traffic && ctx->config.igmp_group_count && ctx->multicast_traffic) {
                 if(interface->mc_packet_cursor < ctx->config.igmp_group_count) {
-                    memcpy(buf, interface->mc_packets + (interface->mc_packet_cursor*interface->mc_packet_len), interface->mc_packet_len);
-                    *(uint64_t*)(buf + (interface->mc_packet_len - 16)) = interface->mc_packet_seq;
-                    *(uint32_t*)(buf + (interface->mc_packet_len - 8)) = interface->tx_timestamp.tv_sec;
-                    *(uint32_t*)(buf + (interface->mc_packet_len - 4)) = interface->tx_timestamp.tv_nsec;
-                    *len = interface->mc_packet_len;
+                    *len = bbl_template_write(&interface->mc_templates[interface->mc_packet_cursor], buf,
+                                              interface->mc_packet_seq, &interface->tx_timestamp);
                     interface->mc_packet_cursor++;
                     interface->stats.mc_tx++;
                     return PROTOCOL_SUCCESS;
@@ -1801,30 +1864,8 @@ bbl_tx(bbl_ctx_s *ctx, bbl_interface_s *interface, uint8_t *buf, uint16_t *len)
             }
             break;
         case INTERFACE_TYPE_A10NSP:
-            /* Write per session frames. */
-            if (!CIRCLEQ_EMPTY(&interface->session_tx_qhead)) {
-                session = CIRCLEQ_FIRST(&interface->session_tx_qhead);
-                if(session->network_send_requests != 0) {
-                    result = bbl_encode_network_packet(interface, session, buf, len);
-                    if(result == PROTOCOL_SUCCESS) {
-                        if(session->a10nsp_session) {
-                            session->a10nsp_session->stats.packets_tx++;
-                        }
-                    }
-                    /* Remove only from TX queue if all requests are processed! */
-                    if(session->network_send_requests == 0) {
-                        bbl_session_network_tx_qnode_remove(session);
-                    } else {
-                        /* Move to the end. */
-                        bbl_session_network_tx_qnode_remove(session);
-                        bbl_session_network_tx_qnode_insert(session);
-                    }
-                } else {
-                    bbl_session_network_tx_qnode_remove(session);
-                }
-                return result;
-            }
-            break;
+            /* Write session traffic. */
+            return bbl_tx_session_traffic(interface, buf, len);
         default:
             break;
     }
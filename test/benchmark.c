@@ -0,0 +1,522 @@
+/*
+ * BNG Blaster (BBL) - Protocols Benchmark
+ *
+ * This simple application replays a fixed set of
+ * representative packets through the protocols decode
+ * and encode functions of the BNG Blaster in tight loops
+ * and prints the cost per packet as one JSON object per
+ * line, suitable for tracking regressions over time.
+ *
+ * Each packet is also verified once before measuring
+ * (decode result and stable re-encode), so the benchmark
+ * fails with a non-zero exit code if a codec breaks.
+ *
+ * Copyright (C) 2020-2021, RtBrick, Inc.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <bbl.h>
+#include <bbl_protocols.h>
+
+#define BENCHMARK_ITERATIONS_DEFAULT    1000000
+#define BENCHMARK_BUFFER_LEN            2048
+#define BENCHMARK_CHECKSUM_LEN          1500
+
+typedef struct benchmark_case_ {
+    const char *name;
+    uint8_t packet[BENCHMARK_BUFFER_LEN];
+    uint16_t len;
+
+    /* Headers used to encode the packet */
+    bbl_ethernet_header_t eth;
+    bbl_pppoe_session_t pppoe;
+    bbl_ipv4_t ipv4;
+    bbl_ipv6_t ipv6;
+    bbl_udp_t udp;
+    bbl_l2tp_t l2tp;
+    bbl_ipv4_t l2tp_ipv4;
+    bbl_udp_t l2tp_udp;
+    bbl_dhcp_t dhcp;
+    struct dhcp_header dhcp_header;
+    bbl_bbl_t bbl;
+
+    bool encode; /* packet can be encoded from headers */
+    bool bbl_fast; /* packet is accepted by BBL fast path */
+    bbl_template_t tpl;
+} benchmark_case_t;
+
+static uint8_t g_mac_client[ETH_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static uint8_t g_mac_server[ETH_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+static ipv6addr_t g_ipv6_client = {0xfc, 0x66, 0x10, [15] = 0x01};
+static ipv6addr_t g_ipv6_server = {0xfc, 0x66, 0x20, [15] = 0x02};
+
+static uint8_t g_scratchpad[SCRATCHPAD_LEN];
+static uint8_t g_buf[BENCHMARK_BUFFER_LEN];
+static volatile uint64_t g_sink;
+
+static inline uint64_t
+benchmark_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline uint64_t
+benchmark_nsec() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void
+benchmark_report(const char *name, const char *op, uint32_t iterations,
+                 uint64_t nsec, uint64_t cycles) {
+    printf("{\"case\": \"%s\", \"op\": \"%s\", \"iterations\": %u, "
+           "\"ns-per-packet\": %.2f, \"cycles-per-packet\": %.2f}\n",
+           name, op, iterations,
+           (double)nsec / iterations, (double)cycles / iterations);
+}
+
+/*
+ * Packet builders
+ */
+
+static void
+benchmark_ethernet(benchmark_case_t *c, uint16_t type, void *next) {
+    c->eth.dst = g_mac_server;
+    c->eth.src = g_mac_client;
+    c->eth.vlan_outer = 128;
+    c->eth.vlan_inner = 7;
+    c->eth.type = type;
+    c->eth.next = next;
+}
+
+static void
+benchmark_bbl(benchmark_case_t *c, uint8_t type, uint8_t sub_type) {
+    c->bbl.type = type;
+    c->bbl.sub_type = sub_type;
+    c->bbl.direction = BBL_DIRECTION_UP;
+    c->bbl.session_id = 1;
+    c->bbl.ifindex = 1;
+    c->bbl.outer_vlan_id = 128;
+    c->bbl.inner_vlan_id = 7;
+    c->bbl.flow_id = 1;
+    c->bbl.padding = 16;
+    c->udp.src = BBL_UDP_PORT;
+    c->udp.dst = BBL_UDP_PORT;
+    c->udp.protocol = UDP_PROTOCOL_BBL;
+    c->udp.next = &c->bbl;
+}
+
+static void
+benchmark_ipv4(bbl_ipv4_t *ipv4, uint32_t src, uint32_t dst, void *next) {
+    ipv4->src = src;
+    ipv4->dst = dst;
+    ipv4->ttl = 64;
+    ipv4->protocol = PROTOCOL_IPV4_UDP;
+    ipv4->next = next;
+}
+
+static void
+benchmark_build_pppoe_ipv4(benchmark_case_t *c) {
+    c->name = "pppoe-ipv4-bbl";
+    benchmark_ethernet(c, ETH_TYPE_PPPOE_SESSION, &c->pppoe);
+    c->pppoe.session_id = 1;
+    c->pppoe.protocol = PROTOCOL_IPV4;
+    c->pppoe.next = &c->ipv4;
+    benchmark_ipv4(&c->ipv4, htobe32(0x0a000001), htobe32(0x0a000002), &c->udp);
+    benchmark_bbl(c, BBL_TYPE_UNICAST_SESSION, BBL_SUB_TYPE_IPV4);
+    c->encode = true;
+    c->bbl_fast = true;
+}
+
+static void
+benchmark_build_pppoe_ipv6(benchmark_case_t *c) {
+    c->name = "pppoe-ipv6-bbl";
+    benchmark_ethernet(c, ETH_TYPE_PPPOE_SESSION, &c->pppoe);
+    c->pppoe.session_id = 1;
+    c->pppoe.protocol = PROTOCOL_IPV6;
+    c->pppoe.next = &c->ipv6;
+    c->ipv6.src = g_ipv6_client;
+    c->ipv6.dst = g_ipv6_server;
+    c->ipv6.ttl = 64;
+    c->ipv6.protocol = IPV6_NEXT_HEADER_UDP;
+    c->ipv6.next = &c->udp;
+    benchmark_bbl(c, BBL_TYPE_UNICAST_SESSION, BBL_SUB_TYPE_IPV6);
+    c->encode = true;
+    c->bbl_fast = true;
+}
+
+static void
+benchmark_build_ipoe_dhcp(benchmark_case_t *c) {
+    c->name = "ipoe-dhcp";
+    benchmark_ethernet(c, ETH_TYPE_IPV4, &c->ipv4);
+    benchmark_ipv4(&c->ipv4, htobe32(0x0a000001), IPV4_BROADCAST, &c->udp);
+    c->udp.src = DHCP_UDP_SERVER;
+    c->udp.dst = DHCP_UDP_CLIENT;
+    c->udp.protocol = UDP_PROTOCOL_DHCP;
+    c->udp.next = &c->dhcp;
+    c->dhcp_header.op = BOOTREPLY;
+    c->dhcp_header.htype = 1;
+    c->dhcp_header.hlen = ETH_ADDR_LEN;
+    c->dhcp_header.xid = htobe32(0x12345678);
+    c->dhcp_header.yiaddr = htobe32(0x0a000002);
+    memcpy(c->dhcp_header.chaddr, g_mac_client, ETH_ADDR_LEN);
+    c->dhcp.header = &c->dhcp_header;
+    c->dhcp.type = DHCP_MESSAGE_OFFER;
+    c->dhcp.option_server_identifier = true;
+    c->dhcp.server_identifier = htobe32(0x0a000001);
+    c->dhcp.option_address = true;
+    c->dhcp.address = htobe32(0x0a000002);
+    c->encode = true;
+}
+
+static void
+benchmark_build_l2tp(benchmark_case_t *c) {
+    c->name = "l2tp-ipv4-bbl";
+    c->eth.dst = g_mac_server;
+    c->eth.src = g_mac_client;
+    c->eth.type = ETH_TYPE_IPV4;
+    c->eth.next = &c->ipv4;
+    benchmark_ipv4(&c->ipv4, htobe32(0x0a640001), htobe32(0x0a640002), &c->udp);
+    c->udp.src = L2TP_UDP_PORT;
+    c->udp.dst = L2TP_UDP_PORT;
+    c->udp.protocol = UDP_PROTOCOL_L2TP;
+    c->udp.next = &c->l2tp;
+    c->l2tp.tunnel_id = 1;
+    c->l2tp.session_id = 1;
+    c->l2tp.protocol = PROTOCOL_IPV4;
+    c->l2tp.next = &c->l2tp_ipv4;
+    benchmark_ipv4(&c->l2tp_ipv4, htobe32(0x0a000001), htobe32(0x0a000002), &c->l2tp_udp);
+    c->l2tp_udp.src = BBL_UDP_PORT;
+    c->l2tp_udp.dst = BBL_UDP_PORT;
+    c->l2tp_udp.protocol = UDP_PROTOCOL_BBL;
+    c->l2tp_udp.next = &c->bbl;
+    c->bbl.type = BBL_TYPE_UNICAST_SESSION;
+    c->bbl.sub_type = BBL_SUB_TYPE_IPV4;
+    c->bbl.direction = BBL_DIRECTION_DOWN;
+    c->bbl.session_id = 1;
+    c->bbl.flow_id = 1;
+    c->encode = true;
+}
+
+static void
+benchmark_build_multicast(benchmark_case_t *c) {
+    c->name = "multicast-ipv4-bbl";
+    c->eth.dst = g_mac_server;
+    c->eth.src = g_mac_client;
+    c->eth.vlan_outer = 128;
+    c->eth.type = ETH_TYPE_IPV4;
+    c->eth.next = &c->ipv4;
+    benchmark_ipv4(&c->ipv4, htobe32(0x0a000001), htobe32(0xef000001), &c->udp);
+    benchmark_bbl(c, BBL_TYPE_MULTICAST, BBL_SUB_TYPE_IPV4);
+    c->bbl.direction = BBL_DIRECTION_DOWN;
+    c->bbl.mc_source = c->ipv4.src;
+    c->bbl.mc_group = c->ipv4.dst;
+    c->encode = true;
+    c->bbl_fast = true;
+}
+
+/*
+ * QMX LI packets are received only, so there is no
+ * encode function. The outer IPv4/UDP headers are
+ * encoded empty and the LI header and mirrored frame
+ * (the PPPoE IPv4 case) are appended manually.
+ */
+static void
+benchmark_build_qmx_li(benchmark_case_t *c, benchmark_case_t *inner) {
+    uint16_t len = 0;
+    c->name = "qmx-li";
+    c->eth.dst = g_mac_server;
+    c->eth.src = g_mac_client;
+    c->eth.type = ETH_TYPE_IPV4;
+    c->eth.next = &c->ipv4;
+    benchmark_ipv4(&c->ipv4, htobe32(0x0a640001), htobe32(0x0a640002), &c->udp);
+    c->udp.src = QMX_LI_UDP_PORT;
+    c->udp.dst = QMX_LI_UDP_PORT;
+    encode_ethernet(c->packet, &len, &c->eth);
+
+    /* Direction up, packet type 5, LIID 1 */
+    *(uint32_t*)(c->packet + len) = htobe32(0x2a000001);
+    len += sizeof(uint32_t);
+    memcpy(c->packet + len, inner->packet, inner->len);
+    len += inner->len;
+    c->len = len;
+
+    /* Fix outer IPv4 total length and checksum
+     * and UDP length (UDP checksum is zero). */
+    *(uint16_t*)(c->packet + 16) = htobe16(len - 14);
+    *(uint16_t*)(c->packet + 24) = 0;
+    *(uint16_t*)(c->packet + 24) = bbl_checksum(c->packet + 14, 20);
+    *(uint16_t*)(c->packet + 38) = htobe16(len - 34);
+    *(uint16_t*)(c->packet + 40) = 0;
+}
+
+/*
+ * Verify that decode returns the expected header chain.
+ */
+static bool
+benchmark_verify(benchmark_case_t *c) {
+    bbl_ethernet_header_t *eth;
+    bbl_ethernet_header_t *fast_eth;
+    bbl_pppoe_session_t *pppoe;
+    bbl_ipv4_t *ipv4;
+    bbl_udp_t *udp;
+    bbl_bbl_t *bbl = NULL;
+    uint8_t tos;
+    uint16_t len = 0;
+
+    if(decode_ethernet(c->packet, c->len, g_scratchpad, SCRATCHPAD_LEN, &eth) != PROTOCOL_SUCCESS) {
+        fprintf(stderr, "%s: decode failed\n", c->name);
+        return false;
+    }
+    if(eth->type != c->eth.type) {
+        fprintf(stderr, "%s: unexpected ethertype %04x\n", c->name, eth->type);
+        return false;
+    }
+    if(eth->type == ETH_TYPE_PPPOE_SESSION) {
+        pppoe = eth->next;
+        if(pppoe->protocol == PROTOCOL_IPV4) {
+            udp = ((bbl_ipv4_t*)pppoe->next)->next;
+        } else {
+            udp = ((bbl_ipv6_t*)pppoe->next)->next;
+        }
+        bbl = udp->next;
+    } else {
+        ipv4 = eth->next;
+        udp = ipv4->next;
+        if(udp->protocol != c->udp.protocol && c->udp.protocol) {
+            fprintf(stderr, "%s: unexpected UDP protocol %u\n", c->name, udp->protocol);
+            return false;
+        }
+        switch(udp->protocol) {
+            case UDP_PROTOCOL_BBL:
+                bbl = udp->next;
+                break;
+            case UDP_PROTOCOL_L2TP:
+                ipv4 = ((bbl_l2tp_t*)udp->next)->next;
+                bbl = ((bbl_udp_t*)ipv4->next)->next;
+                break;
+            case UDP_PROTOCOL_DHCP:
+                if(((bbl_dhcp_t*)udp->next)->type != DHCP_MESSAGE_OFFER) {
+                    fprintf(stderr, "%s: unexpected DHCP message\n", c->name);
+                    return false;
+                }
+                break;
+            case UDP_PROTOCOL_QMX_LI:
+                if(((bbl_qmx_li_t*)udp->next)->liid != 1) {
+                    fprintf(stderr, "%s: unexpected LIID\n", c->name);
+                    return false;
+                }
+                break;
+            default:
+                fprintf(stderr, "%s: unexpected UDP protocol %u\n", c->name, udp->protocol);
+                return false;
+        }
+    }
+    if(bbl && (bbl->flow_id != c->bbl.flow_id || bbl->sub_type != c->bbl.sub_type)) {
+        fprintf(stderr, "%s: unexpected BBL header\n", c->name);
+        return false;
+    }
+    if(c->bbl_fast) {
+        if(decode_bbl_fast(c->packet, c->len, g_scratchpad, SCRATCHPAD_LEN, &fast_eth, &tos) != PROTOCOL_SUCCESS) {
+            fprintf(stderr, "%s: BBL fast path decode failed\n", c->name);
+            return false;
+        }
+    }
+    if(c->encode) {
+        /* Encode must be stable */
+        if(encode_ethernet(g_buf, &len, &c->eth) != PROTOCOL_SUCCESS ||
+           len != c->len || memcmp(g_buf, c->packet, len) != 0) {
+            fprintf(stderr, "%s: encode mismatch\n", c->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Measurements
+ */
+
+static void
+benchmark_decode(benchmark_case_t *c, uint32_t iterations) {
+    bbl_ethernet_header_t *eth;
+    uint64_t nsec, cycles;
+    uint32_t i;
+
+    nsec = benchmark_nsec();
+    cycles = benchmark_cycles();
+    for(i = 0; i < iterations; i++) {
+        g_sink += decode_ethernet(c->packet, c->len, g_scratchpad, SCRATCHPAD_LEN, &eth);
+        g_sink += eth->type;
+    }
+    cycles = benchmark_cycles() - cycles;
+    nsec = benchmark_nsec() - nsec;
+    benchmark_report(c->name, "decode", iterations, nsec, cycles);
+}
+
+static void
+benchmark_decode_header(benchmark_case_t *c, uint32_t iterations) {
+    bbl_ethernet_header_t *eth;
+    uint64_t nsec, cycles;
+    uint32_t i;
+
+    nsec = benchmark_nsec();
+    cycles = benchmark_cycles();
+    for(i = 0; i < iterations; i++) {
+        g_sink += decode_ethernet_header(c->packet, c->len, g_scratchpad, SCRATCHPAD_LEN, &eth);
+        g_sink += eth->type;
+    }
+    cycles = benchmark_cycles() - cycles;
+    nsec = benchmark_nsec() - nsec;
+    benchmark_report(c->name, "decode-header", iterations, nsec, cycles);
+}
+
+static void
+benchmark_decode_fast(benchmark_case_t *c, uint32_t iterations) {
+    bbl_ethernet_header_t *eth;
+    uint64_t nsec, cycles;
+    uint32_t i;
+    uint8_t tos;
+
+    nsec = benchmark_nsec();
+    cycles = benchmark_cycles();
+    for(i = 0; i < iterations; i++) {
+        g_sink += decode_bbl_fast(c->packet, c->len, g_scratchpad, SCRATCHPAD_LEN, &eth, &tos);
+        g_sink += tos;
+    }
+    cycles = benchmark_cycles() - cycles;
+    nsec = benchmark_nsec() - nsec;
+    benchmark_report(c->name, "decode-bbl-fast", iterations, nsec, cycles);
+}
+
+static void
+benchmark_encode(benchmark_case_t *c, uint32_t iterations) {
+    uint64_t nsec, cycles;
+    uint32_t i;
+    uint16_t len;
+
+    nsec = benchmark_nsec();
+    cycles = benchmark_cycles();
+    for(i = 0; i < iterations; i++) {
+        len = 0;
+        g_sink += encode_ethernet(g_buf, &len, &c->eth);
+        g_sink += len;
+    }
+    cycles = benchmark_cycles() - cycles;
+    nsec = benchmark_nsec() - nsec;
+    benchmark_report(c->name, "encode", iterations, nsec, cycles);
+}
+
+static void
+benchmark_template(benchmark_case_t *c, uint32_t iterations) {
+    struct timespec timestamp = {0};
+    uint64_t nsec, cycles;
+    uint32_t i;
+
+    bbl_template_init(&c->tpl, c->packet, c->len, &c->bbl);
+
+    nsec = benchmark_nsec();
+    cycles = benchmark_cycles();
+    for(i = 0; i < iterations; i++) {
+        timestamp.tv_nsec = i;
+        g_sink += bbl_template_write(&c->tpl, g_buf, i, &timestamp);
+    }
+    cycles = benchmark_cycles() - cycles;
+    nsec = benchmark_nsec() - nsec;
+    benchmark_report(c->name, "template-write", iterations, nsec, cycles);
+}
+
+static void
+benchmark_checksum(uint32_t iterations) {
+    uint64_t nsec, cycles;
+    uint32_t i;
+
+    for(i = 0; i < BENCHMARK_CHECKSUM_LEN; i++) {
+        g_buf[i] = i;
+    }
+    nsec = benchmark_nsec();
+    cycles = benchmark_cycles();
+    for(i = 0; i < iterations; i++) {
+        g_buf[0] = i;
+        g_sink += bbl_checksum(g_buf, BENCHMARK_CHECKSUM_LEN);
+    }
+    cycles = benchmark_cycles() - cycles;
+    nsec = benchmark_nsec() - nsec;
+    benchmark_report("checksum-1500", "checksum", iterations, nsec, cycles);
+}
+
+int
+main (int argc, char **argv) {
+
+    benchmark_case_t *cases;
+    benchmark_case_t *c;
+    uint32_t iterations = BENCHMARK_ITERATIONS_DEFAULT;
+    size_t i;
+
+    void (*build[])(benchmark_case_t*) = {
+        benchmark_build_pppoe_ipv4,
+        benchmark_build_pppoe_ipv6,
+        benchmark_build_ipoe_dhcp,
+        benchmark_build_l2tp,
+        benchmark_build_multicast,
+    };
+    size_t count = sizeof(build) / sizeof(build[0]);
+
+    if(argc > 2) {
+        printf("Usage: %s [iterations]\n", argv[0]);
+        exit(1);
+    }
+    if(argc == 2) {
+        iterations = strtoul(argv[1], NULL, 10);
+        if(!iterations) {
+            fprintf(stderr, "Invalid iterations %s\n", argv[1]);
+            exit(1);
+        }
+    }
+
+    /* One additional case for QMX LI */
+    cases = calloc(count + 1, sizeof(benchmark_case_t));
+    for(i = 0; i < count; i++) {
+        c = &cases[i];
+        build[i](c);
+        if(encode_ethernet(c->packet, &c->len, &c->eth) != PROTOCOL_SUCCESS) {
+            fprintf(stderr, "%s: encode failed\n", c->name);
+            exit(1);
+        }
+    }
+    benchmark_build_qmx_li(&cases[count], &cases[0]);
+    count++;
+
+    for(i = 0; i < count; i++) {
+        if(!benchmark_verify(&cases[i])) {
+            exit(1);
+        }
+    }
+
+    for(i = 0; i < count; i++) {
+        c = &cases[i];
+        benchmark_decode(c, iterations);
+        benchmark_decode_header(c, iterations);
+        if(c->bbl_fast) {
+            benchmark_decode_fast(c, iterations);
+            benchmark_template(c, iterations);
+        }
+        if(c->encode) {
+            benchmark_encode(c, iterations);
+        }
+    }
+    benchmark_checksum(iterations);
+    free(cases);
+    return 0;
+}
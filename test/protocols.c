@@ -44,9 +44,310 @@ test_protocols_decode_pppoe_ipcp_conf_request(void **unused) {
 
 }
 
+static void
+test_protocols_decode_lazy(void **unused) {
+    (void) unused;
+
+    uint8_t *sp = calloc(1, SCRATCHPAD_LEN);
+    bbl_ethernet_header_t *eth;
+    bbl_pppoe_session_t *pppoes;
+    bbl_ipcp_t *ipcp;
+
+    assert_int_equal(decode_ethernet_header(pppoe_ipcp_conf_request, sizeof(pppoe_ipcp_conf_request), sp, SCRATCHPAD_LEN, &eth), PROTOCOL_SUCCESS);
+    assert_int_equal(eth->type, ETH_TYPE_PPPOE_SESSION);
+    assert_null(eth->next);
+    assert_false(eth->decoded);
+
+    assert_int_equal(decode_ethernet_next(eth), PROTOCOL_SUCCESS);
+    assert_true(eth->decoded);
+    pppoes = (bbl_pppoe_session_t*)eth->next;
+    assert_non_null(pppoes);
+    ipcp = (bbl_ipcp_t*)pppoes->next;
+    assert_int_equal(ipcp->code, PPP_CODE_CONF_REQUEST);
+
+    /* Second call must not decode again */
+    assert_int_equal(decode_ethernet_next(eth), PROTOCOL_SUCCESS);
+    assert_true(eth->next == pppoes);
+
+    /* Truncated payload is reported by decode_ethernet_next */
+    assert_int_equal(decode_ethernet_header(pppoe_ipcp_conf_request, 24, sp, SCRATCHPAD_LEN, &eth), PROTOCOL_SUCCESS);
+    assert_int_not_equal(decode_ethernet_next(eth), PROTOCOL_SUCCESS);
+    free(sp);
+}
+
+static void
+test_protocols_decode_bbl_fast(void **unused) {
+    (void) unused;
+
+    uint8_t *sp = calloc(1, SCRATCHPAD_LEN);
+    uint8_t buf[256];
+    uint16_t len = 0;
+    uint8_t mac[ETH_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    uint8_t tos = 0;
+
+    bbl_ethernet_header_t eth = {0};
+    bbl_pppoe_session_t pppoe = {0};
+    bbl_ipv4_t ipv4 = {0};
+    bbl_udp_t udp = {0};
+    bbl_bbl_t bbl = {0};
+
+    bbl_ethernet_header_t *rx_eth;
+    bbl_bbl_t *rx_bbl;
+
+    eth.dst = mac;
+    eth.src = mac;
+    eth.vlan_outer = 1000;
+    eth.vlan_outer_priority = 5;
+    eth.vlan_inner = 7;
+    eth.type = ETH_TYPE_PPPOE_SESSION;
+    eth.next = &pppoe;
+    pppoe.session_id = 1;
+    pppoe.protocol = PROTOCOL_IPV4;
+    pppoe.next = &ipv4;
+    ipv4.src = htobe32(0x0a000001);
+    ipv4.dst = htobe32(0x0a000002);
+    ipv4.ttl = 64;
+    ipv4.tos = 0xa0;
+    ipv4.protocol = PROTOCOL_IPV4_UDP;
+    ipv4.next = &udp;
+    udp.src = BBL_UDP_PORT;
+    udp.dst = BBL_UDP_PORT;
+    udp.protocol = UDP_PROTOCOL_BBL;
+    udp.next = &bbl;
+    bbl.padding = 16;
+    bbl.type = BBL_TYPE_UNICAST_SESSION;
+    bbl.sub_type = BBL_SUB_TYPE_IPV4;
+    bbl.session_id = 1;
+    bbl.outer_vlan_id = 1000;
+    bbl.inner_vlan_id = 7;
+    bbl.flow_id = 42;
+    bbl.flow_seq = 1;
+
+    assert_int_equal(encode_ethernet(buf, &len, &eth), PROTOCOL_SUCCESS);
+    assert_int_equal(decode_bbl_fast(buf, len, sp, SCRATCHPAD_LEN, &rx_eth, &tos), PROTOCOL_SUCCESS);
+
+    rx_bbl = (bbl_bbl_t*)rx_eth->next;
+    assert_int_equal(rx_eth->type, ETH_TYPE_PPPOE_SESSION);
+    assert_int_equal(rx_eth->vlan_outer, 1000);
+    assert_int_equal(rx_eth->vlan_outer_priority, 5);
+    assert_int_equal(rx_eth->vlan_inner, 7);
+    assert_int_equal(rx_eth->length, len);
+    assert_int_equal(tos, 0xa0);
+    assert_int_equal(rx_bbl->session_id, 1);
+    assert_int_equal(rx_bbl->flow_id, 42);
+    assert_int_equal(rx_bbl->flow_seq, 1);
+
+    /* Fragments must be passed to the regular decode path. */
+    ipv4.offset = 1;
+    len = 0;
+    assert_int_equal(encode_ethernet(buf, &len, &eth), PROTOCOL_SUCCESS);
+    assert_int_equal(decode_bbl_fast(buf, len, sp, SCRATCHPAD_LEN, &rx_eth, &tos), IGNORED);
+
+    /* Control traffic */
+    assert_int_equal(decode_bbl_fast(pppoe_ipcp_conf_request, sizeof(pppoe_ipcp_conf_request), sp, SCRATCHPAD_LEN, &rx_eth, &tos), IGNORED);
+
+    free(sp);
+}
+
+static uint16_t
+checksum_reference(uint8_t *buf, uint16_t len) {
+    uint32_t sum = 0;
+    uint16_t i;
+    for(i = 0; i + 1 < len; i += 2) {
+        sum += *(uint16_t*)(buf+i);
+    }
+    if(len & 1) {
+        sum += buf[len-1];
+    }
+    while(sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+static void
+test_protocols_checksum(void **unused) {
+    (void) unused;
+
+    uint8_t buf[1600];
+    uint8_t old[16];
+    uint16_t lengths[] = {0, 1, 2, 3, 15, 16, 17, 31, 32, 33, 64, 127, 1500, 1599};
+    uint16_t checksum;
+    uint16_t i;
+
+    for(i = 0; i < sizeof(buf); i++) {
+        buf[i] = (i * 31 + 7) & 0xff;
+    }
+    /* Vector and scalar sum must match the reference. */
+    for(i = 0; i < sizeof(lengths)/sizeof(lengths[0]); i++) {
+        assert_int_equal(bbl_checksum(buf, lengths[i]), checksum_reference(buf, lengths[i]));
+        assert_int_equal(bbl_checksum(buf+1, lengths[i]), checksum_reference(buf+1, lengths[i]));
+    }
+    memset(buf, 0xff, sizeof(buf));
+    assert_int_equal(bbl_checksum(buf, 1500), checksum_reference(buf, 1500));
+
+    /* Incremental update (RFC 1624) of sequence number and timestamp. */
+    for(i = 0; i < sizeof(buf); i++) {
+        buf[i] = (i * 13 + 1) & 0xff;
+    }
+    checksum = bbl_checksum(buf, 1000);
+    memcpy(old, buf+984, sizeof(old));
+    *(uint64_t*)(buf+984) = 0x0102030405060708;
+    *(uint32_t*)(buf+992) = 1234;
+    *(uint32_t*)(buf+996) = 0xffffffff;
+    checksum = bbl_checksum_update(checksum, old, buf+984, sizeof(old));
+    assert_int_equal(checksum, bbl_checksum(buf, 1000));
+
+    checksum = bbl_checksum_update16(checksum, *(uint16_t*)(buf+10), 0xabcd);
+    *(uint16_t*)(buf+10) = 0xabcd;
+    assert_int_equal(checksum, bbl_checksum(buf, 1000));
+}
+
+static void
+test_protocols_template(void **unused) {
+    (void) unused;
+
+    uint8_t tpl_buf[256];
+    uint8_t buf[256];
+    uint8_t expected[256];
+    uint16_t len;
+    uint16_t expected_len;
+    uint16_t padding;
+    uint8_t mac[ETH_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    ipv6addr_t src = {0xfc, 0x66, 0x10, [15] = 0x01};
+    ipv6addr_t dst = {0xfc, 0x66, 0x20, [15] = 0x02};
+    struct timespec timestamp = {.tv_sec = 123456, .tv_nsec = 999999999};
+
+    bbl_ethernet_header_t eth = {0};
+    bbl_ipv6_t ipv6 = {0};
+    bbl_udp_t udp = {0};
+    bbl_bbl_t bbl = {0};
+    bbl_template_t tpl;
+
+    eth.dst = mac;
+    eth.src = mac;
+    eth.vlan_outer = 10;
+    eth.type = ETH_TYPE_IPV6;
+    eth.next = &ipv6;
+    ipv6.src = src;
+    ipv6.dst = dst;
+    ipv6.ttl = 64;
+    ipv6.protocol = IPV6_NEXT_HEADER_UDP;
+    ipv6.next = &udp;
+    udp.src = BBL_UDP_PORT;
+    udp.dst = BBL_UDP_PORT;
+    udp.protocol = UDP_PROTOCOL_BBL;
+    udp.next = &bbl;
+    bbl.type = BBL_TYPE_UNICAST_SESSION;
+    bbl.sub_type = BBL_SUB_TYPE_IPV6;
+    bbl.flow_id = 1;
+
+    /* Even and odd padding to test aligned and
+     * unaligned incremental checksum updates. */
+    for(padding = 0; padding < 4; padding++) {
+        bbl.padding = padding;
+        bbl.flow_seq = 0;
+        bbl.timestamp.tv_sec = 0;
+        bbl.timestamp.tv_nsec = 0;
+        bbl.udp_checksum = NULL;
+        len = 0;
+        assert_int_equal(encode_ethernet(tpl_buf, &len, &eth), PROTOCOL_SUCCESS);
+        bbl_template_init(&tpl, tpl_buf, len, &bbl);
+        assert_int_equal(tpl.len, len);
+        assert_int_equal(tpl.seq_offset, len - 16);
+        assert_int_not_equal(tpl.udp_checksum_offset, 0);
+
+        bbl.flow_seq = 0x1122334455667788;
+        bbl.timestamp = timestamp;
+        expected_len = 0;
+        assert_int_equal(encode_ethernet(expected, &expected_len, &eth), PROTOCOL_SUCCESS);
+
+        /* Copy and patch */
+        assert_int_equal(bbl_template_write(&tpl, buf, bbl.flow_seq, &timestamp), expected_len);
+        assert_memory_equal(buf, expected, expected_len);
+
+        /* Patch in place */
+        bbl_template_patch(&tpl, tpl_buf, 1, &timestamp);
+        bbl_template_patch(&tpl, tpl_buf, bbl.flow_seq, &timestamp);
+        assert_memory_equal(tpl_buf, expected, expected_len);
+    }
+}
+
+static void
+test_protocols_bbl_padding(void **unused) {
+    (void) unused;
+
+    uint8_t *sp = calloc(1, SCRATCHPAD_LEN);
+    uint8_t buf[512];
+    uint8_t expected[200];
+    uint16_t len;
+    uint8_t mac[ETH_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    uint8_t tos = 0;
+    uint8_t pattern;
+
+    bbl_ethernet_header_t eth = {0};
+    bbl_ipv4_t ipv4 = {0};
+    bbl_udp_t udp = {0};
+    bbl_bbl_t bbl = {0};
+
+    bbl_ethernet_header_t *rx_eth;
+    bbl_bbl_t *rx_bbl;
+
+    eth.dst = mac;
+    eth.src = mac;
+    eth.type = ETH_TYPE_IPV4;
+    eth.next = &ipv4;
+    ipv4.src = htobe32(0x0a000001);
+    ipv4.dst = htobe32(0x0a000002);
+    ipv4.ttl = 64;
+    ipv4.protocol = PROTOCOL_IPV4_UDP;
+    ipv4.next = &udp;
+    udp.src = BBL_UDP_PORT;
+    udp.dst = BBL_UDP_PORT;
+    udp.protocol = UDP_PROTOCOL_BBL;
+    udp.next = &bbl;
+    bbl.padding = sizeof(expected);
+    bbl.type = BBL_TYPE_UNICAST_SESSION;
+    bbl.sub_type = BBL_SUB_TYPE_IPV4;
+    bbl.flow_id = 42;
+    bbl.flow_seq = 1;
+
+    for(pattern = BBL_PADDING_ZERO; pattern <= BBL_PADDING_PRBS; pattern++) {
+        bbl.padding_pattern = pattern;
+        bbl.padding_seed = bbl.flow_id;
+        len = 0;
+        assert_int_equal(encode_ethernet(buf, &len, &eth), PROTOCOL_SUCCESS);
+        assert_non_null(bbl.padding_data);
+        memcpy(expected, bbl.padding_data, sizeof(expected));
+        if(pattern == BBL_PADDING_COUNTER) {
+            assert_int_equal(expected[0], 42);
+            assert_int_equal(expected[199], (uint8_t)(42 + 199));
+        }
+
+        assert_int_equal(decode_bbl_fast(buf, len, sp, SCRATCHPAD_LEN, &rx_eth, &tos), PROTOCOL_SUCCESS);
+        rx_bbl = (bbl_bbl_t*)rx_eth->next;
+        assert_int_equal(rx_bbl->padding, sizeof(expected));
+        assert_memory_equal(rx_bbl->padding_data, expected, sizeof(expected));
+
+        /* Different seed must result in a different PRBS. */
+        if(pattern == BBL_PADDING_PRBS) {
+            bbl.padding_seed = 43;
+            len = 0;
+            assert_int_equal(encode_ethernet(buf, &len, &eth), PROTOCOL_SUCCESS);
+            assert_memory_not_equal(bbl.padding_data, expected, sizeof(expected));
+        }
+    }
+    free(sp);
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_protocols_decode_pppoe_ipcp_conf_request),
+        cmocka_unit_test(test_protocols_decode_lazy),
+        cmocka_unit_test(test_protocols_decode_bbl_fast),
+        cmocka_unit_test(test_protocols_checksum),
+        cmocka_unit_test(test_protocols_template),
+        cmocka_unit_test(test_protocols_bbl_padding),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,175 @@
+/*
+ * BNG Blaster (BBL) - Stream Tests
+ *
+ * Copyright (C) 2020-2021, RtBrick, Inc.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include <stddef.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <bbl.h>
+#include <bbl_stream.h>
+
+static bbl_ctx_s ctx;
+static bbl_stream stream;
+
+static void
+stream_init() {
+    memset(&ctx, 0x0, sizeof(ctx));
+    memset(&stream, 0x0, sizeof(stream));
+}
+
+static void
+rx_range(uint64_t first, uint64_t last) {
+    uint64_t seq;
+
+    for(seq = first; seq <= last; seq++) {
+        bbl_stream_rx_seq(&ctx, &stream, seq);
+    }
+}
+
+static void
+test_rx_seq_in_order(void **unused) {
+    (void) unused;
+
+    stream_init();
+
+    rx_range(1, 3000);
+    assert_int_equal(ctx.stats.stream_traffic_flows_verified, 1);
+    assert_int_equal(stream.rx_first_seq, 1);
+    assert_int_equal(stream.rx_last_seq, 3000);
+    assert_int_equal(stream.loss, 0);
+    assert_int_equal(stream.rx_reordered, 0);
+    assert_int_equal(stream.rx_duplicate, 0);
+    assert_int_equal(stream.rx_late, 0);
+}
+
+static void
+test_rx_seq_reorder(void **unused) {
+    (void) unused;
+
+    stream_init();
+
+    rx_range(1, 100);
+    /* 101 and 102 swapped */
+    bbl_stream_rx_seq(&ctx, &stream, 102);
+    assert_int_equal(stream.loss, 1);
+    bbl_stream_rx_seq(&ctx, &stream, 101);
+    assert_int_equal(stream.loss, 0);
+    assert_int_equal(stream.rx_reordered, 1);
+
+    /* 110 received after 200 */
+    rx_range(103, 109);
+    rx_range(111, 200);
+    assert_int_equal(stream.loss, 1);
+    bbl_stream_rx_seq(&ctx, &stream, 110);
+    assert_int_equal(stream.loss, 0);
+    assert_int_equal(stream.rx_reordered, 2);
+    assert_int_equal(stream.rx_duplicate, 0);
+    assert_int_equal(stream.rx_late, 0);
+}
+
+static void
+test_rx_seq_reorder_beyond_window(void **unused) {
+    (void) unused;
+
+    stream_init();
+
+    rx_range(1, 99);
+    rx_range(101, 100 + STREAM_SEQ_WINDOW);
+    assert_int_equal(stream.loss, 1);
+    /* 100 is the oldest sequence number in the window */
+    rx_range(101 + STREAM_SEQ_WINDOW, 101 + STREAM_SEQ_WINDOW);
+    bbl_stream_rx_seq(&ctx, &stream, 100);
+    assert_int_equal(stream.loss, 1);
+    assert_int_equal(stream.rx_reordered, 0);
+    assert_int_equal(stream.rx_late, 1);
+    assert_int_equal(stream.rx_duplicate, 0);
+}
+
+static void
+test_rx_seq_duplicate(void **unused) {
+    (void) unused;
+
+    stream_init();
+
+    rx_range(1, 100);
+    bbl_stream_rx_seq(&ctx, &stream, 100);
+    bbl_stream_rx_seq(&ctx, &stream, 50);
+    assert_int_equal(stream.rx_duplicate, 2);
+
+    /* Duplicate of reordered packet */
+    bbl_stream_rx_seq(&ctx, &stream, 102);
+    bbl_stream_rx_seq(&ctx, &stream, 101);
+    bbl_stream_rx_seq(&ctx, &stream, 101);
+    assert_int_equal(stream.rx_reordered, 1);
+    assert_int_equal(stream.rx_duplicate, 3);
+    assert_int_equal(stream.loss, 0);
+}
+
+static void
+test_rx_seq_before_first(void **unused) {
+    (void) unused;
+
+    stream_init();
+
+    rx_range(10, 20);
+    bbl_stream_rx_seq(&ctx, &stream, 5);
+    assert_int_equal(stream.rx_reordered, 1);
+    assert_int_equal(stream.loss, 0);
+    bbl_stream_rx_seq(&ctx, &stream, 5);
+    assert_int_equal(stream.rx_reordered, 1);
+    assert_int_equal(stream.rx_duplicate, 1);
+    assert_int_equal(stream.loss, 0);
+}
+
+static void
+test_rx_seq_gap(void **unused) {
+    (void) unused;
+    uint64_t seq;
+
+    stream_init();
+
+    /* Fill the whole window, so that a gap must clear
+     * stale bits of sequence numbers one window below. */
+    rx_range(1, STREAM_SEQ_WINDOW);
+    bbl_stream_rx_seq(&ctx, &stream, STREAM_SEQ_WINDOW + 500);
+    assert_int_equal(stream.loss, 499);
+    for(seq = STREAM_SEQ_WINDOW + 1; seq < STREAM_SEQ_WINDOW + 500; seq++) {
+        bbl_stream_rx_seq(&ctx, &stream, seq);
+    }
+    assert_int_equal(stream.loss, 0);
+    assert_int_equal(stream.rx_reordered, 499);
+    assert_int_equal(stream.rx_duplicate, 0);
+
+    /* Gap larger than window */
+    bbl_stream_rx_seq(&ctx, &stream, 10 * STREAM_SEQ_WINDOW);
+    assert_int_equal(stream.loss, 9 * STREAM_SEQ_WINDOW - 501);
+    bbl_stream_rx_seq(&ctx, &stream, 10 * STREAM_SEQ_WINDOW - 1);
+    bbl_stream_rx_seq(&ctx, &stream, 9 * STREAM_SEQ_WINDOW + 1);
+    assert_int_equal(stream.rx_reordered, 501);
+    assert_int_equal(stream.rx_duplicate, 0);
+    assert_int_equal(stream.loss, 9 * STREAM_SEQ_WINDOW - 503);
+
+    /* Gaps not aligned to bitmap words */
+    for(seq = 10 * STREAM_SEQ_WINDOW + 3; seq < 12 * STREAM_SEQ_WINDOW; seq += 67) {
+        bbl_stream_rx_seq(&ctx, &stream, seq);
+        bbl_stream_rx_seq(&ctx, &stream, seq - 1);
+        bbl_stream_rx_seq(&ctx, &stream, seq - 2);
+        bbl_stream_rx_seq(&ctx, &stream, seq - 1);
+    }
+    assert_int_equal(stream.rx_duplicate, (2 * STREAM_SEQ_WINDOW - 3 + 66) / 67);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_rx_seq_in_order),
+        cmocka_unit_test(test_rx_seq_reorder),
+        cmocka_unit_test(test_rx_seq_reorder_beyond_window),
+        cmocka_unit_test(test_rx_seq_duplicate),
+        cmocka_unit_test(test_rx_seq_before_first),
+        cmocka_unit_test(test_rx_seq_gap),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}